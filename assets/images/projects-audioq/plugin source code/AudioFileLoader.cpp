@@ -0,0 +1,500 @@
+#include "AudioFileLoader.h"
+#include "PeakCache.h"
+#include "SincResampler.h"
+#include <limits>
+
+/**
+ * AudioFileLoader.cpp
+ *
+ * Implements the background load pipeline:
+ *  - One reader per file (memory-mapped where possible), plus one per range
+ *    when a long file is decoded on several workers,
+ *  - Chunked decoding so a load can be cancelled and report progress,
+ *  - A streaming waveform peak pyramid built from the same chunks,
+ *    or taken from the PeakCache when the file has been analysed before,
+ *  - Conversion of decoded audio to the device rate,
+ *  - Results delivered to the message thread through MessageManager::callAsync.
+ */
+
+//==============================================================================
+class AudioFileLoader::LoadJob : public juce::ThreadPoolJob
+{
+public:
+    LoadJob(AudioFileLoader& o, juce::WeakReference<AudioFileLoader> weakO,
+        const juce::File& f, int gen, Callback cb, OverviewCallback overviewCb)
+        : juce::ThreadPoolJob("AudioFileLoadJob"),
+        owner(o), weakOwner(std::move(weakO)), file(f), jobGeneration(gen),
+        onFinished(std::move(cb)), onOverviewReady(std::move(overviewCb))
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        auto isStale = [this] { return shouldExit() || owner.generation.load() != jobGeneration; };
+
+        auto reportProgress = [this](float p)
+            {
+                if (owner.generation.load() == jobGeneration)
+                    owner.progress = p;
+            };
+
+        auto reportCachedOverview = [this](WaveformOverview::Ptr overview)
+            {
+                if (!onOverviewReady)
+                    return;
+
+                auto weak = weakOwner;
+                auto gen = jobGeneration;
+                auto cb = onOverviewReady;
+
+                juce::MessageManager::callAsync([weak, gen, cb, overview]()
+                    {
+                        if (weak != nullptr && weak->generation.load() == gen)
+                            cb(overview);
+                    });
+            };
+
+        auto result = owner.loadInternal(file, isStale, reportProgress, reportCachedOverview);
+
+        if (isStale())
+            return jobHasFinished;
+
+        // std::function must be copyable, so the result travels in a shared holder
+        auto holder = std::make_shared<std::unique_ptr<LoadedAudio>>(std::move(result));
+        auto weak = weakOwner;
+        auto gen = jobGeneration;
+        auto cb = onFinished;
+
+        juce::MessageManager::callAsync([weak, holder, gen, cb]()
+            {
+                // Dropped if the loader is gone or a newer load has started since
+                if (weak == nullptr || weak->generation.load() != gen)
+                    return;
+
+                weak->loading = false;
+
+                if (cb)
+                    cb(std::move(*holder));
+            });
+
+        return jobHasFinished;
+    }
+
+private:
+    AudioFileLoader& owner;
+    juce::WeakReference<AudioFileLoader> weakOwner;
+    juce::File file;
+    int jobGeneration = 0;
+    Callback onFinished;
+    OverviewCallback onOverviewReady;
+};
+
+//==============================================================================
+/** One pool of decode threads for the whole process, however many plugin instances load at once. */
+struct AudioFileLoader::DecodeWorkers
+{
+    juce::ThreadPool pool{ juce::jmax(1, juce::SystemStats::getNumCpus() - 1) };
+};
+
+//==============================================================================
+AudioFileLoader::AudioFileLoader()
+{
+    formatManager.registerBasicFormats();
+}
+
+AudioFileLoader::~AudioFileLoader()
+{
+    ++generation;
+    ++conversionGeneration;
+    pool.removeAllJobs(true, 5000);
+
+    // The owner's stores are gone by now; don't keep them beyond the cache's limit
+    decodedCache->trim();
+}
+
+void AudioFileLoader::loadAsync(const juce::File& file, Callback onFinished, OverviewCallback onOverviewReady)
+{
+    // Invalidate and interrupt the previous load, but don't wait for it:
+    // it checks shouldExit() between chunks and discards its result.
+    const int gen = ++generation;
+    pool.removeAllJobs(true, 0);
+
+    progress = 0.0f;
+    loading = true;
+
+    pool.addJob(new LoadJob(*this, juce::WeakReference<AudioFileLoader>(this),
+        file, gen, std::move(onFinished), std::move(onOverviewReady)), true);
+}
+
+std::unique_ptr<LoadedAudio> AudioFileLoader::load(const juce::File& file, std::function<bool()> shouldCancel)
+{
+    if (shouldCancel == nullptr)
+        shouldCancel = [] { return false; };
+
+    return loadInternal(file, shouldCancel, [](float) {}, [](WaveformOverview::Ptr) {});
+}
+
+void AudioFileLoader::cancel()
+{
+    ++generation;
+    pool.removeAllJobs(true, 0);
+
+    loading = false;
+    progress = 0.0f;
+}
+
+//==============================================================================
+std::unique_ptr<LoadedAudio> AudioFileLoader::loadInternal(const juce::File& file,
+    const std::function<bool()>& shouldCancel,
+    const std::function<void(float)>& reportProgress,
+    const std::function<void(WaveformOverview::Ptr)>& reportCachedOverview)
+{
+    // A valid cached pyramid lets the waveform appear before anything is decoded
+    WaveformOverview::Ptr cachedOverview = PeakCache::load(file);
+    if (cachedOverview != nullptr)
+        reportCachedOverview(cachedOverview);
+
+    bool isMapped = false;
+    std::unique_ptr<juce::AudioFormatReader> reader(createReaderFor(file, isMapped));
+    if (reader == nullptr)
+        return nullptr;
+
+    const int       numChannels = (int)reader->numChannels;
+    const long long numSamples = (long long)reader->lengthInSamples;
+    const double    fileSampleRate = reader->sampleRate;
+
+    if (numSamples <= 0 || numChannels <= 0 || fileSampleRate <= 0.0)
+        return nullptr;
+
+    auto result = std::make_unique<LoadedAudio>();
+    result->file = file;
+    result->sampleRate = fileSampleRate;
+    result->lengthInSamples = numSamples;
+    result->numChannels = numChannels;
+
+    const long long decodedBytes = numSamples * numChannels * (long long)sizeof(float);
+    const bool ramResident = decodedBytes <= ramResidentLimitBytes.load()
+        && numSamples <= std::numeric_limits<int>::max();
+
+    if (cachedOverview != nullptr && cachedOverview->getTotalSamples() != numSamples)
+        cachedOverview = nullptr;
+
+    // Only analyse the file if the cache could not provide the pyramid
+    std::unique_ptr<WaveformOverviewBuilder> overviewBuilder;
+    if (cachedOverview == nullptr)
+        overviewBuilder = std::make_unique<WaveformOverviewBuilder>(numSamples);
+
+    if (ramResident)
+    {
+        // Decode once per process: another instance may have this file already.
+        // The overview is built from each chunk as it lands in the store.
+        SampleStore::Ptr decoded = decodedCache->find(file, fileSampleRate);
+        const bool alreadyDecoded = decoded != nullptr;
+
+        if (!alreadyDecoded)
+            decoded = new SampleStore(numChannels, (int)numSamples, fileSampleRate);
+
+        // When the file needs converting to the device rate, decoding is the first half of the work
+        const double targetRate = targetSampleRate.load();
+        const bool convert = targetRate > 0.0 && std::abs(targetRate - fileSampleRate) > 1.0e-6;
+        const float decodeShare = convert ? 0.5f : 1.0f;
+
+        // Long files are decoded on several cores first; the loop below then only builds the overview
+        const bool decodedInParallel = !alreadyDecoded && parallelDecodeEnabled.load() && canDecodeInParallel(*reader);
+
+        if (decodedInParallel && !decodeInParallel(file, *decoded, shouldCancel,
+                [&](float p) { reportProgress(decodeShare * p); }))
+            return nullptr;
+
+        juce::AudioBuffer<float> chunk;
+        if (overviewBuilder != nullptr && decoded->isCompact())
+            chunk.setSize(numChannels, decodeChunkSamples);
+
+        for (int pos = 0; pos < (int)numSamples; pos += decodeChunkSamples)
+        {
+            if (shouldCancel())
+                return nullptr;
+
+            const int num = juce::jmin(decodeChunkSamples, (int)numSamples - pos);
+
+            if (!alreadyDecoded && !decodedInParallel)
+                reader->read(&decoded->getBuffer(), pos, num, pos, true, true);
+
+            if (overviewBuilder != nullptr)
+            {
+                if (decoded->isCompact())
+                {
+                    // Another instance's compact copy: expanded a chunk at a time
+                    for (int ch = 0; ch < numChannels; ++ch)
+                        decoded->read(ch, pos, num, chunk.getWritePointer(ch));
+
+                    overviewBuilder->addSamples(chunk, 0, num);
+                }
+                else
+                {
+                    overviewBuilder->addSamples(decoded->getBuffer(), pos, num);
+                }
+            }
+
+            if (!decodedInParallel)
+                reportProgress(decodeShare * (float)(pos + num) / (float)numSamples);
+        }
+
+        // Kept compact from here on; the float decode is only still needed to convert from.
+        // If two instances decoded it at once, both continue with the first copy.
+        const SampleStore::Ptr floatDecoded = decoded;
+
+        if (!alreadyDecoded)
+            decoded = decodedCache->add(file, SampleStore::createCompact(*decoded, chooseEncoding(*reader)));
+
+        result->nativeStore = decoded;
+        result->store = decoded;
+
+        if (convert)
+        {
+            result->store = decodedCache->find(file, targetRate);
+
+            if (result->store == nullptr)
+            {
+                auto converted = convertSampleRate(*floatDecoded, targetRate, shouldCancel,
+                    [&](float p) { reportProgress(decodeShare + (1.0f - decodeShare) * p); });
+
+                if (converted == nullptr)
+                    return nullptr;
+
+                result->store = decodedCache->add(file, SampleStore::createCompact(*converted, decoded->getEncoding()));
+            }
+        }
+
+        result->source = std::make_unique<SampleStoreSource>(result->store);
+    }
+    else
+    {
+        // Too large for RAM: scan the whole file through one reusable chunk
+        // (unless the pyramid is cached), then hand the same reader to a streaming source.
+        if (overviewBuilder != nullptr)
+        {
+            juce::AudioBuffer<float> chunk(numChannels, decodeChunkSamples);
+
+            for (long long pos = 0; pos < numSamples; pos += decodeChunkSamples)
+            {
+                if (shouldCancel())
+                    return nullptr;
+
+                const int num = (int)juce::jmin((long long)decodeChunkSamples, numSamples - pos);
+                reader->read(&chunk, 0, num, pos, true, true);
+                overviewBuilder->addSamples(chunk, 0, num);
+
+                reportProgress((float)((double)(pos + num) / (double)numSamples));
+            }
+        }
+
+        result->isMapped = isMapped;
+        result->source = std::make_unique<juce::AudioFormatReaderSource>(reader.release(), true);
+
+        bool displayIsMapped = false, prefetchIsMapped = false;
+        result->displayReader.reset(createReaderFor(file, displayIsMapped));
+        result->prefetchReader.reset(createReaderFor(file, prefetchIsMapped));
+    }
+
+    if (shouldCancel())
+        return nullptr;
+
+    if (overviewBuilder != nullptr)
+    {
+        result->overview = overviewBuilder->getResult();
+        PeakCache::save(file, *result->overview);
+    }
+    else
+    {
+        result->overview = cachedOverview;
+    }
+
+    reportProgress(1.0f);
+    return result;
+}
+
+void AudioFileLoader::convertAsync(const juce::File& file, SampleStore::Ptr source, double targetRate,
+    std::function<void(SampleStore::Ptr)> onDone)
+{
+    const int gen = ++conversionGeneration;
+    juce::WeakReference<AudioFileLoader> weak(this);
+
+    pool.addJob([this, weak, gen, file, source, targetRate, onDone]
+        {
+            auto isStale = [this, gen] { return conversionGeneration.load() != gen; };
+
+            SampleStore::Ptr converted = decodedCache->find(file, targetRate);
+
+            if (converted == nullptr)
+            {
+                converted = convertSampleRate(*source, targetRate, isStale, [](float) {});
+                if (converted == nullptr)
+                    return;
+
+                converted = decodedCache->add(file, converted);
+            }
+
+            juce::MessageManager::callAsync([weak, gen, converted, onDone]()
+                {
+                    if (weak != nullptr && weak->conversionGeneration.load() == gen && onDone)
+                        onDone(converted);
+                });
+        });
+}
+
+SampleStore::Ptr AudioFileLoader::convertSampleRate(const SampleStore& source, double targetRate,
+    const std::function<bool()>& shouldCancel, const std::function<void(float)>& reportProgress)
+{
+    const double step = source.getSampleRate() / targetRate;
+    const long long length = (long long)std::ceil((double)source.getNumSamples() / step);
+
+    if (length <= 0 || length > std::numeric_limits<int>::max())
+        return nullptr;
+
+    juce::SharedResourcePointer<SincKernelBank> kernels;
+    const auto& kernel = kernels->getKernel(SincKernelBank::Quality::mastering, SincKernelBank::getCutoffIndex(step));
+    std::vector<float> tapScratch((size_t)kernel.numTaps);
+
+    // The kernels read floats, so a compact source is expanded for the duration
+    SampleStore::Ptr expanded = source.isCompact() ? SampleStore::createExpanded(source) : nullptr;
+    const SampleStore& input = expanded != nullptr ? *expanded : source;
+
+    SampleStore::Ptr converted = new SampleStore(source.getNumChannels(), (int)length, targetRate);
+    const long long total = source.getNumSamples();
+
+    for (int pos = 0; pos < (int)length; pos += decodeChunkSamples)
+    {
+        if (shouldCancel())
+            return nullptr;
+
+        const int num = juce::jmin(decodeChunkSamples, (int)length - pos);
+
+        for (int i = pos; i < pos + num; ++i)
+        {
+            // Exact position for every output sample, so errors never accumulate
+            const double sourcePosition = (double)i * step;
+            const auto index = (long long)sourcePosition;
+            const float* taps = kernel.getTaps((float)(sourcePosition - (double)index), tapScratch.data());
+
+            for (int ch = 0; ch < source.getNumChannels(); ++ch)
+                converted->getBuffer().setSample(ch, i,
+                    SincKernelBank::read(kernel, taps, input.getFloatData(ch), total, index));
+        }
+
+        reportProgress((float)(pos + num) / (float)length);
+    }
+
+    return SampleStore::createCompact(*converted, source.getEncoding());
+}
+
+bool AudioFileLoader::canDecodeInParallel(const juce::AudioFormatReader& reader)
+{
+    const auto format = reader.getFormatName();
+    const bool seeksExactly = format.startsWith("WAV") || format.startsWith("AIFF") || format.startsWith("FLAC");
+
+    return seeksExactly && reader.lengthInSamples >= 2LL * minParallelRangeSamples;
+}
+
+SampleStore::Encoding AudioFileLoader::chooseEncoding(const juce::AudioFormatReader& reader) const
+{
+    switch ((CompactStorage)compactStorage.load())
+    {
+        case CompactStorage::int16:   return SampleStore::Encoding::int16;
+        case CompactStorage::int24:   return SampleStore::Encoding::int24;
+        case CompactStorage::float16: return SampleStore::Encoding::float16;
+
+        case CompactStorage::automatic:
+            // Lossless: integer samples fit back into integers of their own width
+            if (reader.usesFloatingPointData || reader.bitsPerSample > 24)
+                return SampleStore::Encoding::float32;
+
+            return reader.bitsPerSample <= 16 ? SampleStore::Encoding::int16 : SampleStore::Encoding::int24;
+
+        case CompactStorage::off:
+        default:
+            return SampleStore::Encoding::float32;
+    }
+}
+
+bool AudioFileLoader::decodeInParallel(const juce::File& file, SampleStore& dest,
+    const std::function<bool()>& shouldCancel, const std::function<void(float)>& reportProgress)
+{
+    auto& workers = decodeWorkers->pool;
+    const long long total = dest.getNumSamples();
+    const int numChannels = dest.getNumChannels();
+    float* const* channels = dest.getBuffer().getArrayOfWritePointers();
+
+    // A couple of ranges per worker, so one slow range doesn't hold up the rest
+    const int numRanges = (int)juce::jlimit(1LL, 2LL * workers.getNumThreads(), total / minParallelRangeSamples);
+
+    // The jobs use these by reference: this function doesn't return before the last one has finished
+    std::atomic<int>       remaining{ numRanges };
+    std::atomic<long long> samplesDone{ 0 };
+    std::atomic<bool>      stop{ false };
+    std::atomic<bool>      failed{ false };
+
+    for (int r = 0; r < numRanges; ++r)
+    {
+        const long long rangeStart = total * r / numRanges;
+        const long long rangeEnd = total * (r + 1) / numRanges;
+
+        workers.addJob([&, rangeStart, rangeEnd]
+            {
+                bool isMapped = false;
+                std::unique_ptr<juce::AudioFormatReader> rangeReader(createReaderFor(file, isMapped));
+
+                if (rangeReader == nullptr)
+                    failed = true;
+
+                for (long long pos = rangeStart; pos < rangeEnd && !stop.load() && !failed.load(); pos += decodeChunkSamples)
+                {
+                    const int num = (int)juce::jmin((long long)decodeChunkSamples, rangeEnd - pos);
+
+                    // Each job writes its own range through its own view of the buffer
+                    juce::AudioBuffer<float> view(channels, numChannels, (int)pos, num);
+
+                    if (!rangeReader->read(&view, 0, num, pos, true, true))
+                        failed = true;
+
+                    samplesDone += num;
+                }
+
+                --remaining;
+            });
+    }
+
+    while (remaining.load() > 0)
+    {
+        if (!stop.load() && shouldCancel())
+            stop = true;
+
+        reportProgress((float)((double)samplesDone.load() / (double)total));
+        juce::Thread::sleep(5);
+    }
+
+    return !stop.load() && !failed.load();
+}
+
+juce::AudioFormatReader* AudioFileLoader::createReaderFor(const juce::File& file, bool& isMapped)
+{
+    isMapped = false;
+
+    if (memoryMappingEnabled.load())
+    {
+        // Only uncompressed formats (WAV/AIFF) provide a memory-mapped reader,
+        // every other format returns nullptr here and falls through.
+        if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+        {
+            std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+
+            if (mapped != nullptr && mapped->mapEntireFile())
+            {
+                isMapped = true;
+                return mapped.release();
+            }
+        }
+    }
+
+    return formatManager.createReaderFor(file);
+}
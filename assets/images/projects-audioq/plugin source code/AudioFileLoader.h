@@ -0,0 +1,207 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "SampleStore.h"
+#include "WaveformOverview.h"
+#include "DecodedAudioCache.h"
+
+/**
+ * LoadedAudio
+ *
+ * Everything a single load produces. It is built off the message thread and
+ * handed to AudioFilePlayer in one piece, so the player can swap it in at once.
+ */
+struct LoadedAudio
+{
+    std::unique_ptr<juce::PositionableAudioSource> source;   ///< Playback source for the transport
+    SampleStore::Ptr   store;                                 ///< Samples for playback, at the target rate (null if streamed)
+    SampleStore::Ptr   nativeStore;                           ///< Decoded samples at the file's own rate (may be `store`)
+    WaveformOverview::Ptr overview;                           ///< Peak pyramid for the waveform display
+
+    /** Separate reader for zoomed-in waveform drawing of streamed files (never used by audio). */
+    std::unique_ptr<juce::AudioFormatReader> displayReader;
+
+    /** Another reader of a streamed file, for paging or prefetching it off the audio path. */
+    std::unique_ptr<juce::AudioFormatReader> prefetchReader;
+
+    juce::File file;
+    double     sampleRate = 0.0;
+    long long  lengthInSamples = 0;
+    int        numChannels = 0;
+    bool       isMapped = false;
+};
+
+/**
+ * AudioFileLoader
+ *
+ * Opens and decodes audio files on a background ThreadPool:
+ *  - Files that fit the RAM limit are decoded once into a SampleStore; long
+ *    WAV/AIFF/FLAC files are split into ranges decoded on several cores at once,
+ *  - Larger files are streamed (memory-mapped for WAV/AIFF),
+ *  - The waveform peak pyramid covers the whole file and is built in the same pass,
+ *    one chunk at a time, so display memory stays bounded at any file length,
+ *  - Pyramids are saved to the PeakCache, so reopening a file skips that work
+ *    and shows its waveform before any audio is decoded,
+ *  - Decoded audio is converted once to the target (device) sample rate with a
+ *    high-quality sinc resampler, so playback only resamples for tempo,
+ *  - Resident audio can be kept compact (see CompactStorage), e.g. 16- and 24-bit
+ *    files as integers of their own width, losslessly,
+ *  - Decoded and converted audio is shared with every other instance in the
+ *    process through the DecodedAudioCache, so a file is only decoded once.
+ *
+ * Starting a new load cancels the one in progress. Progress can be polled from any thread.
+ */
+class AudioFileLoader
+{
+public:
+    using Callback = std::function<void(std::unique_ptr<LoadedAudio>)>;
+    using OverviewCallback = std::function<void(WaveformOverview::Ptr)>;
+
+    AudioFileLoader();
+    ~AudioFileLoader();
+
+    /**
+     * Starts loading a file in the background, cancelling any load in progress.
+     * onFinished is called on the message thread with the result, or nullptr if
+     * the file could not be read. Cancelled loads never call back.
+     * If a cached peak pyramid exists, onOverviewReady is called with it first,
+     * before decoding starts.
+     */
+    void loadAsync(const juce::File& file, Callback onFinished, OverviewCallback onOverviewReady = nullptr);
+
+    /**
+     * Loads a file synchronously on the calling thread. Returns nullptr on failure,
+     * or once shouldCancel (if given) returns true. Safe to call from several threads at once.
+     */
+    std::unique_ptr<LoadedAudio> load(const juce::File& file, std::function<bool()> shouldCancel = nullptr);
+
+    /** Cancels the load in progress (if any) without waiting for it. */
+    void cancel();
+
+    bool  isLoading()   const { return loading.load(); }
+    float getProgress() const { return progress.load(); }
+
+    //==============================================================================
+    // Settings
+    //==============================================================================
+    void setMemoryMappingEnabled(bool shouldMap) { memoryMappingEnabled = shouldMap; }
+    bool isMemoryMappingEnabled() const { return memoryMappingEnabled.load(); }
+
+    void setRamResidentLimitBytes(long long numBytes) { ramResidentLimitBytes = numBytes; }
+
+    /**
+     * Whether long files are split into ranges decoded on several cores (on by
+     * default). Callers loading many files at once parallelise across files instead.
+     */
+    void setParallelDecodeEnabled(bool shouldSplit) { parallelDecodeEnabled = shouldSplit; }
+
+    /** Rate RAM-resident files are converted to after decoding (0: keep the file's rate). */
+    void setTargetSampleRate(double rate) { targetSampleRate = rate; }
+
+    /** How RAM-resident audio is held once decoded. */
+    enum class CompactStorage
+    {
+        off = 0,        ///< 32-bit floats (the default)
+        automatic,      ///< Integer files at their own width (16 or 24 bits), float files as floats
+        int16,          ///< Everything as 16-bit integers
+        int24,          ///< Everything as 24-bit integers
+        float16         ///< Everything as half floats
+    };
+
+    /**
+     * Applies from the next load. Files are decoded to floats and then packed, so
+     * the RAM limit still counts 4 bytes per sample. Converted copies use the
+     * encoding of the file they came from (requantised, without dither).
+     */
+    void setCompactStorage(CompactStorage mode) { compactStorage = (int)mode; }
+
+    /**
+     * Converts the decoded audio of `file` to another rate on the loader's pool
+     * (or takes the shared copy if another instance already has). onDone is
+     * called on the message thread with the result; cancelled or superseded
+     * conversions (and those outliving the loader) never call back.
+     */
+    void convertAsync(const juce::File& file, SampleStore::Ptr source, double targetRate,
+        std::function<void(SampleStore::Ptr)> onDone);
+
+    /** File patterns of every format the loader can open, e.g. for scanning folders. */
+    juce::String getWildcardForAllFormats() const { return formatManager.getWildcardForAllFormats(); }
+
+    /** Lets the shared cache drop audio no instance uses any more (call after releasing a store). */
+    void releaseUnusedAudio() { decodedCache->trim(); }
+
+    /** How much decoded audio no instance uses may be kept for fast reloads, process-wide. */
+    void setUnusedAudioCacheBytes(long long numBytes) { decodedCache->setUnusedBytesLimit(numBytes); }
+
+    /**
+     * Offline sample-rate conversion with the mastering-quality sinc kernels,
+     * band-limited when converting down. The result has the source's encoding.
+     * Returns nullptr if cancelled.
+     */
+    static SampleStore::Ptr convertSampleRate(const SampleStore& source, double targetRate,
+        const std::function<bool()>& shouldCancel, const std::function<void(float)>& reportProgress);
+
+private:
+    class LoadJob;
+    struct DecodeWorkers;
+
+    /**
+     * The actual load pipeline. Returns nullptr on failure or as soon as
+     * shouldCancel() returns true; reports progress in [0..1], and a cached
+     * peak pyramid as soon as it has been found.
+     */
+    std::unique_ptr<LoadedAudio> loadInternal(const juce::File& file,
+        const std::function<bool()>& shouldCancel,
+        const std::function<void(float)>& reportProgress,
+        const std::function<void(WaveformOverview::Ptr)>& reportCachedOverview);
+
+    /**
+     * Creates a reader for the file: a memory-mapped reader for WAV/AIFF
+     * (if enabled and the mapping succeeds), otherwise a regular reader.
+     */
+    juce::AudioFormatReader* createReaderFor(const juce::File& file, bool& isMapped);
+
+    /**
+     * True for files worth splitting whose readers seek exactly and cheaply:
+     * WAV and AIFF (byte offsets) and FLAC (seek table).
+     */
+    static bool canDecodeInParallel(const juce::AudioFormatReader& reader);
+
+    /** The encoding a file decoded by this reader is kept in, per the CompactStorage setting. */
+    SampleStore::Encoding chooseEncoding(const juce::AudioFormatReader& reader) const;
+
+    /**
+     * Decodes the whole file into `dest` as disjoint ranges on the process-wide
+     * decode workers, each range through its own reader. Returns false if
+     * cancelled or if a range could not be read.
+     */
+    bool decodeInParallel(const juce::File& file, SampleStore& dest,
+        const std::function<bool()>& shouldCancel, const std::function<void(float)>& reportProgress);
+
+    //==============================================================================
+    juce::AudioFormatManager formatManager;
+    juce::ThreadPool         pool{ 2 };
+
+    juce::SharedResourcePointer<DecodedAudioCache> decodedCache;
+    juce::SharedResourcePointer<DecodeWorkers>     decodeWorkers;
+
+    std::atomic<int>   generation{ 0 };
+    std::atomic<int>   conversionGeneration{ 0 };
+    std::atomic<bool>  loading{ false };
+    std::atomic<float> progress{ 0.0f };
+
+    std::atomic<bool>      memoryMappingEnabled{ true };
+    std::atomic<bool>      parallelDecodeEnabled{ true };
+    std::atomic<long long> ramResidentLimitBytes{ 512LL * 1024 * 1024 };
+    std::atomic<double>    targetSampleRate{ 0.0 };
+    std::atomic<int>       compactStorage{ (int)CompactStorage::off };
+
+    static constexpr int decodeChunkSamples = 65536;
+    static constexpr int minParallelRangeSamples = 1 << 19;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(AudioFileLoader)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFileLoader)
+};
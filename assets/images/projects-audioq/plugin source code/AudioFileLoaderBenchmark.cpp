@@ -0,0 +1,115 @@
+#include "AudioFileLoader.h"
+#include "PeakCache.h"
+
+/**
+ * AudioFileLoaderBenchmark.cpp
+ *
+ * Load throughput of a long multichannel WAV file, decoded by one reader and
+ * split into ranges across the decode workers. The file is loaded once before
+ * timing, so it is in the OS cache and its peak pyramid in the PeakCache: the
+ * numbers are decoding, not disk or analysis. Built with JUCE_UNIT_TESTS; run
+ * with juce::UnitTestRunner().runTestsInCategory("Benchmarks").
+ */
+
+#if JUCE_UNIT_TESTS
+
+class AudioFileLoaderBenchmark : public juce::UnitTest
+{
+public:
+    AudioFileLoaderBenchmark() : juce::UnitTest("AudioFileLoader parallel decode", "Benchmarks") {}
+
+    void runTest() override
+    {
+        for (const int numChannels : { 2, 8 })
+        {
+            beginTest(juce::String(numChannels) + " channels, " + juce::String(secondsOfAudio) + " s, 24-bit WAV");
+
+            juce::TemporaryFile temp(".wav");
+            if (!writeNoise(temp.getFile(), numChannels))
+            {
+                expect(false, "Could not write the test file");
+                continue;
+            }
+
+            AudioFileLoader loader;
+            loader.setUnusedAudioCacheBytes(0);
+
+            // Warm the OS cache and the PeakCache, and check the decode
+            expect(load(loader, temp.getFile(), true) > 0.0);
+
+            const double megabytes = (double)temp.getFile().getSize() / (1024.0 * 1024.0);
+            const double singleReader = load(loader, temp.getFile(), false);
+            const double parallel = load(loader, temp.getFile(), true);
+
+            logMessage("  " + juce::String(megabytes, 1) + " MB: single reader " + juce::String(megabytes / singleReader, 0)
+                + " MB/s, parallel " + juce::String(megabytes / parallel, 0) + " MB/s ("
+                + juce::String(singleReader / parallel, 2) + "x)");
+
+            PeakCache::getCacheFileFor(temp.getFile()).deleteFile();
+        }
+    }
+
+private:
+    static constexpr int    secondsOfAudio = 60;
+    static constexpr double sampleRate = 48000.0;
+
+    /** The best of three loads, in seconds (0 if the file did not load). */
+    static double load(AudioFileLoader& loader, const juce::File& file, bool parallel)
+    {
+        loader.setParallelDecodeEnabled(parallel);
+        double best = std::numeric_limits<double>::max();
+
+        for (int run = 0; run < 3; ++run)
+        {
+            const auto start = juce::Time::getHighResolutionTicks();
+            auto loaded = loader.load(file);
+            const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            if (loaded == nullptr || loaded->store == nullptr)
+                return 0.0;
+
+            best = juce::jmin(best, seconds);
+
+            // Otherwise the next load takes the shared decoded copy
+            loaded = nullptr;
+            loader.releaseUnusedAudio();
+        }
+
+        return best;
+    }
+
+    static bool writeNoise(const juce::File& file, int numChannels)
+    {
+        std::unique_ptr<juce::FileOutputStream> out(file.createOutputStream());
+        if (out == nullptr)
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(out.get(), sampleRate,
+            (unsigned int)numChannels, 24, {}, 0));
+
+        if (writer == nullptr)
+            return false;
+
+        out.release();   // The writer owns the stream now
+
+        juce::AudioBuffer<float> chunk(numChannels, 65536);
+        juce::Random random(1);
+
+        for (int pos = 0; pos < secondsOfAudio * (int)sampleRate; pos += chunk.getNumSamples())
+        {
+            for (int ch = 0; ch < numChannels; ++ch)
+                for (int i = 0; i < chunk.getNumSamples(); ++i)
+                    chunk.setSample(ch, i, random.nextFloat() - 0.5f);
+
+            if (!writer->writeFromAudioSampleBuffer(chunk, 0, chunk.getNumSamples()))
+                return false;
+        }
+
+        return true;
+    }
+};
+
+static AudioFileLoaderBenchmark audioFileLoaderBenchmark;
+
+#endif
@@ -1,125 +1,592 @@
 #include "AudioFilePlayer.h"
-#include <random>
 
 /**
  * AudioFilePlayer.cpp
  *
  * Implements a basic AudioFilePlayer that:
- *  - Loads a file, sets up a transport,
- *  - Supports random or granular looping by automatically selecting new regions,
- *  - Maintains an offlineBuffer for waveform visualization,
- *  - Optional crossfade for loop transitions.
+ *  - Loads a file (in the background) once into a shared SampleStore played by a
+ *    sample-accurate LoopPlaybackEngine (large files stream through a transport
+ *    instead, memory-mapped for WAV/AIFF),
+ *  - Supports random looping with regions planned ahead by a RegionScheduler
+ *    (and, for streamed files, prefetched before playback jumps there),
+ *  - Renders granular mode with a GranularEngine reading the SampleStore,
+ *  - Optionally time-stretches whatever it plays to change tempo without changing pitch,
+ *  - Provides a waveform peak pyramid and raw samples for visualization,
+ *  - Table-driven crossfades for loop transitions,
+ *  - A gapless playlist fed by a second, preloading AudioFileLoader.
  */
 
 AudioFilePlayer::AudioFilePlayer()
     : thread("AudioFilePlayerThread"),
-    resamplingSource(&transport, false, 2) // false: not deleting input source, 2: max channels
+    transport(std::make_unique<juce::AudioTransportSource>()),
+    resamplingSource(transport.get(), 2), // 2: max channels
+    stretcher([this](juce::AudioBuffer<float>& dest, int start, int num)
+        {
+            renderSource(juce::AudioSourceChannelInfo(&dest, start, num));
+        })
 {
-    formatManager.registerBasicFormats();
+    thread.addTimeSliceClient(&regionScheduler);
+    thread.addTimeSliceClient(&stretchCache);
     thread.startThread();
-    transport.addChangeListener(this);
+    transport->addChangeListener(this);
 }
 
 AudioFilePlayer::~AudioFilePlayer()
 {
-    transport.removeChangeListener(this);
-    transport.stop();
-    transport.setSource(nullptr);
+    stopTimer();
+    cancelPendingUpdate();
+    preloader.cancel();
+    loader.cancel();
+    transport->removeChangeListener(this);
+    transport->stop();
+    transport->setSource(nullptr);
+    thread.removeTimeSliceClient(&regionScheduler);
+    thread.removeTimeSliceClient(&stretchCache);
     thread.stopThread(500);
 }
 
 //==============================================================================
 bool AudioFilePlayer::loadFile(const juce::File& file)
 {
-    stop();
+    auto loaded = loader.load(file);
+    if (loaded == nullptr)
+        return false;
+
+    installLoadedAudio(std::move(loaded));
+    return true;
+}
+
+void AudioFilePlayer::loadFileAsync(const juce::File& file, std::function<void(bool)> onLoaded,
+    std::function<void(WaveformOverview::Ptr)> onOverviewReady)
+{
+    // The loader never outlives this player, so capturing `this` is safe
+    loader.loadAsync(file, [this, onLoaded](std::unique_ptr<LoadedAudio> loaded)
+        {
+            const bool ok = (loaded != nullptr);
+            if (ok)
+                installLoadedAudio(std::move(loaded));
+
+            if (onLoaded)
+                onLoaded(ok);
+        },
+        std::move(onOverviewReady));
+}
+
+void AudioFilePlayer::loadDecodedAudio(const juce::File& file, SampleStore::Ptr decodedNative, SampleStore::Ptr decoded,
+    WaveformOverview::Ptr overview)
+{
+    jassert(decodedNative != nullptr && decoded != nullptr);
+
+    // Whatever was still loading would replace this once it finishes
+    loader.cancel();
+
+    auto loaded = std::make_unique<LoadedAudio>();
+    loaded->source = std::make_unique<SampleStoreSource>(decoded);
+    loaded->store = std::move(decoded);
+    loaded->nativeStore = std::move(decodedNative);
+    loaded->overview = std::move(overview);
+    loaded->file = file;
+    loaded->sampleRate = loaded->nativeStore->getSampleRate();
+    loaded->lengthInSamples = loaded->nativeStore->getNumSamples();
+    loaded->numChannels = loaded->nativeStore->getNumChannels();
+
+    installLoadedAudio(std::move(loaded));
+}
+
+void AudioFilePlayer::installLoadedAudio(std::unique_ptr<LoadedAudio> loaded)
+{
+    SampleStore::Ptr oldStore, oldNativeStore, oldRetiredStore;
+
+    // Streamed files get their page cache, or read-ahead buffer and region cache, here
+    // rather than from the transport, so jumps can be served while the disk catches up
+    if (loaded->store == nullptr)
+    {
+        auto upcoming = [this](double* startSec, int maxRegions) { return regionScheduler.getUpcomingRegions(startSec, maxRegions); };
+
+        if (pagedCacheBytes.load() > 0 && loaded->prefetchReader != nullptr)
+        {
+            loaded->source = std::make_unique<PagedSampleSource>(
+                std::make_unique<PagedSampleStore>(std::move(loaded->prefetchReader), thread, pagedCacheBytes.load(), upcoming),
+                prefetchCounters);
+        }
+        else
+        {
+            loaded->source = std::make_unique<RegionPrefetchSource>(std::move(loaded->source),
+                std::move(loaded->prefetchReader), thread, streamReadAheadSamples.load(),
+                prefetchRegions.load(), (int)(prefetchSecondsPerRegion.load() * loaded->sampleRate),
+                upcoming, prefetchCounters);
+        }
+    }
+
+    // Everything that allocates, prepares or frees happens outside the lock;
+    // the audio thread only ever sees the old objects or the new ones
+    const double sourceRate = loaded->store != nullptr ? loaded->store->getSampleRate() : loaded->sampleRate;
+    auto newTransport = createTransport(loaded->source.get(), sourceRate);
 
-    auto* reader = formatManager.createReaderFor(file);
-    if (reader != nullptr)
     {
-        std::unique_ptr<juce::AudioFormatReaderSource> newSource(
-            new juce::AudioFormatReaderSource(reader, true)
-        );
+        const juce::SpinLock::ScopedLockType sl(audioLock);
 
-        transport.setSource(newSource.get(),
-            0,       // readAheadBufferSize
-            &thread, // TimeSliceThread
-            reader->sampleRate);
+        swapTransport(newTransport, loaded->source);
 
-        readerSource.reset(newSource.release());
+        oldStore = sampleStore;
+        sampleStore = loaded->store;
+        oldNativeStore = std::move(nativeStore);
+        nativeStore = loaded->nativeStore;
+        storeRate = sourceRate;
+        granular.setSource(sampleStore.get());
+        loopEngine.setSource(sampleStore.get());
+        engineStore = sampleStore.get();
+        engineSpeed = 1.0;
+        stretcher.reset();
 
-        loadedSampleRate = reader->sampleRate;
-        loadedLengthInSamples = (long long)reader->lengthInSamples;
+        // The new source cuts off any playlist crossfade, so the file it left can go too
+        oldRetiredStore = std::move(retiredStore);
+        entryElapsed = 0;
+
+        loadedFile = loaded->file;
+        loadedSampleRate = loaded->sampleRate;
+        loadedLengthInSamples = loaded->lengthInSamples;
         loadedLengthInSeconds = (double)loadedLengthInSamples / loadedSampleRate;
+        loadedFileIsMapped = loaded->isMapped;
 
-        return true;
+        regionStartSec = juce::jmin(regionStartSec, loadedLengthInSeconds);
+        regionEndSec = juce::jmin(regionEndSec, loadedLengthInSeconds);
     }
-    return false;
+
+    offlineOverview = loaded->overview;
+    displayReader = std::move(loaded->displayReader);
+    stretchCache.setSource(sampleStore);
+    addToLibrary(*loaded);
+
+    // The previous file's audio may now be unused by every instance
+    newTransport = nullptr;
+    loaded->source = nullptr;
+    oldStore = nullptr;
+    oldNativeStore = nullptr;
+    oldRetiredStore = nullptr;
+    loader.releaseUnusedAudio();
+
+    // Regions planned for the previous file no longer apply
+    if (randomMode || granularMode)
+        restartRegionSchedule();
+
+    // Loaded before the device rate was known, or the rate changed while loading
+    requestStoreConversion();
 }
 
-bool AudioFilePlayer::loadFileToBuffer(const juce::File& file)
+void AudioFilePlayer::addToLibrary(const LoadedAudio& loaded)
 {
-    auto* reader = formatManager.createReaderFor(file);
-    if (reader == nullptr)
-        return false;
+    if (loaded.overview != nullptr)
+        library->addFile(loaded.file, loaded.sampleRate, loaded.lengthInSamples, loaded.numChannels, *loaded.overview);
+}
 
-    long long numSamples = (long long)reader->lengthInSamples;
-    if (numSamples <= 0)
+std::unique_ptr<juce::AudioTransportSource> AudioFilePlayer::createTransport(juce::PositionableAudioSource* source,
+    double sourceRate)
+{
+    auto newTransport = std::make_unique<juce::AudioTransportSource>();
+    newTransport->addChangeListener(this);
+
+    // Prepared as resamplingSource prepares its input, so setSource() prepares the
+    // source (and its read-ahead buffer) here rather than under audioLock
+    if (currentSampleRate > 0.0)
+        newTransport->prepareToPlay(juce::roundToInt(currentBlockSize * resamplingSource.getResamplingRatio()), currentSampleRate);
+
+    newTransport->setSource(source,
+        0,       // readAheadBufferSize
+        &thread, // TimeSliceThread
+        sourceRate);
+
+    if (playing)
+        newTransport->start();
+
+    return newTransport;
+}
+
+void AudioFilePlayer::swapTransport(std::unique_ptr<juce::AudioTransportSource>& newTransport,
+    std::unique_ptr<juce::PositionableAudioSource>& newSource)
+{
+    std::swap(transport, newTransport);
+    std::swap(playbackSource, newSource);
+    resamplingSource.setInput(transport.get());
+}
+
+void AudioFilePlayer::requestStoreConversion()
+{
+    const double deviceRate = deviceSampleRate.load();
+
+    if (nativeStore == nullptr || deviceRate <= 0.0 || storeRate.load() == deviceRate)
+        return;
+
+    if (nativeStore->getSampleRate() == deviceRate)
     {
-        delete reader;
-        return false;
+        installConvertedStore(nativeStore, nativeStore);
+        return;
     }
 
-    const long long maxSamplesToRead = 2000000;
-    const long long samplesToRead = (numSamples < maxSamplesToRead)
-        ? numSamples
-        : maxSamplesToRead;
+    // The loader never outlives this player, so capturing `this` is safe
+    const SampleStore::Ptr native = nativeStore;
+
+    loader.convertAsync(loadedFile, native, deviceRate, [this, native](SampleStore::Ptr converted)
+        {
+            // The device may have changed rate again while this was converting
+            if (converted->getSampleRate() == deviceSampleRate.load())
+                installConvertedStore(native, std::move(converted));
+        });
+}
 
-    offlineBuffer.setSize((int)reader->numChannels, (int)samplesToRead);
-    offlineBuffer.clear();
+void AudioFilePlayer::installConvertedStore(const SampleStore::Ptr& native, SampleStore::Ptr converted)
+{
+    if (native != nativeStore)
+        return;
 
-    reader->read(&offlineBuffer,
-        0,                    // destination start sample
-        (int)samplesToRead,   // number of samples to read
-        0,                    // reader start sample
-        true,                 // use left chan?
-        true);                // use right chan?
+    SampleStore::Ptr oldStore;
 
-    delete reader;
-    return true;
+    const double newRate = converted->getSampleRate();
+    std::unique_ptr<juce::PositionableAudioSource> newSource = std::make_unique<SampleStoreSource>(converted);
+    auto newTransport = createTransport(newSource.get(), newRate);
+
+    {
+        const juce::SpinLock::ScopedLockType sl(audioLock);
+
+        const double positionSec = loopEngine.getPosition() * engineSpeed.load() / storeRate.load();
+
+        oldStore = sampleStore;
+        sampleStore = std::move(converted);
+        storeRate = newRate;
+
+        loopEngine.setSource(sampleStore.get());
+        loopEngine.setPosition((long long)(positionSec * newRate));
+        engineStore = sampleStore.get();
+        engineSpeed = 1.0;
+
+        granular.setSource(sampleStore.get());
+        granular.setRegion((long long)(regionStartSec * newRate), (long long)(regionEndSec * newRate));
+
+        swapTransport(newTransport, newSource);
+    }
+
+    // Render-ahead starts over from the new copy
+    stretchCache.setSource(sampleStore);
+
+    // swapTransport() handed back the previous transport and source
+    newTransport = nullptr;
+    newSource = nullptr;
+    oldStore = nullptr;
+    loader.releaseUnusedAudio();
+}
+
+void AudioFilePlayer::setRegionPrefetch(int numRegions, double secondsPerRegion)
+{
+    prefetchRegions = juce::jlimit(0, 64, numRegions);
+    prefetchSecondsPerRegion = juce::jlimit(0.0, 10.0, secondsPerRegion);
+}
+
+AudioFilePlayer::PrefetchStats AudioFilePlayer::getPrefetchStats() const
+{
+    PrefetchStats stats;
+    stats.hits = prefetchCounters.hits.load();
+    stats.misses = prefetchCounters.misses.load();
+    return stats;
+}
+
+//==============================================================================
+void AudioFilePlayer::setPlaylist(const juce::Array<juce::File>& files, bool loopPlaylist)
+{
+    clearPlaylist();
+
+    playlist = files;
+    playlistLoops = loopPlaylist;
+    playlistIndex = 0;
+
+    if (playlist.isEmpty())
+        return;
+
+    playlistActive = true;
+
+    loadFileAsync(playlist[0], [this](bool)
+        {
+            if (!playlist.isEmpty())
+                preloadPlaylistEntryAfter(playlistIndex, playlist.size());
+        });
+
+    startTimerHz(20);
+}
+
+void AudioFilePlayer::clearPlaylist()
+{
+    // Complete a switch the audio thread has already made
+    if (playlistSwitched.exchange(false))
+        finishPlaylistSwitch();
+
+    preloader.cancel();
+    playlist.clear();
+    playlistActive = false;
+    reachedEnd = false;
+
+    SampleStore::Ptr next;
+    {
+        const juce::SpinLock::ScopedLockType sl(audioLock);
+        next = std::move(playlistNext);
+    }
+
+    preloaded = nullptr;
+
+    // The timer keeps going until the last switch's crossfade is over and its file released
+    releaseRetiredStore();
+    if (retiredStore == nullptr)
+        stopTimer();
+}
+
+void AudioFilePlayer::preloadPlaylistEntryAfter(int index, int attemptsLeft)
+{
+    if (playlist.isEmpty() || attemptsLeft <= 0)
+        return;
+
+    int next = index + 1;
+    if (next >= playlist.size())
+    {
+        if (!playlistLoops)
+            return;
+
+        next = 0;
+    }
+
+    // The preloader never outlives this player, so capturing `this` is safe
+    preloader.loadAsync(playlist[next], [this, next, attemptsLeft](std::unique_ptr<LoadedAudio> loaded)
+        {
+            if (loaded == nullptr)
+            {
+                preloadPlaylistEntryAfter(next, attemptsLeft - 1);
+                return;
+            }
+
+            preloadedIndex = next;
+            preloaded = std::move(loaded);
+
+            // RAM-resident: the audio thread can move into it on its own at the end of this file
+            if (preloaded->store != nullptr)
+            {
+                const juce::SpinLock::ScopedLockType sl(audioLock);
+                playlistNext = preloaded->store;
+            }
+        });
+}
+
+void AudioFilePlayer::switchToNextPlaylistEntry()
+{
+    const long long segment = playlistCrossfade.load() ? playlistNext->getNumSamples() : 0;
+
+    // Moving the pointers never frees anything here: the message thread releases retiredStore
+    retiredStore = std::move(sampleStore);
+    sampleStore = std::move(playlistNext);
+
+    loopEngine.switchSource(sampleStore.get(), 0, segment);
+    engineStore = sampleStore.get();
+    engineSpeed = 1.0;
+    storeRate = sampleStore->getSampleRate();
+    entryElapsed = 0;
+
+    playlistSwitched = true;
+}
+
+void AudioFilePlayer::finishPlaylistSwitch()
+{
+    auto entry = std::move(preloaded);
+    if (entry == nullptr)
+        return;
+
+    SampleStore::Ptr oldNativeStore;
+    auto newTransport = createTransport(entry->source.get(), storeRate.load());
+
+    {
+        const juce::SpinLock::ScopedLockType sl(audioLock);
+
+        // retiredStore stays until the loop engine's crossfade out of it is over
+        granular.setSource(sampleStore.get());
+        oldNativeStore = std::move(nativeStore);
+        nativeStore = entry->nativeStore;
+
+        swapTransport(newTransport, entry->source);
+
+        loadedFile = entry->file;
+        loadedSampleRate = entry->sampleRate;
+        loadedLengthInSamples = entry->lengthInSamples;
+        loadedLengthInSeconds = (double)loadedLengthInSamples / loadedSampleRate;
+        loadedFileIsMapped = entry->isMapped;
+
+        regionStartSec = juce::jmin(regionStartSec, loadedLengthInSeconds);
+        regionEndSec = juce::jmin(regionEndSec, loadedLengthInSeconds);
+    }
+
+    offlineOverview = entry->overview;
+    displayReader = std::move(entry->displayReader);
+    stretchCache.setSource(sampleStore);
+    addToLibrary(*entry);
+
+    // swapTransport() handed back the previous transport and source
+    newTransport = nullptr;
+    entry->source = nullptr;
+    oldNativeStore = nullptr;
+    releaseRetiredStore();
+
+    if (randomMode || granularMode)
+        restartRegionSchedule();
+
+    advancePlaylistIndex();
+
+    // The device rate may have changed while it was preloading
+    requestStoreConversion();
+}
+
+void AudioFilePlayer::releaseRetiredStore()
+{
+    SampleStore::Ptr oldStore;
+
+    {
+        const juce::SpinLock::ScopedLockType sl(audioLock);
+
+        if (retiredStore == nullptr || loopEngine.getFadingSource() == retiredStore.get())
+            return;
+
+        oldStore = std::move(retiredStore);
+    }
+
+    oldStore = nullptr;
+    loader.releaseUnusedAudio();
+}
+
+void AudioFilePlayer::advancePlaylistIndex()
+{
+    playlistIndex = preloadedIndex;
+    preloadPlaylistEntryAfter(playlistIndex, playlist.size());
+
+    if (onPlaylistAdvanced)
+        onPlaylistAdvanced(playlistIndex);
+}
+
+void AudioFilePlayer::handleAsyncUpdate()
+{
+    requestStoreConversion();
+}
+
+void AudioFilePlayer::timerCallback()
+{
+    if (playlistSwitched.exchange(false))
+        finishPlaylistSwitch();
+    else
+        releaseRetiredStore();
+
+    if (playlist.isEmpty())
+    {
+        if (retiredStore == nullptr)
+            stopTimer();
+
+        return;
+    }
+
+    // A streamed next entry (or one still loading when this file ended) cannot follow
+    // at the sample: swap it in the ordinary way as soon as it is there
+    if (reachedEnd.load() && preloaded != nullptr && !playlist.isEmpty())
+    {
+        {
+            const juce::SpinLock::ScopedLockType sl(audioLock);
+            playlistNext = nullptr;
+        }
+
+        installLoadedAudio(std::move(preloaded));
+        start();
+        advancePlaylistIndex();
+    }
+}
+
+bool AudioFilePlayer::readDisplaySamples(juce::AudioBuffer<float>& dest, long long startSample, int numSamples)
+{
+    if (numSamples <= 0 || startSample < 0 || startSample + numSamples > loadedLengthInSamples)
+        return false;
+
+    if (nativeStore != nullptr)
+    {
+        dest.setSize(nativeStore->getNumChannels(), numSamples, false, false, true);
+
+        for (int ch = 0; ch < nativeStore->getNumChannels(); ++ch)
+            nativeStore->read(ch, startSample, numSamples, dest.getWritePointer(ch));
+
+        return true;
+    }
+
+    if (displayReader != nullptr)
+    {
+        dest.setSize((int)displayReader->numChannels, numSamples, false, false, true);
+        return displayReader->read(&dest, 0, numSamples, startSample, true, true);
+    }
+
+    return false;
 }
 
 //==============================================================================
 void AudioFilePlayer::start()
 {
-    if (!transport.isPlaying())
-        transport.start();
+    playing = true;
+    reachedEnd = false;
+
+    if (!transport->isPlaying())
+        transport->start();
 }
 
 void AudioFilePlayer::stop()
 {
-    if (transport.isPlaying())
-        transport.stop();
+    playing = false;
+
+    if (transport->isPlaying())
+        transport->stop();
 }
 
 bool AudioFilePlayer::isPlaying() const
 {
-    return transport.isPlaying();
+    return playing;
 }
 
 void AudioFilePlayer::setResamplingRatio(double ratio)
 {
     // E.g., ratio = 1.0 => normal speed, 2.0 => double speed, 0.5 => half speed
-    resamplingSource.setResamplingRatio(ratio);
+    tempoRatio = ratio;
+    granular.setPlaybackRatio(ratio);
+
+    // When stretching, the source plays at its own pitch and the stretcher changes the speed
+    const bool stretching = stretcher.getMode() != TimeStretcher::Mode::off;
+    resamplingSource.setResamplingRatio(stretching ? 1.0 : ratio);
+    loopEngine.setPlaybackRatio(stretching ? 1.0 : ratio);
+    stretcher.setRatio(ratio);
+}
+
+void AudioFilePlayer::setResamplingQuality(SincKernelBank::Quality quality)
+{
+    resamplingSource.setQuality(quality);
+    loopEngine.setQuality(quality);
+    granular.setQuality(quality);
 }
 
 void AudioFilePlayer::setPosition(double newTimeSec)
 {
-    transport.setPosition(newTimeSec);
+    // RAM-resident files: the engine picks the new position up at its next block
+    if (sampleStore != nullptr)
+        loopEngine.requestPosition((long long)(newTimeSec * storeRate.load() / engineSpeed.load()));
+    else
+        transport->setPosition(newTimeSec);
 }
 
 double AudioFilePlayer::getPosition() const
 {
-    return transport.getCurrentPosition();
+    // The grain engine keeps its own scan position instead of moving the transport
+    const double rate = storeRate.load();
+
+    if (isGrainEngineActive() && rate > 0.0)
+        return granular.getScanPosition() / rate;
+
+    if (sampleStore != nullptr && rate > 0.0)
+        return loopEngine.getPosition() * engineSpeed.load() / rate;
+
+    return transport->getCurrentPosition();
 }
 
 double AudioFilePlayer::getLength() const
@@ -130,7 +597,19 @@ double AudioFilePlayer::getLength() const
 void AudioFilePlayer::prepareToPlay(int samplesPerBlock, double sampleRate)
 {
     currentSampleRate = sampleRate;
+    currentBlockSize = samplesPerBlock;
     resamplingSource.prepareToPlay(samplesPerBlock, sampleRate);
+    granular.prepare(sampleRate, samplesPerBlock);
+    loopEngine.prepare(sampleRate, samplesPerBlock);
+    stretcher.prepare(sampleRate, samplesPerBlock);
+    rebuildCrossfadeTables();
+
+    // Later loads are converted as part of decoding. The current file is converted
+    // from the message thread, which owns the stores and swaps the transport
+    deviceSampleRate = sampleRate;
+    loader.setTargetSampleRate(sampleRate);
+    preloader.setTargetSampleRate(sampleRate);
+    triggerAsyncUpdate();
 }
 
 void AudioFilePlayer::releaseResources()
@@ -160,49 +639,211 @@ void AudioFilePlayer::setRandomMode(bool shouldEnable)
         // If randomMode is on, also ensure region-based loop
         looping = true;
         useRegionLoop = true;
-        generateRandomRegion();
+        restartRegionSchedule();
     }
 }
 
 void AudioFilePlayer::setGranularMode(bool enable)
 {
-    granularMode = enable;
-    if (granularMode)
     {
-        // Similarly ensure region-based loop
-        looping = true;
-        useRegionLoop = true;
-        generateRandomRegion();
+        // The grain engine is reset between two blocks
+        const juce::SpinLock::ScopedLockType sl(audioLock);
+
+        granularMode = enable;
+        granular.reset();
+
+        if (granularMode)
+        {
+            // Similarly ensure region-based loop
+            looping = true;
+            useRegionLoop = true;
+        }
     }
+
+    // The grain workers are started the first time any instance needs them
+    granular.setWorkersEnabled(enable);
+
+    if (granularMode)
+        restartRegionSchedule();
+}
+
+void AudioFilePlayer::setRegionSeed(juce::uint64 seed)
+{
+    regionScheduler.setSeed(seed);
+
+    if (randomMode || granularMode)
+        restartRegionSchedule();
+}
+
+void AudioFilePlayer::setGrainSize(float sizeSec)
+{
+    grainSizeSec = sizeSec;
+    granular.setGrainSize(sizeSec);
+}
+
+void AudioFilePlayer::setGrainDensity(float density)
+{
+    grainDensity = density;
+    granular.setDensity(density);
 }
 
 void AudioFilePlayer::setCrossfadeTimeMs(double ms)
 {
-    if (currentSampleRate > 0.0)
-        crossfadeSamples = (int)std::round((ms / 1000.0) * currentSampleRate);
-    else
-        crossfadeSamples = 0;
+    crossfadeMs = juce::jmax(0.0, ms);
+    rebuildCrossfadeTables();
+}
+
+void AudioFilePlayer::setCrossfadeCurve(CrossfadeTables::Curve curve)
+{
+    crossfadeCurve = curve;
+    rebuildCrossfadeTables();
+}
+
+void AudioFilePlayer::rebuildCrossfadeTables()
+{
+    const int numSamples = currentSampleRate > 0.0
+        ? (int)std::round((crossfadeMs / 1000.0) * currentSampleRate)
+        : 0;
+
+    // Built here and swapped in under the lock; the old tables are freed after it
+    CrossfadeTables newTables(numSamples, crossfadeCurve);
+    std::vector<float> newScratch((size_t)numSamples);
+
+    const juce::SpinLock::ScopedLockType sl(audioLock);
+    std::swap(crossfadeTables, newTables);
+    std::swap(fadeScratch, newScratch);
+    crossfadeSamples = numSamples;
+    loopEngine.setCrossfade(&crossfadeTables);
 }
 
 //==============================================================================
 void AudioFilePlayer::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
 {
+    // A new file is being swapped in right now: output silence for this block
+    const juce::SpinLock::ScopedTryLockType sl(audioLock);
+    if (!sl.isLocked())
+    {
+        info.clearActiveBufferRegion();
+        return;
+    }
+
+    const double audioLen = getLength();
+    displayState.publishPlayhead(audioLen > 0.0 ? getPosition() / audioLen : 0.0);
+
     // If no file loaded or transport not playing, just clear
-    if (!readerSource)
+    if (!playbackSource)
     {
         info.clearActiveBufferRegion();
         return;
     }
 
-    if (!transport.isPlaying())
+    if (!playing)
     {
         info.clearActiveBufferRegion();
         return;
     }
 
-    double startPos = transport.getCurrentPosition();
+    // A new region sequence was started: jump to its first region
+    if (needsNewRegion.load() && (randomMode || granularMode) && advanceToNextRegion())
+        needsNewRegion = false;
+
+    // Region loops never reach the end of the file, so in a playlist they end after
+    // the file's length; the message thread then installs the next entry
+    if (playlistActive.load() && useRegionLoop && looping)
+    {
+        entryElapsed += info.numSamples;
+
+        if ((double)entryElapsed >= audioLen * currentSampleRate)
+        {
+            playing = false;
+            reachedEnd = true;
+            info.clearActiveBufferRegion();
+            return;
+        }
+    }
+
+    // Granular mode on a RAM-resident file: a grain cloud scanning the region
+    if (isGrainEngineActive())
+    {
+        if (granular.process(info))
+            advanceToNextRegion();
+
+        return;
+    }
+
+    // Streamed file: the transport stops itself at the end of the stream
+    if (sampleStore == nullptr && !transport->isPlaying())
+    {
+        playing = false;
+        reachedEnd = true;
+        info.clearActiveBufferRegion();
+        return;
+    }
+
+    // Pitch-preserving tempo
+    if (stretcher.getMode() != TimeStretcher::Mode::off)
+    {
+        // Tempo has settled and the high-quality render is ready: play it like any RAM file
+        const auto* rendered = sampleStore != nullptr
+            ? stretchCache.getRendered(sampleStore.get(), tempoRatio, stretcher.getMode())
+            : nullptr;
+
+        if (rendered != nullptr)
+        {
+            setEngineStore(rendered->store.get(), rendered->ratio);
+            stretchActive = false;
+            renderFromStore(info);
+            return;
+        }
+
+        // Otherwise (tempo moving, render not ready) the stretcher pulls the file through renderSource()
+        if (sampleStore != nullptr)
+            setEngineStore(sampleStore.get(), 1.0);
+
+        // Don't resume with audio buffered the last time it was on
+        if (!stretchActive)
+            stretcher.reset();
+
+        stretchActive = true;
+        stretcher.process(*info.buffer, info.startSample, info.numSamples);
+        return;
+    }
+
+    if (sampleStore != nullptr)
+        setEngineStore(sampleStore.get(), 1.0);
+
+    stretchActive = false;
+    renderSource(info);
+}
+
+void AudioFilePlayer::setEngineStore(const SampleStore* store, double speed)
+{
+    if (store == engineStore)
+        return;
+
+    const double filePosition = loopEngine.getPosition() * engineSpeed.load();
+
+    loopEngine.setSource(store);
+    loopEngine.setPosition((long long)(filePosition / speed));
+
+    engineStore = store;
+    engineSpeed = speed;
+}
+
+void AudioFilePlayer::renderSource(const juce::AudioSourceChannelInfo& info)
+{
+    // RAM-resident file: sample-accurate loop engine
+    if (sampleStore != nullptr)
+        renderFromStore(info);
+    else
+        renderFromTransport(info);
+}
+
+void AudioFilePlayer::renderFromTransport(const juce::AudioSourceChannelInfo& info)
+{
+    const double audioLen = getLength();
+    double startPos = transport->getCurrentPosition();
     double blockEnd = startPos + (info.numSamples / currentSampleRate);
-    double audioLen = getLength();
 
     //--------------------------------------------------------------------------------
     // Region-based loop (works for random or granular or normal region)
@@ -233,11 +874,9 @@ void AudioFilePlayer::getNextAudioBlock(const juce::AudioSourceChannelInfo& info
             int secondChunkSize = info.numSamples - samplesUntilEnd;
             if (secondChunkSize > 0)
             {
-                // If random/granular => choose new random region
-                if (randomMode || granularMode)
-                    generateRandomRegion();
-                else
-                    transport.setPosition(regionStartSec);
+                // If random/granular => take the next planned region
+                if (!((randomMode || granularMode) && advanceToNextRegion()))
+                    transport->setPosition(regionStartSec);
 
                 juce::AudioSourceChannelInfo secondChunk(info.buffer,
                     info.startSample + samplesUntilEnd,
@@ -257,18 +896,16 @@ void AudioFilePlayer::getNextAudioBlock(const juce::AudioSourceChannelInfo& info
         }
 
         // If position somehow advanced beyond endSec, pick new region or jump
-        double newPos = transport.getCurrentPosition();
+        double newPos = transport->getCurrentPosition();
         if (newPos >= regionEndSec)
         {
-            if (randomMode || granularMode)
-                generateRandomRegion();
-            else
-                transport.setPosition(regionStartSec);
+            if (!((randomMode || granularMode) && advanceToNextRegion()))
+                transport->setPosition(regionStartSec);
         }
     }
-    else if (looping && audioLen > 0.0)
+    else if (looping && !playlistActive.load() && audioLen > 0.0)
     {
-        // Normal full-file loop
+        // Normal full-file loop (a playlist moves on to its next entry instead)
         if (blockEnd > audioLen)
         {
             int samplesUntilEnd = juce::roundToInt((audioLen - startPos) * currentSampleRate);
@@ -291,7 +928,7 @@ void AudioFilePlayer::getNextAudioBlock(const juce::AudioSourceChannelInfo& info
             int secondChunkSize = info.numSamples - samplesUntilEnd;
             if (secondChunkSize > 0)
             {
-                transport.setPosition(0.0);
+                transport->setPosition(0.0);
 
                 juce::AudioSourceChannelInfo secondChunk(info.buffer,
                     info.startSample + samplesUntilEnd,
@@ -317,105 +954,156 @@ void AudioFilePlayer::getNextAudioBlock(const juce::AudioSourceChannelInfo& info
 
 void AudioFilePlayer::changeListenerCallback(juce::ChangeBroadcaster* src)
 {
-    if (src == &transport)
+    if (src == transport.get())
     {
         // If transport changes, we could do something, but we don't specifically here.
     }
 }
 
-void AudioFilePlayer::generateRandomRegion()
+void AudioFilePlayer::restartRegionSchedule()
 {
-    double fileLen = getLength();
-    if (fileLen <= 0.05)
-        return;
-
-    // Different region lengths for random vs granular
+    // Different region lengths for random vs granular. The grain engine needs
+    // room for several grains, so its regions scale with the grain size.
     double minLen = randomMode ? 0.1 : 0.05;
     double maxLen = randomMode ? 3.0 : 0.20;
 
-    if (minLen > fileLen)
-        minLen = fileLen * 0.5;
+    if (!randomMode && isGrainEngineActive())
+    {
+        minLen = juce::jmax(minLen, 2.0 * grainSizeSec.load());
+        maxLen = juce::jmax(maxLen, 8.0 * grainSizeSec.load());
+    }
+
+    regionScheduler.restart(getLength(), minLen, maxLen);
+    needsNewRegion = true;
+
+    // A seed replays the grains along with the regions
+    granular.setSeed(regionScheduler.getSeed());
+
+    thread.moveToFrontOfQueue(&regionScheduler);
+}
+
+bool AudioFilePlayer::advanceToNextRegion()
+{
+    RegionScheduler::Region region;
+    if (!regionScheduler.popNextRegion(region))
+        return false;
+
+    const double fileLen = getLength();
+    regionStartSec = juce::jmin(region.startSec, fileLen);
+    regionEndSec = juce::jmin(region.endSec, fileLen);
 
-    double range = (fileLen - minLen);
-    if (range < 0.0)
-        range = 0.0;
+    // Move the grain engine's scan position, the loop engine's cursor,
+    // or (streamed files only) the transport to the new region start
+    const double rate = storeRate.load();
+
+    if (isGrainEngineActive())
+        granular.setRegion((long long)(regionStartSec * rate), (long long)(regionEndSec * rate));
+    else if (sampleStore != nullptr)
+        loopEngine.jumpTo((long long)(regionStartSec * rate / engineSpeed.load()),
+            (long long)((regionEndSec - regionStartSec) * rate / engineSpeed.load()));
+    else
+        transport->setPosition(regionStartSec);
 
-    // Generate a random start
-    double newStart = ((double)std::rand() / RAND_MAX) * range;
-    double length = minLen + ((double)std::rand() / RAND_MAX) * (maxLen - minLen);
-    double newEnd = newStart + length;
-    if (newEnd > fileLen)
-        newEnd = fileLen;
+    // Let the UI (ColorizedOfflineWave) highlight it at its next frame
+    if (fileLen > 0.0)
+        displayState.publishRegion(regionStartSec / fileLen, regionEndSec / fileLen,
+            region.regionColour, region.playheadColour);
 
-    regionStartSec = newStart;
-    regionEndSec = newEnd;
+    return true;
+}
 
-    // Move transport to new region start
-    transport.setPosition(regionStartSec);
+void AudioFilePlayer::renderFromStore(const juce::AudioSourceChannelInfo& info)
+{
+    auto& buffer = *info.buffer;
+    int emptyWraps = 0;
 
-    // Notify UI (ColorizedOfflineWave) if needed
-    if (onRandomRegionChanged)
+    for (int done = 0; done < info.numSamples; )
     {
-        double normStart = regionStartSec / fileLen;
-        double normEnd = regionEndSec / fileLen;
-
-        // Create some random colors for region + playhead
-        juce::Colour c1 = juce::Colour::fromHSV(
-            (float)(std::rand() % 360) / 360.0f,
-            0.4f + 0.4f * ((float)std::rand() / RAND_MAX),
-            1.0f, 0.3f
-        );
-        juce::Colour c2 = juce::Colour::fromHSV(
-            (float)(std::rand() % 360) / 360.0f,
-            0.9f,
-            0.95f,
-            1.0f
-        );
-
-        onRandomRegionChanged(normStart, normEnd, c1, c2);
+        // Re-read after every boundary: a playlist switch changes the store
+        const long long total = engineStore->getNumSamples();
+
+        // File seconds to samples of the store the engine plays
+        const double toEngine = storeRate.load() / engineSpeed.load();
+
+        // Boundaries in samples, re-read after every wrap (a random region may have changed them)
+        const long long loopStart = juce::jlimit(0LL, total, (long long)(regionStartSec * toEngine));
+        const long long loopEnd = juce::jlimit(0LL, total, (long long)(regionEndSec * toEngine));
+        const bool regionLoop = useRegionLoop && looping && loopEnd > loopStart;
+
+        // With a playlist the end of the file leads to the next entry, never back to the start
+        const bool loopsFile = looping && !playlistActive.load();
+
+        // The outgoing voice of a crossfade plays on past the boundary, which it can't do past
+        // the end of the file: there the fade (into the next playlist entry, or back to the
+        // loop start) begins a crossfade's length early instead
+        const bool toNextEntry = !regionLoop && playlistNext != nullptr && retiredStore == nullptr;
+        const long long loopFrom = regionLoop ? loopStart : 0;
+        const long long boundary = regionLoop ? loopEnd : total;
+        const bool fadesAtBoundary = toNextEntry ? playlistCrossfade.load() : (regionLoop || loopsFile);
+        const long long fadeLength = boundary >= total && fadesAtBoundary
+            ? juce::jmin(loopEngine.getCrossfadeLengthInSource(), (boundary - loopFrom) / 2) : 0;
+        const long long end = boundary - fadeLength;
+
+        const int num = loopEngine.render(buffer, info.startSample + done, info.numSamples - done, end);
+        done += num;
+
+        if (!loopEngine.hasReached(end))
+            continue;
+
+        if (toNextEntry)
+        {
+            switchToNextPlaylistEntry();
+            continue;
+        }
+
+        // At the boundary: stop at the end of the file (a playlist entry not ready to
+        // follow at the sample is installed by the message thread), or wrap
+        if (!(regionLoop || loopsFile))
+        {
+            playing = false;
+            reachedEnd = true;
+            buffer.clear(info.startSample + done, info.numSamples - done);
+            break;
+        }
+
+        // A region that yields no samples (e.g. a zero-length one) must not spin forever
+        if (num == 0 && ++emptyWraps > 2)
+        {
+            buffer.clear(info.startSample + done, info.numSamples - done);
+            break;
+        }
+
+        // If random/granular => take the next planned region, otherwise loop exactly.
+        // Either way the engine crossfades the old and new audio over each other.
+        if (!(regionLoop && (randomMode || granularMode) && advanceToNextRegion()))
+            loopEngine.wrapTo(loopFrom, end, end - loopFrom);
     }
 }
 
 //------------------------------------------------------------------------------
 void AudioFilePlayer::fadeOut(const juce::AudioSourceChannelInfo& sourceInfo, int fadeSamps)
 {
+    fadeSamps = juce::jmin(fadeSamps, sourceInfo.numSamples, crossfadeTables.getLength());
     if (fadeSamps < 1)
         return;
 
-    int startOffset = sourceInfo.numSamples - fadeSamps;
-    if (startOffset < 0)
-        startOffset = 0;
-
-    auto* buffer = const_cast<juce::AudioBuffer<float>*>(sourceInfo.buffer);
+    const int startOffset = sourceInfo.numSamples - fadeSamps;
+    const float* gains = crossfadeTables.getGains(false, 0, fadeSamps, fadeSamps, fadeScratch.data());
 
-    for (int ch = 0; ch < buffer->getNumChannels(); ++ch)
-    {
-        float* data = buffer->getWritePointer(ch, sourceInfo.startSample + startOffset);
-        for (int i = 0; i < fadeSamps && (startOffset + i) < sourceInfo.numSamples; ++i)
-        {
-            float x = (float)i / (float)(fadeSamps - 1);
-            float gain = std::cos(juce::MathConstants<float>::halfPi * x);
-            data[i] *= gain;
-        }
-    }
+    for (int ch = 0; ch < sourceInfo.buffer->getNumChannels(); ++ch)
+        juce::FloatVectorOperations::multiply(
+            sourceInfo.buffer->getWritePointer(ch, sourceInfo.startSample + startOffset), gains, fadeSamps);
 }
 
 void AudioFilePlayer::fadeIn(const juce::AudioSourceChannelInfo& sourceInfo, int fadeSamps)
 {
+    fadeSamps = juce::jmin(fadeSamps, sourceInfo.numSamples, crossfadeTables.getLength());
     if (fadeSamps < 1)
         return;
 
-    auto* buffer = const_cast<juce::AudioBuffer<float>*>(sourceInfo.buffer);
+    const float* gains = crossfadeTables.getGains(true, 0, fadeSamps, fadeSamps, fadeScratch.data());
 
-    for (int ch = 0; ch < buffer->getNumChannels(); ++ch)
-    {
-        float* data = buffer->getWritePointer(ch, sourceInfo.startSample);
-
-        for (int i = 0; i < fadeSamps && i < sourceInfo.numSamples; ++i)
-        {
-            float x = (float)i / (float)(fadeSamps - 1);
-            float gain = std::sin(juce::MathConstants<float>::halfPi * x);
-            data[i] *= gain;
-        }
-    }
+    for (int ch = 0; ch < sourceInfo.buffer->getNumChannels(); ++ch)
+        juce::FloatVectorOperations::multiply(
+            sourceInfo.buffer->getWritePointer(ch, sourceInfo.startSample), gains, fadeSamps);
 }
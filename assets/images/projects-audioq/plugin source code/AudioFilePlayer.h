@@ -3,28 +3,45 @@
 #include <JuceHeader.h>
 #include <functional>
 #include <vector>
+#include "SampleStore.h"
+#include "AudioFileLoader.h"
+#include "GranularEngine.h"
+#include "LoopPlaybackEngine.h"
+#include "RegionScheduler.h"
+#include "DisplayStateMailbox.h"
+#include "TimeStretcher.h"
+#include "StretchRenderCache.h"
+#include "RegionPrefetchSource.h"
+#include "PagedSampleStore.h"
+#include "SampleLibrary.h"
 
 /**
  * AudioFilePlayer
  *
  * A class for loading and playing audio files in JUCE, using:
- *  - AudioFormatReader -> AudioFormatReaderSource -> AudioTransportSource,
- *  - ResamplingAudioSource for speed/pitch changes,
- *  - "Random Mode" or "Granular Mode" to automatically jump around the file in small or medium loops,
- *  - Offline buffer for displaying the waveform.
+ *  - AudioFileLoader (background) -> SampleStore (decoded once, converted to the
+ *    device rate) -> LoopPlaybackEngine, a sample-accurate cursor with exact loop
+ *    and region wrapping,
+ *  - PagedSampleStore (bounded page cache, paged in ahead of the playhead and of
+ *    upcoming random regions) -> AudioTransportSource -> SincResamplingSource
+ *    streaming for files too large for RAM; with paging off, AudioFormatReaderSource ->
+ *    RegionPrefetchSource (read-ahead buffer plus a cache of upcoming regions) instead,
+ *  - "Random Mode" to automatically jump around the file in medium loops,
+ *  - "Granular Mode": a GranularEngine grain cloud scanning random regions of the file
+ *    (falls back to small region loops for streamed files),
+ *  - Optional pitch-preserving tempo changes through a TimeStretcher (WSOLA or
+ *    phase vocoder) instead of tape-style resampling; once the tempo settles a
+ *    StretchRenderCache renders the file ahead at high quality and that plays instead,
+ *  - A waveform peak pyramid computed by the loader for display,
+ *  - A gapless playlist: the next file is preloaded in the background and the
+ *    loop engine carries on into it at the exact sample, optionally crossfading,
+ *  - Every file loaded is indexed in the SampleLibrary, for the library browser.
  *
  * It also provides region-based looping with optional crossfades and random region generation.
  */
-struct Grain
-{
-    // Old struct for multi-grain usage, not used in the new approach.
-    long long offlineStart = 0;
-    int       totalSamples = 0;
-    int       cursor = 0;
-    int       startOffsetInBlock = 0;
-};
-
-class AudioFilePlayer : private juce::ChangeListener
+class AudioFilePlayer : private juce::ChangeListener,
+                        private juce::Timer,
+                        private juce::AsyncUpdater
 {
 public:
     AudioFilePlayer();
@@ -34,14 +51,106 @@ public:
     // Loading files
     //==============================================================================
     /**
-     * Load an audio file into the transport. Returns true on success.
+     * Load an audio file synchronously on the calling thread. The file is opened
+     * and decoded once into a SampleStore that playback and the waveform share.
+     * Files larger than the RAM-resident limit are streamed instead.
+     * Returns true on success.
      */
     bool loadFile(const juce::File& file);
 
     /**
-     * Load an audio file into offlineBuffer (for waveform display).
+     * Load an audio file on a background worker. Any load already in progress is
+     * cancelled. When done, the new audio is swapped in between two audio blocks
+     * and onLoaded(success) is called on the message thread. If the file's peaks
+     * are cached, onOverviewReady gets them first, before any audio is decoded.
+     */
+    void loadFileAsync(const juce::File& file, std::function<void(bool)> onLoaded,
+        std::function<void(WaveformOverview::Ptr)> onOverviewReady = nullptr);
+
+    /**
+     * Switches to audio that is already decoded, such as an imported sample-list
+     * entry: no disk access and no waiting, the swap happens right away. `store`
+     * plays (converted to the device rate in the background if it is not at it),
+     * `nativeStore` is the file's own decode. Cancels a background load in progress.
+     */
+    void loadDecodedAudio(const juce::File& file, SampleStore::Ptr nativeStore, SampleStore::Ptr store,
+        WaveformOverview::Ptr overview);
+
+    /** Cancels a background load in progress, if any. */
+    void cancelLoading() { loader.cancel(); }
+
+    bool  isLoading()       const { return loader.isLoading(); }
+    float getLoadProgress() const { return loader.getProgress(); }
+
+    /** Files whose decoded size exceeds this many bytes are streamed instead of held in RAM. */
+    void setRamResidentLimitBytes(long long numBytes) { loader.setRamResidentLimitBytes(numBytes); }
+
+    /** How RAM-resident files are held (32-bit floats unless set). Applies from the next load. */
+    void setCompactStorage(AudioFileLoader::CompactStorage mode)
+    {
+        loader.setCompactStorage(mode);
+        preloader.setCompactStorage(mode);
+    }
+
+    /**
+     * Enable/disable memory-mapped reading of uncompressed files (WAV/AIFF).
+     * When enabled, both the transport and the offline buffer read straight
+     * from the mapped file pages instead of a decoding stream.
      */
-    bool loadFileToBuffer(const juce::File& file);
+    void setMemoryMappingEnabled(bool shouldMap) { loader.setMemoryMappingEnabled(shouldMap); }
+    bool isMemoryMappingEnabled() const { return loader.isMemoryMappingEnabled(); }
+
+    /** True if the currently loaded file is played from a memory map. */
+    bool isLoadedFileMemoryMapped() const { return loadedFileIsMapped; }
+
+    /**
+     * Streamed files: size of the read-ahead buffer, and how many upcoming random
+     * regions are prefetched and how much of each. Applies from the next load.
+     */
+    void setStreamReadAheadSamples(int numSamples) { streamReadAheadSamples = juce::jmax(0, numSamples); }
+    void setRegionPrefetch(int numRegions, double secondsPerRegion);
+
+    /**
+     * Memory budget of the page cache streamed files are played through (256 MB by
+     * default). Missing pages fade out instead of blocking. 0 turns paging off, using
+     * the read-ahead buffer and region prefetch above. Applies from the next load.
+     */
+    void setPagedCacheBytes(long long numBytes) { pagedCacheBytes = juce::jmax(0LL, numBytes); }
+
+    /** Counters for sizing the prefetch or page cache: jumps served from it, or not. */
+    struct PrefetchStats
+    {
+        juce::uint64 hits = 0;
+        juce::uint64 misses = 0;
+    };
+
+    PrefetchStats getPrefetchStats() const;
+
+    //==============================================================================
+    // Playlist
+    //==============================================================================
+    /**
+     * Plays the files in order, without stopping: the first is loaded now and each
+     * next one is preloaded (decoded and converted) while the current one plays.
+     * RAM-resident files follow each other at the exact sample, crossfaded if
+     * enabled; files that have to be streamed switch with a short gap.
+     *
+     * The playlist wins over looping: every entry plays to the end of its file
+     * and the next one follows, whether or not file looping is on. In a loop
+     * region, Random or Granular mode an entry ends once it has played for as
+     * long as its file lasts, and the next one starts after a short gap.
+     */
+    void setPlaylist(const juce::Array<juce::File>& files, bool loopPlaylist);
+    void clearPlaylist();
+
+    /** Crossfade between playlist entries, with the crossfade time and curve set below. */
+    void setPlaylistCrossfade(bool shouldCrossfade) { playlistCrossfade = shouldCrossfade; }
+
+    /** Index of the playing entry, -1 without a playlist (message thread). */
+    int getPlaylistIndex() const { return playlist.isEmpty() ? -1 : playlistIndex; }
+
+    /** Called on the message thread when the playlist has moved on to another entry. */
+    std::function<void(int index)> onPlaylistAdvanced;
 
     //==============================================================================
     // Transport / Playback
@@ -51,6 +160,28 @@ public:
     bool isPlaying() const;
     void setResamplingRatio(double ratio);
 
+    /**
+     * Interpolation quality for every speed change: streamed files, the loop
+     * engine and grains all read through the same polyphase sinc kernels.
+     */
+    void setResamplingQuality(SincKernelBank::Quality quality);
+
+    /**
+     * How the resampling ratio is applied (audio thread): off resamples like a
+     * tape machine, the other modes change speed but keep the pitch.
+     * Granular mode is not affected.
+     */
+    void setTimeStretchMode(TimeStretcher::Mode mode) { stretcher.setMode(mode); }
+    TimeStretcher::Mode getTimeStretchMode() const { return stretcher.getMode(); }
+
+    /**
+     * Render-ahead of stretched audio (RAM-resident files): how long the tempo
+     * must stay put before rendering starts, and the largest render allowed.
+     */
+    void setStretchRenderSettleTimeMs(int ms) { stretchCache.setSettleTimeMs(ms); }
+    void setStretchRenderMaxBytes(long long numBytes) { stretchCache.setMaxBytes(numBytes); }
+    float getStretchRenderProgress() const { return stretchCache.getProgress(); }
+
     // Position
     void setPosition(double newTimeSec);
     double getPosition() const;
@@ -67,8 +198,17 @@ public:
     void setLooping(bool shouldLoop);
     void setRegionLoop(double startSec, double endSec, bool enable);
 
-    // Offline buffer for display
-    const juce::AudioBuffer<float>& getOfflineBuffer() const { return offlineBuffer; }
+    // Decoded samples of the loaded file at its own rate (null if the file is streamed)
+    SampleStore::Ptr getSampleStore() const { return nativeStore; }
+
+    // Peak pyramid of the loaded file for the waveform display (message thread only)
+    WaveformOverview::Ptr getOfflineOverview() const { return offlineOverview; }
+
+    /**
+     * Reads samples of the loaded file for zoomed-in waveform drawing (message thread only).
+     * Comes from the SampleStore, or from a separate display reader for streamed files.
+     */
+    bool readDisplaySamples(juce::AudioBuffer<float>& dest, long long startSample, int numSamples);
 
     //==============================================================================
     // Random / Granular
@@ -79,50 +219,196 @@ public:
     void setGranularMode(bool enable);
     bool isGranularMode() const { return granularMode; }
 
-    // Parameters used if needed
-    void setGrainSize(float sizeSec) { grainSizeSec = sizeSec; }
-    void setGrainDensity(float density) { grainDensity = density; }
+    // Grain length in seconds and overlap (0..1), called from the audio thread
+    void setGrainSize(float sizeSec);
+    void setGrainDensity(float density);
 
-    // Callback for region highlight changes
-    std::function<void(double startNorm,
-        double endNorm,
-        juce::Colour regionColour,
-        juce::Colour playheadColour)> onRandomRegionChanged;
+    // Grain shape and per-grain randomisation (audio thread)
+    void setGrainWindow(GranularEngine::WindowShape shape) { granular.setWindowShape(shape); }
+    void setGrainPitchSpread(float semitones) { granular.setPitchSpread(semitones); }
+    void setGrainPanSpread(float spread) { granular.setPanSpread(spread); }
+
+    /**
+     * Seed for the random region sequence of Random/Granular modes. With a
+     * non-zero seed each time a mode is switched on it replays the same regions,
+     * and in Granular mode the same grain detune, jitter and pan.
+     */
+    void setRegionSeed(juce::uint64 seed);
+    juce::uint64 getRegionSeed() const { return regionScheduler.getSeed(); }
+
+    // Dense clouds: overlap at full density, and threads sharing the rendering
+    // (the thread count applies at the next prepareToPlay)
+    void setGrainMaxOverlap(float grains) { granular.setMaxOverlap(grains); }
+    void setNumGrainWorkerThreads(int numThreads) { granular.setNumWorkerThreads(numThreads); }
+    GranularEngine::RenderStats getGrainRenderStats() const { return granular.getRenderStats(); }
+
+    /**
+     * Region highlight and playhead published by the audio thread,
+     * for the editor to read at frame rate.
+     */
+    const DisplayStateMailbox& getDisplayState() const { return displayState; }
 
-    // Crossfade time in ms for looping transitions
+    /**
+     * Crossfade time in ms for looping transitions (10 ms by default). RAM-resident
+     * files crossfade the outgoing and incoming audio over each other; streamed
+     * files fade out before the boundary and back in after it.
+     */
     void setCrossfadeTimeMs(double ms);
+    void setCrossfadeCurve(CrossfadeTables::Curve curve);
 
 private:
+    /**
+     * Swaps freshly loaded audio in. The swap happens under audioLock, so the
+     * audio thread sees either the old file or the new one for a whole block.
+     */
+    void installLoadedAudio(std::unique_ptr<LoadedAudio> loaded);
+
+    /**
+     * Message thread. Makes sure the RAM-resident file plays from a copy at the
+     * device rate: uses the decoded store if it already matches, otherwise has
+     * the loader convert it in the background. Until then the engines resample
+     * in real time.
+     */
+    void requestStoreConversion();
+
+    /** Adds a file that has just been swapped in to the sample library. */
+    void addToLibrary(const LoadedAudio& loaded);
+
+    /** Swaps the converted copy of `native` in (ignored if another file was loaded since). */
+    void installConvertedStore(const SampleStore::Ptr& native, SampleStore::Ptr converted);
+
+    /**
+     * Starts preloading the entry after `index` (wrapping if the playlist loops).
+     * Entries that fail to load are skipped, up to attemptsLeft of them.
+     */
+    void preloadPlaylistEntryAfter(int index, int attemptsLeft);
+
+    /**
+     * Audio thread: continues into the preloaded playlist entry. The file it leaves
+     * is parked in retiredStore for the message thread to release once the loop
+     * engine has faded out of it.
+     */
+    void switchToNextPlaylistEntry();
+
+    /** Message thread: completes a switch the audio thread made (file info, display, next preload). */
+    void finishPlaylistSwitch();
+
+    /** Releases the file the last playlist switch left, once the crossfade out of it is over. */
+    void releaseRetiredStore();
+
+    /** Moves the playlist on after a switch, and reports it. */
+    void advancePlaylistIndex();
+
+    /** Playlist housekeeping on the message thread. */
+    void timerCallback() override;
+
+    /** Runs the store conversion prepareToPlay() asked for, on the message thread. */
+    void handleAsyncUpdate() override;
+
     /** Internal callback for changes in AudioTransportSource. */
     void changeListenerCallback(juce::ChangeBroadcaster* src) override;
 
     /**
-     * Generate a new random region. The length depends on whether we are
-     * in randomMode (bigger) or granularMode (smaller).
+     * Message thread, outside audioLock: a transport playing `source`, already
+     * prepared for the device and started if playback is on.
+     */
+    std::unique_ptr<juce::AudioTransportSource> createTransport(juce::PositionableAudioSource* source, double sourceRate);
+
+    /**
+     * Under audioLock: makes `newTransport` and its `newSource` the ones that play,
+     * only moving pointers. The previous pair is handed back in the arguments,
+     * to be released (transport first) after the lock.
      */
-    void generateRandomRegion();
+    void swapTransport(std::unique_ptr<juce::AudioTransportSource>& newTransport,
+        std::unique_ptr<juce::PositionableAudioSource>& newSource);
 
-    /** Fades out the last portion of a block for crossfade. */
+    /**
+     * Starts a new sequence of random regions for the current file and mode.
+     * The length depends on whether we are in randomMode (bigger) or
+     * granularMode (smaller). Not for the audio thread.
+     */
+    void restartRegionSchedule();
+
+    /**
+     * Audio thread: moves to the next region planned by the RegionScheduler.
+     * O(1) and lock-free; returns false (keeping the current region) if none is ready.
+     */
+    bool advanceToNextRegion();
+
+    /**
+     * Plays a RAM-resident file through the LoopPlaybackEngine: renders up to each
+     * loop or region boundary and wraps there, as often as the block needs.
+     */
+    void renderFromStore(const juce::AudioSourceChannelInfo& info);
+
+    /** Plays a streamed file through the transport, with region and file loops. */
+    void renderFromTransport(const juce::AudioSourceChannelInfo& info);
+
+    /** Renders the loaded file at the current ratio; also the TimeStretcher's input. */
+    void renderSource(const juce::AudioSourceChannelInfo& info);
+
+    /**
+     * Audio thread (or under audioLock): makes the loop engine play `store`, whose
+     * timeline is the file's sped up by `speed`, keeping the position in the file.
+     */
+    void setEngineStore(const SampleStore* store, double speed);
+
+    /** Recomputes the fade tables for the current crossfade time, curve and sample rate. */
+    void rebuildCrossfadeTables();
+
+    /** Fades out the last portion of a block (streamed files). */
     void fadeOut(const juce::AudioSourceChannelInfo& info, int fadeSamps);
 
-    /** Fades in the next portion of a block for crossfade. */
+    /** Fades in the next portion of a block (streamed files). */
     void fadeIn(const juce::AudioSourceChannelInfo& info, int fadeSamps);
 
-    // Old multi-grain approach (not used now)
-    void spawnNewGrains(int) {}
-    void mixGrains(juce::AudioSourceChannelInfo&) {}
+    /** True when granular mode can render grains from a RAM-resident store. */
+    bool isGrainEngineActive() const { return granularMode && sampleStore != nullptr; }
 
     //==============================================================================
     // Internal objects
     //==============================================================================
-    juce::AudioFormatManager formatManager;
-    juce::TimeSliceThread    thread;
+    AudioFileLoader       loader;
+    juce::SharedResourcePointer<SampleLibrary> library;
+    juce::TimeSliceThread thread;
+    RegionScheduler       regionScheduler;
+    DisplayStateMailbox   displayState;
+
+    // Set when a new region sequence starts; the audio thread then picks its first region
+    std::atomic<bool> needsNewRegion{ false };
+
+    // Held by the audio thread for a whole block, and by installLoadedAudio for the swap
+    juce::SpinLock audioLock;
+
+    // RAM-resident files. The engine plays sampleStore (engineSpeed 1) or a
+    // render-ahead of it at engineSpeed, so engine samples = store samples / engineSpeed.
+    LoopPlaybackEngine  loopEngine;
+    const SampleStore*  engineStore = nullptr;
+    std::atomic<double> engineSpeed{ 1.0 };
+    StretchRenderCache  stretchCache;
 
-    juce::AudioTransportSource                     transport;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    juce::ResamplingAudioSource                    resamplingSource;
+    // Streamed files
+    std::atomic<int>                                 streamReadAheadSamples{ 32768 };
+    std::atomic<int>                                 prefetchRegions{ 8 };
+    std::atomic<double>                              prefetchSecondsPerRegion{ 0.5 };
+    std::atomic<long long>                           pagedCacheBytes{ 256LL * 1024 * 1024 };
+    RegionPrefetchSource::Counters                   prefetchCounters;
+    std::unique_ptr<juce::AudioTransportSource>      transport;
+    std::unique_ptr<juce::PositionableAudioSource>   playbackSource;
+    SincResamplingSource                             resamplingSource;
+
+    // Pitch-preserving tempo: pulls from renderSource() at ratio 1 and stretches
+    TimeStretcher stretcher;
+    bool          stretchActive = false;
+    double        tempoRatio = 1.0;
 
     double currentSampleRate = 0.0;
+    int    currentBlockSize = 0;
+
+    // The device rate as last prepared, for the message thread's store conversion
+    std::atomic<double> deviceSampleRate{ 0.0 };
+
+    std::atomic<bool> playing{ false };
 
     // Region-based loop
     bool   looping = false;
@@ -131,20 +417,51 @@ private:
     double regionEndSec = 0.0;
 
     // File info
+    juce::File loadedFile;
     double    loadedSampleRate = 0.0;
     long long loadedLengthInSamples = 0;
     double    loadedLengthInSeconds = 0.0;
 
-    // Offline buffer for waveform
-    juce::AudioBuffer<float> offlineBuffer;
+    bool loadedFileIsMapped = false;
+
+    // Decoded audio (null while streaming) and its display data. sampleStore is
+    // what plays: nativeStore converted to the device rate, or nativeStore itself.
+    SampleStore::Ptr      sampleStore;
+    SampleStore::Ptr      nativeStore;
+    std::atomic<double>   storeRate{ 0.0 };   ///< sampleStore's sample rate
+    WaveformOverview::Ptr offlineOverview;
+    std::unique_ptr<juce::AudioFormatReader> displayReader;
+
+    // Playlist (message thread), and the preloaded next entry. The audio thread
+    // only sees playlistNext and retiredStore, both swapped under audioLock.
+    AudioFileLoader              preloader;
+    juce::Array<juce::File>      playlist;
+    int                          playlistIndex = 0;
+    int                          preloadedIndex = 0;
+    bool                         playlistLoops = false;
+    std::unique_ptr<LoadedAudio> preloaded;
+    SampleStore::Ptr             playlistNext;
+    SampleStore::Ptr             retiredStore;
+    std::atomic<bool>            playlistCrossfade{ true };
+    std::atomic<bool>            playlistSwitched{ false };
+    std::atomic<bool>            reachedEnd{ false };
+    std::atomic<bool>            playlistActive{ false };   ///< Set while a playlist is playing
+    long long                    entryElapsed = 0;          ///< Audio thread: output samples of the current entry
 
     // Random / Granular
     bool randomMode = false;
     bool granularMode = false;
 
-    float grainSizeSec = 0.05f;
-    float grainDensity = 3.0f;
+    GranularEngine granular;
+
+    std::atomic<float> grainSizeSec{ 0.1f };
+    float grainDensity = 0.5f;
 
+    // Crossfades
+    double                 crossfadeMs = 10.0;
+    CrossfadeTables::Curve crossfadeCurve = CrossfadeTables::Curve::equalPower;
+    CrossfadeTables        crossfadeTables;
+    std::vector<float>     fadeScratch;
     int crossfadeSamples = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFilePlayer)
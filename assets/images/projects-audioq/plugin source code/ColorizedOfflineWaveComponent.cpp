@@ -4,7 +4,9 @@
  * ColorizedOfflineWaveComponent.cpp
  *
  * Implementation of an offline buffer waveform display. It shows:
- *  - A colorized waveform (colors vary with amplitude),
+ *  - A colorized min/max waveform with an RMS core (colors vary with amplitude),
+ *    drawn from the peak pyramid level that matches the zoom,
+ *  - Individual samples when zoomed in all the way, fetched once per visible span,
  *  - A draggable region selection,
  *  - A playhead line.
  */
@@ -16,73 +18,64 @@ ColorizedOfflineWaveComponent::ColorizedOfflineWaveComponent()
 
 ColorizedOfflineWaveComponent::~ColorizedOfflineWaveComponent() {}
 
-void ColorizedOfflineWaveComponent::setOfflineBuffer(const juce::AudioBuffer<float>& buf)
+void ColorizedOfflineWaveComponent::setOverview(WaveformOverview::Ptr newOverview)
 {
     {
         juce::ScopedLock sl(bufferLock);
-        offlineBuffer.makeCopyOf(buf, true);
-        rebuildEnvelope();
+        overview = std::move(newOverview);
+        viewStartNorm = 0.0;
+        viewEndNorm = 1.0;
+        scratchFirstSample = -1;
     }
     repaint();
 }
 
-void ColorizedOfflineWaveComponent::setPlayheadPosition(double pos)
+void ColorizedOfflineWaveComponent::setSampleProvider(SampleProvider provider)
 {
-    {
-        juce::ScopedLock sl(bufferLock);
-        playheadPos = juce::jlimit(0.0, 1.0, pos);
-    }
+    sampleProvider = std::move(provider);
+    scratchFirstSample = -1;
     repaint();
 }
 
-void ColorizedOfflineWaveComponent::rebuildEnvelope()
+void ColorizedOfflineWaveComponent::setVisibleRange(double startNorm, double endNorm)
 {
-    envelope.clear();
+    {
+        juce::ScopedLock sl(bufferLock);
 
-    int numSamples = offlineBuffer.getNumSamples();
-    int numCh = offlineBuffer.getNumChannels();
-    if (numSamples < 1 || numCh < 1)
-        return;
+        // Never zoom in further than a handful of samples across the whole width
+        double minSpan = 1.0;
+        if (overview != nullptr && overview->getTotalSamples() > 0)
+            minSpan = juce::jmin(1.0, minVisibleSamples / (double)overview->getTotalSamples());
 
-    // We'll create a 1024-point envelope
-    const int envResolution = 1024;
-    envelope.resize((size_t)envResolution, 0.0f);
+        double span = juce::jlimit(minSpan, 1.0, endNorm - startNorm);
+        viewStartNorm = juce::jlimit(0.0, 1.0 - span, startNorm);
+        viewEndNorm = viewStartNorm + span;
+    }
+    repaint();
+}
 
-    for (int i = 0; i < envResolution; ++i)
+void ColorizedOfflineWaveComponent::setPlayheadPosition(double pos)
+{
     {
-        int start = i * numSamples / envResolution;
-        int end = (i + 1) * numSamples / envResolution;
-        if (end > numSamples)
-            end = numSamples;
-
-        float peak = 0.0f;
-        for (int ch = 0; ch < numCh; ++ch)
-        {
-            const float* data = offlineBuffer.getReadPointer(ch);
-            for (int s = start; s < end; ++s)
-            {
-                float a = std::abs(data[s]);
-                if (a > peak)
-                    peak = a;
-            }
-        }
-        envelope[(size_t)i] = juce::jlimit(0.0f, 1.0f, peak);
+        juce::ScopedLock sl(bufferLock);
+        playheadPos = juce::jlimit(0.0, 1.0, pos);
     }
+    repaint();
 }
 
 void ColorizedOfflineWaveComponent::paint(juce::Graphics& g)
 {
     g.fillAll(juce::Colours::darkgrey.darker(0.6f));
 
-    // Copy data locally for thread safety
-    std::vector<float> localEnv;
+    // Copy data locally for thread safety (the pyramid itself is shared, not copied)
+    WaveformOverview::Ptr localOverview;
     double localPlayhead = 0.0;
     double selStart = 0.0, selEnd = 0.0;
     juce::Colour localRegionColour, localPlayheadColour;
 
     {
         juce::ScopedLock sl(bufferLock);
-        localEnv = envelope;
+        localOverview = overview;
         localPlayhead = playheadPos;
         selStart = std::min(regionStartNorm, regionEndNorm);
         selEnd = std::max(regionStartNorm, regionEndNorm);
@@ -90,7 +83,7 @@ void ColorizedOfflineWaveComponent::paint(juce::Graphics& g)
         localPlayheadColour = playheadColour;
     }
 
-    if (localEnv.empty())
+    if (localOverview == nullptr || localOverview->isEmpty())
     {
         g.setColour(juce::Colours::white);
         g.drawFittedText("No file loaded or empty buffer!",
@@ -101,61 +94,171 @@ void ColorizedOfflineWaveComponent::paint(juce::Graphics& g)
     }
 
     auto bounds = getLocalBounds().toFloat();
-    float w = bounds.getWidth();
-    float h = bounds.getHeight();
-    int envSz = (int)localEnv.size();
 
     // Draw region highlight
     if (selEnd > selStart + 0.000001)
     {
-        float rx1 = bounds.getX() + (float)selStart * w;
-        float rx2 = bounds.getX() + (float)selEnd * w;
-        g.setColour(localRegionColour);
-        g.fillRect(rx1, bounds.getY(), rx2 - rx1, bounds.getHeight());
+        float rx1 = juce::jmax(bounds.getX(), normToX(selStart));
+        float rx2 = juce::jmin(bounds.getRight(), normToX(selEnd));
+        if (rx2 > rx1)
+        {
+            g.setColour(localRegionColour);
+            g.fillRect(rx1, bounds.getY(), rx2 - rx1, bounds.getHeight());
+        }
     }
 
     // Draw waveform
-    for (int i = 0; i < envSz; ++i)
+    drawPeaks(g, *localOverview, bounds);
+
+    // Draw the playhead line
+    if (localPlayhead >= viewStartNorm && localPlayhead <= viewEndNorm)
     {
-        float x = (float)i / (float)envSz * w;
-        float amp = localEnv[(size_t)i];
+        float px = normToX(localPlayhead);
+        g.setColour(localPlayheadColour);
+        g.drawLine(px, bounds.getY(), px, bounds.getBottom(), 2.0f);
+    }
+}
 
-        // Simple amplitude-based color transitions
-        juce::Colour c;
-        if (amp < 0.25f)
-        {
-            // Light green to green
-            juce::Colour lightGreen = juce::Colour(144, 238, 144);
-            c = lightGreen.interpolatedWith(juce::Colours::green, amp / 0.25f);
-        }
-        else if (amp < 0.5f)
-        {
-            c = juce::Colours::green.interpolatedWith(juce::Colours::white, (amp - 0.25f) / 0.25f);
-        }
-        else if (amp < 0.75f)
-        {
-            c = juce::Colours::white.interpolatedWith(juce::Colours::yellow, (amp - 0.5f) / 0.25f);
-        }
-        else
-        {
-            c = juce::Colours::yellow.interpolatedWith(juce::Colours::red, (amp - 0.75f) / 0.25f);
-        }
+void ColorizedOfflineWaveComponent::drawPeaks(juce::Graphics& g, const WaveformOverview& ov, juce::Rectangle<float> bounds)
+{
+    const int width = (int)bounds.getWidth();
+    if (width < 1)
+        return;
+
+    const double total = (double)ov.getTotalSamples();
+    const double firstSample = viewStartNorm * total;
+    const double samplesPerPixel = (viewEndNorm - viewStartNorm) * total / (double)width;
+
+    // Less than a sample per pixel: draw the samples themselves. Coarser than that
+    // the finest pyramid level is drawn instead, which needs no reads
+    if (samplesPerPixel <= 1.0)
+    {
+        const auto first = (long long)firstSample;
+        const auto numVisible = juce::jmin(ov.getTotalSamples() - first,
+                                           (long long)std::ceil(samplesPerPixel * width) + 1);
+
+        if (drawSamples(g, first, numVisible, ov.getTotalSamples(), bounds))
+            return;
+    }
+
+    const int level = ov.findLevelFor(samplesPerPixel);
+
+    float halfH = bounds.getHeight() * 0.5f;
+    float midY = bounds.getY() + halfH;
+
+    // One combined peak per pixel column => O(width) whatever the zoom
+    for (int px = 0; px < width; ++px)
+    {
+        const auto s0 = (long long)(firstSample + px * samplesPerPixel);
+        const auto s1 = juce::jmax(s0 + 1, (long long)(firstSample + (px + 1) * samplesPerPixel));
+
+        auto peak = ov.getPeak(level, s0, s1);
+        float minVal = juce::jlimit(-1.0f, 1.0f, peak.minValue);
+        float maxVal = juce::jlimit(-1.0f, 1.0f, peak.maxValue);
+        float rms = juce::jlimit(0.0f, 1.0f, peak.rms);
+        float amp = juce::jmax(-minVal, maxVal);
+
+        juce::Colour c = colourForAmplitude(amp);
+        float x = bounds.getX() + (float)px;
+
+        // Peak range, then the RMS core on top
         g.setColour(c);
+        g.drawLine(x, midY - maxVal * halfH, x, midY - minVal * halfH, 1.0f);
+
+        g.setColour(c.brighter(0.4f));
+        g.drawLine(x, midY - rms * halfH, x, midY + rms * halfH, 1.0f);
+    }
+}
 
-        float halfH = h * 0.5f;
-        float midY = bounds.getY() + halfH;
-        float mag = amp * halfH;
+bool ColorizedOfflineWaveComponent::drawSamples(juce::Graphics& g, long long firstSample, long long numVisible,
+    long long totalSamples, juce::Rectangle<float> bounds)
+{
+    if (!sampleProvider || numVisible < 1)
+        return false;
 
-        g.drawLine(x, midY - mag, x, midY + mag, 1.0f);
+    // The playhead repaints at frame rate; only a new span (or file) reads again
+    if (firstSample != scratchFirstSample || (int)numVisible != scratchNumSamples)
+    {
+        scratchFirstSample = -1;
+
+        if (!sampleProvider(sampleScratch, firstSample, (int)numVisible) || sampleScratch.getNumChannels() < 1)
+            return false;
+
+        scratchFirstSample = firstSample;
+        scratchNumSamples = (int)numVisible;
     }
 
-    // Draw the playhead line
-    if (localPlayhead >= 0.0 && localPlayhead <= 1.0)
+    const float halfH = bounds.getHeight() * 0.5f;
+    const float midY = bounds.getY() + halfH;
+    const int numSamples = sampleScratch.getNumSamples();
+    const int numChannels = sampleScratch.getNumChannels();
+
+    // Mix down to one trace so loop points can be compared across channels
+    juce::Path trace;
+    for (int i = 0; i < numSamples; ++i)
     {
-        float px = bounds.getX() + (float)localPlayhead * w;
-        g.setColour(localPlayheadColour);
-        g.drawLine(px, bounds.getY(), px, bounds.getBottom(), 2.0f);
+        float v = 0.0f;
+        for (int ch = 0; ch < numChannels; ++ch)
+            v += sampleScratch.getSample(ch, i);
+        v = juce::jlimit(-1.0f, 1.0f, v / (float)numChannels);
+
+        const float x = normToX(((double)(firstSample + i) + 0.5) / (double)totalSamples);
+        const float y = midY - v * halfH;
+
+        if (i == 0)
+            trace.startNewSubPath(x, y);
+        else
+            trace.lineTo(x, y);
     }
+
+    g.setColour(colourForAmplitude(0.5f));
+    g.strokePath(trace, juce::PathStrokeType(1.5f));
+
+    // Individual sample dots once they are far enough apart
+    if (bounds.getWidth() / (float)numSamples >= 6.0f)
+    {
+        g.setColour(juce::Colours::white);
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float v = 0.0f;
+            for (int ch = 0; ch < numChannels; ++ch)
+                v += sampleScratch.getSample(ch, i);
+            v = juce::jlimit(-1.0f, 1.0f, v / (float)numChannels);
+
+            const float x = normToX(((double)(firstSample + i) + 0.5) / (double)totalSamples);
+            g.fillEllipse(x - 2.0f, midY - v * halfH - 2.0f, 4.0f, 4.0f);
+        }
+    }
+
+    return true;
+}
+
+juce::Colour ColorizedOfflineWaveComponent::colourForAmplitude(float amp)
+{
+    // Simple amplitude-based color transitions
+    if (amp < 0.25f)
+    {
+        // Light green to green
+        juce::Colour lightGreen = juce::Colour(144, 238, 144);
+        return lightGreen.interpolatedWith(juce::Colours::green, amp / 0.25f);
+    }
+    if (amp < 0.5f)
+        return juce::Colours::green.interpolatedWith(juce::Colours::white, (amp - 0.25f) / 0.25f);
+    if (amp < 0.75f)
+        return juce::Colours::white.interpolatedWith(juce::Colours::yellow, (amp - 0.5f) / 0.25f);
+
+    return juce::Colours::yellow.interpolatedWith(juce::Colours::red, (amp - 0.75f) / 0.25f);
+}
+
+double ColorizedOfflineWaveComponent::xToNorm(float x) const
+{
+    float w = (float)juce::jmax(1, getWidth());
+    return juce::jlimit(0.0, 1.0, viewStartNorm + (double)(x / w) * (viewEndNorm - viewStartNorm));
+}
+
+float ColorizedOfflineWaveComponent::normToX(double norm) const
+{
+    return (float)((norm - viewStartNorm) / (viewEndNorm - viewStartNorm) * (double)getWidth());
 }
 
 void ColorizedOfflineWaveComponent::resized()
@@ -168,9 +271,7 @@ void ColorizedOfflineWaveComponent::mouseDown(const juce::MouseEvent& event)
     mouseDownX = (float)event.getMouseDownX();
     mouseMoved = false;
 
-    float x = (float)event.getPosition().x;
-    float w = (float)getWidth();
-    float norm = juce::jlimit(0.0f, 1.0f, x / w);
+    double norm = xToNorm((float)event.getPosition().x);
 
     {
         juce::ScopedLock sl(bufferLock);
@@ -186,9 +287,7 @@ void ColorizedOfflineWaveComponent::mouseDrag(const juce::MouseEvent& event)
     if (distX > dragThreshold)
         mouseMoved = true;
 
-    float x = (float)event.getPosition().x;
-    float w = (float)getWidth();
-    float norm = juce::jlimit(0.0f, 1.0f, x / w);
+    double norm = xToNorm((float)event.getPosition().x);
 
     if (mouseMoved)
     {
@@ -202,9 +301,7 @@ void ColorizedOfflineWaveComponent::mouseDrag(const juce::MouseEvent& event)
 
 void ColorizedOfflineWaveComponent::mouseUp(const juce::MouseEvent& event)
 {
-    float x = (float)event.getPosition().x;
-    float w = (float)getWidth();
-    float norm = juce::jlimit(0.0f, 1.0f, x / w);
+    double norm = xToNorm((float)event.getPosition().x);
 
     double startVal, endVal;
     bool wasSelecting = false;
@@ -241,6 +338,27 @@ void ColorizedOfflineWaveComponent::mouseUp(const juce::MouseEvent& event)
     }
 }
 
+void ColorizedOfflineWaveComponent::mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel)
+{
+    const double span = viewEndNorm - viewStartNorm;
+
+    if (event.mods.isShiftDown() || std::abs(wheel.deltaX) > std::abs(wheel.deltaY))
+    {
+        // Scroll by a fraction of the visible span
+        const double delta = (std::abs(wheel.deltaX) > 0.0f ? -wheel.deltaX : -wheel.deltaY) * span;
+        setVisibleRange(viewStartNorm + delta, viewEndNorm + delta);
+        return;
+    }
+
+    // Zoom around the position under the cursor
+    const double anchor = xToNorm((float)event.getPosition().x);
+    const double factor = std::pow(2.0, -(double)wheel.deltaY * 2.0);
+    const double newSpan = span * factor;
+    const double anchorFrac = (anchor - viewStartNorm) / span;
+
+    setVisibleRange(anchor - anchorFrac * newSpan, anchor + (1.0 - anchorFrac) * newSpan);
+}
+
 void ColorizedOfflineWaveComponent::setRegionColor(juce::Colour c)
 {
     juce::ScopedLock sl(bufferLock);
@@ -255,13 +373,15 @@ void ColorizedOfflineWaveComponent::setPlayheadColor(juce::Colour c)
 
 void ColorizedOfflineWaveComponent::setRegionSelectionNormalized(double startNorm, double endNorm)
 {
-    // Call asynchronously so we don't block the audio or cause thread conflicts
-    juce::MessageManager::callAsync([this, startNorm, endNorm]()
-        {
-            juce::ScopedLock sl(bufferLock);
-            regionStartNorm = juce::jlimit(0.0, 1.0, startNorm);
-            regionEndNorm = juce::jlimit(0.0, 1.0, endNorm);
-            isSelectingRegion = true;
-            repaint();
-        });
+    // Region updates from the audio thread arrive through the editor's timer
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    {
+        juce::ScopedLock sl(bufferLock);
+        regionStartNorm = juce::jlimit(0.0, 1.0, startNorm);
+        regionEndNorm = juce::jlimit(0.0, 1.0, endNorm);
+        isSelectingRegion = true;
+    }
+
+    repaint();
 }
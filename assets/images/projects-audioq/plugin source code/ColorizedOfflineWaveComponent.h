@@ -3,6 +3,7 @@
 #include <JuceHeader.h>
 #include <vector>
 #include <functional>
+#include "WaveformOverview.h"
 
 /**
  * ColorizedOfflineWaveComponent
@@ -10,7 +11,12 @@
  * A component that displays a static offline audio buffer in a colorful waveform.
  * - Single-click sets the playhead position (calls onPlayheadDragged callback),
  * - Mouse drag selects a region (calls onRegionSelected callback).
+ * - Mouse wheel zooms around the cursor, shift+wheel (or horizontal wheel) scrolls.
  * - The waveform can be colorized based on amplitude.
+ *
+ * Drawing picks the peak pyramid level matching the current zoom, so any view
+ * renders in O(width). Zoomed in to less than a sample per pixel, raw samples are
+ * drawn; they are fetched once per visible span, not on every repaint.
  */
 class ColorizedOfflineWaveComponent : public juce::Component
 {
@@ -18,8 +24,26 @@ public:
     ColorizedOfflineWaveComponent();
     ~ColorizedOfflineWaveComponent() override;
 
-    /** Pass in the audio buffer to display; it will create an internal “envelope” representation. */
-    void setOfflineBuffer(const juce::AudioBuffer<float>& buf);
+    /**
+     * Pass in the peak pyramid to display; resets the zoom to the whole file.
+     * The pyramid is built by the file loader off the message thread.
+     */
+    void setOverview(WaveformOverview::Ptr newOverview);
+
+    /**
+     * Provides raw samples for views zoomed in to less than a sample per pixel:
+     * fills the buffer with numSamples samples from startSample, returns false on failure.
+     * It may read the disk, so it is only called when the visible span changes.
+     */
+    using SampleProvider = std::function<bool(juce::AudioBuffer<float>&, long long startSample, int numSamples)>;
+    void setSampleProvider(SampleProvider provider);
+
+    //==============================================================================
+    // Zoom & scroll
+    //==============================================================================
+    /** Sets the visible part of the file in [0..1]. */
+    void setVisibleRange(double startNorm, double endNorm);
+    juce::Range<double> getVisibleRange() const { return { viewStartNorm, viewEndNorm }; }
 
     /** Update the playhead marker (0..1). */
     void setPlayheadPosition(double pos);
@@ -47,23 +71,46 @@ public:
     void setPlayheadColor(juce::Colour c);
 
     /**
-     * Asynchronously set a region highlight in [0..1],
+     * Set a region highlight in [0..1] (message thread),
      * e.g., used by random/granular mode to highlight chosen loop region.
      */
     void setRegionSelectionNormalized(double startNorm, double endNorm);
 
 private:
-    /** Rebuilds an amplitude envelope from offlineBuffer for drawing. */
-    void rebuildEnvelope();
-
-    // Mouse events for single-click and dragging
+    // Mouse events for single-click, dragging and zooming
     void mouseDown(const juce::MouseEvent& event) override;
     void mouseDrag(const juce::MouseEvent& event) override;
     void mouseUp(const juce::MouseEvent& event) override;
+    void mouseWheelMove(const juce::MouseEvent& event, const juce::MouseWheelDetails& wheel) override;
+
+    /** Converts between x-coordinates and file positions in [0..1] for the current view. */
+    double xToNorm(float x) const;
+    float  normToX(double norm) const;
+
+    /** Draws the visible part of the file from the pyramid level for this zoom. */
+    void drawPeaks(juce::Graphics& g, const WaveformOverview& ov, juce::Rectangle<float> bounds);
+
+    /** Draws individual samples when zoomed in to less than a sample per pixel. */
+    bool drawSamples(juce::Graphics& g, long long firstSample, long long numVisible,
+        long long totalSamples, juce::Rectangle<float> bounds);
+
+    /** The amplitude-based waveform colour. */
+    static juce::Colour colourForAmplitude(float amp);
+
+    // Peak pyramid for drawing, and raw samples for deep zoom
+    WaveformOverview::Ptr overview;
+    SampleProvider sampleProvider;
+
+    // The raw samples last fetched and the span they cover (message thread);
+    // a new overview or provider empties it
+    juce::AudioBuffer<float> sampleScratch;
+    long long scratchFirstSample = -1;
+    int       scratchNumSamples = 0;
 
-    // Offline buffer data
-    juce::AudioBuffer<float> offlineBuffer;
-    std::vector<float> envelope;
+    // Visible part of the file in [0..1]
+    double viewStartNorm = 0.0;
+    double viewEndNorm = 1.0;
+    static constexpr double minVisibleSamples = 16.0;
 
     double playheadPos = 0.0;
     std::function<void(double)> onPlayheadDragged;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+/**
+ * CrossfadeTables
+ *
+ * Precomputed fade-in / fade-out gain curves for loop and region transitions,
+ * so the audio thread applies fades with vectorised multiplies instead of
+ * calling std::sin / std::cos per sample. Equal-power curves keep the level
+ * steady when two uncorrelated voices overlap; linear ones suit correlated material.
+ */
+class CrossfadeTables
+{
+public:
+    enum class Curve { equalPower = 0, linear };
+
+    CrossfadeTables() = default;
+
+    CrossfadeTables(int numSamples, Curve curve)
+        : fadeIn((size_t)juce::jmax(0, numSamples)), fadeOut((size_t)juce::jmax(0, numSamples))
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            // Sample centres, so a fade of any length (even 1) never divides by zero
+            const float x = ((float)i + 0.5f) / (float)numSamples;
+
+            if (curve == Curve::equalPower)
+            {
+                fadeIn[(size_t)i] = std::sin(juce::MathConstants<float>::halfPi * x);
+                fadeOut[(size_t)i] = std::cos(juce::MathConstants<float>::halfPi * x);
+            }
+            else
+            {
+                fadeIn[(size_t)i] = x;
+                fadeOut[(size_t)i] = 1.0f - x;
+            }
+        }
+    }
+
+    int getLength() const { return (int)fadeIn.size(); }
+
+    /**
+     * Gains for samples [startIndex, startIndex + numSamples) of a fade lasting
+     * fadeLength samples. Points straight into the table when fadeLength matches
+     * it; otherwise the table is resampled into scratch (numSamples floats).
+     */
+    const float* getGains(bool fadingIn, int startIndex, int numSamples, int fadeLength, float* scratch) const
+    {
+        const auto& table = fadingIn ? fadeIn : fadeOut;
+        const int length = getLength();
+
+        if (fadeLength == length)
+            return table.data() + startIndex;
+
+        for (int i = 0; i < numSamples; ++i)
+            scratch[i] = table[(size_t)juce::jmin(length - 1, (int)((juce::int64)(startIndex + i) * length / fadeLength))];
+
+        return scratch;
+    }
+
+private:
+    std::vector<float> fadeIn, fadeOut;
+};
@@ -0,0 +1,109 @@
+#include "DecodedAudioCache.h"
+
+/**
+ * DecodedAudioCache.cpp
+ *
+ * Lookup by file identity and rate, and the LRU trim of entries that only the
+ * cache still references.
+ */
+
+SampleStore::Ptr DecodedAudioCache::find(const juce::File& file, double sampleRate)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto* entry = findEntry(file, sampleRate);
+    if (entry == nullptr)
+        return nullptr;
+
+    entry->lastUsed = ++useCounter;
+    return entry->store;
+}
+
+SampleStore::Ptr DecodedAudioCache::add(const juce::File& file, SampleStore::Ptr store)
+{
+    jassert(store != nullptr);
+
+    const juce::ScopedLock sl(lock);
+
+    if (auto* existing = findEntry(file, store->getSampleRate()))
+    {
+        existing->lastUsed = ++useCounter;
+        return existing->store;
+    }
+
+    Entry entry;
+    entry.path = file.getFullPathName();
+    entry.fileSize = file.getSize();
+    entry.modTime = file.getLastModificationTime().toMilliseconds();
+    entry.sampleRate = store->getSampleRate();
+    entry.store = store;
+    entry.lastUsed = ++useCounter;
+    entries.push_back(std::move(entry));
+
+    trimLocked();
+    return store;
+}
+
+void DecodedAudioCache::setUnusedBytesLimit(long long numBytes)
+{
+    const juce::ScopedLock sl(lock);
+    unusedBytesLimit = juce::jmax(0LL, numBytes);
+    trimLocked();
+}
+
+void DecodedAudioCache::trim()
+{
+    const juce::ScopedLock sl(lock);
+    trimLocked();
+}
+
+long long DecodedAudioCache::getTotalBytes() const
+{
+    const juce::ScopedLock sl(lock);
+
+    long long total = 0;
+    for (const auto& entry : entries)
+        total += entry.store->getSizeInBytes();
+
+    return total;
+}
+
+//==============================================================================
+DecodedAudioCache::Entry* DecodedAudioCache::findEntry(const juce::File& file, double sampleRate)
+{
+    const auto path = file.getFullPathName();
+    const auto size = file.getSize();
+    const auto modTime = file.getLastModificationTime().toMilliseconds();
+
+    for (auto& entry : entries)
+        if (entry.sampleRate == sampleRate && entry.fileSize == size && entry.modTime == modTime && entry.path == path)
+            return &entry;
+
+    return nullptr;
+}
+
+void DecodedAudioCache::trimLocked()
+{
+    // Entries whose only reference is ours are unused
+    for (;;)
+    {
+        long long unusedBytes = 0;
+        Entry* oldest = nullptr;
+
+        for (auto& entry : entries)
+        {
+            if (entry.store->getReferenceCount() > 1)
+                continue;
+
+            unusedBytes += entry.store->getSizeInBytes();
+
+            if (oldest == nullptr || entry.lastUsed < oldest->lastUsed)
+                oldest = &entry;
+        }
+
+        if (oldest == nullptr || unusedBytes <= unusedBytesLimit)
+            return;
+
+        entries.erase(entries.begin() + (oldest - entries.data()));
+    }
+}
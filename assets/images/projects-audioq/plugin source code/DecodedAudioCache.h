@@ -0,0 +1,69 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "SampleStore.h"
+
+/**
+ * DecodedAudioCache
+ *
+ * Process-wide cache of decoded audio, so plugin instances loading the same
+ * file share one copy of its samples instead of each decoding their own.
+ * Use it through juce::SharedResourcePointer<DecodedAudioCache>.
+ *
+ * Entries are keyed by the file's path, size and modification time (an edited
+ * file is a new entry) plus the sample rate of the stored copy, so the file's
+ * own decode and its conversions to device rates are cached side by side.
+ *
+ * Stores are shared by reference count and must not be modified once added.
+ * An entry nobody else holds any more moves to an LRU tier: it is kept for
+ * fast reloads while the unused entries fit the unused-bytes limit, and the
+ * least recently used are dropped beyond it.
+ *
+ * All methods lock; never call them from the audio thread.
+ */
+class DecodedAudioCache
+{
+public:
+    DecodedAudioCache() = default;
+
+    /** The cached copy of this file at this sample rate, or nullptr. */
+    SampleStore::Ptr find(const juce::File& file, double sampleRate);
+
+    /**
+     * Adds a decoded copy of the file (keyed by the store's sample rate) and
+     * returns the one to use: if another instance added the same copy first,
+     * that one, so the duplicate can be dropped.
+     */
+    SampleStore::Ptr add(const juce::File& file, SampleStore::Ptr store);
+
+    /** How many bytes of entries nobody uses may be kept for reloads (256 MB by default). */
+    void setUnusedBytesLimit(long long numBytes);
+
+    /** Drops unused entries beyond the limit; call after releasing a store. */
+    void trim();
+
+    /** Total size of all cached stores, in bytes. */
+    long long getTotalBytes() const;
+
+private:
+    struct Entry
+    {
+        juce::String     path;
+        juce::int64      fileSize = 0;
+        juce::int64      modTime = 0;
+        double           sampleRate = 0.0;
+        SampleStore::Ptr store;
+        juce::uint32     lastUsed = 0;
+    };
+
+    Entry* findEntry(const juce::File& file, double sampleRate);
+    void trimLocked();
+
+    juce::CriticalSection lock;
+    std::vector<Entry>    entries;
+    juce::uint32          useCounter = 0;
+    long long             unusedBytesLimit = 256LL * 1024 * 1024;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DecodedAudioCache)
+};
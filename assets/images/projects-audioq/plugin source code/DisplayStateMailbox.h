@@ -0,0 +1,98 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+/**
+ * DisplayStateMailbox
+ *
+ * A lock-free "latest state" mailbox between the audio thread and the editor.
+ * The audio thread publishes the current random/granular region (bounds and
+ * colours) and the playhead position; the editor's timer reads the newest
+ * values at frame rate. Updates published between two frames simply overwrite
+ * each other, so the audio thread never posts messages or allocates.
+ *
+ * Single writer (the audio thread), any number of readers. Writing is wait-free.
+ * Reading uses a sequence counter and fails (keep the previous frame) if it
+ * raced with a write.
+ */
+class DisplayStateMailbox
+{
+public:
+    struct Snapshot
+    {
+        juce::uint32 regionVersion = 0;   ///< Changes every time a new region is published
+        double       regionStartNorm = 0.0;
+        double       regionEndNorm = 0.0;
+        juce::Colour regionColour;
+        juce::Colour playheadColour;
+        double       playheadNorm = 0.0;
+    };
+
+    /** Audio thread: a new region was chosen (bounds in [0..1]). */
+    void publishRegion(double startNorm, double endNorm, juce::Colour regionC, juce::Colour playheadC)
+    {
+        beginWrite();
+        regionStart.store(startNorm, std::memory_order_relaxed);
+        regionEnd.store(endNorm, std::memory_order_relaxed);
+        regionColour.store(regionC.getARGB(), std::memory_order_relaxed);
+        playheadColour.store(playheadC.getARGB(), std::memory_order_relaxed);
+        regionVersion.store(regionVersion.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        endWrite();
+    }
+
+    /** Audio thread: the playhead moved (in [0..1]). */
+    void publishPlayhead(double norm)
+    {
+        beginWrite();
+        playhead.store(norm, std::memory_order_relaxed);
+        endWrite();
+    }
+
+    /** Reads a consistent snapshot. Returns false if a write was in progress. */
+    bool read(Snapshot& s) const
+    {
+        for (int attempt = 0; attempt < 4; ++attempt)
+        {
+            const auto before = sequence.load(std::memory_order_acquire);
+            if ((before & 1) != 0)
+                continue;
+
+            s.regionVersion = regionVersion.load(std::memory_order_relaxed);
+            s.regionStartNorm = regionStart.load(std::memory_order_relaxed);
+            s.regionEndNorm = regionEnd.load(std::memory_order_relaxed);
+            s.regionColour = juce::Colour(regionColour.load(std::memory_order_relaxed));
+            s.playheadColour = juce::Colour(playheadColour.load(std::memory_order_relaxed));
+            s.playheadNorm = playhead.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (sequence.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    void beginWrite()
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite()
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Odd while a write is in progress
+    std::atomic<juce::uint32> sequence{ 0 };
+
+    std::atomic<juce::uint32> regionVersion{ 0 };
+    std::atomic<double>       regionStart{ 0.0 };
+    std::atomic<double>       regionEnd{ 0.0 };
+    std::atomic<juce::uint32> regionColour{ 0 };
+    std::atomic<juce::uint32> playheadColour{ 0 };
+    std::atomic<double>       playhead{ 0.0 };
+};
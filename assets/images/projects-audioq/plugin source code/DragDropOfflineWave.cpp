@@ -5,13 +5,16 @@
  *
  * Implementation of the DragDropOfflineWave component, which:
  *  - Accepts drag & drop of audio files,
- *  - Loads them into the AudioFilePlayer and updates the waveform display,
+ *  - Loads them into the AudioFilePlayer in the background, showing progress,
+ *  - Imports folders and multi-file drops into the sample list, showing throughput,
+ *    and switches the player between imported samples,
+ *  - Updates the waveform display once loading has finished,
  *  - Shows two toggle buttons for Random Mode and Granular Mode.
  */
 
 DragDropOfflineWave::DragDropOfflineWave(AudioFilePlayer& p,
-    ColorizedOfflineWaveComponent& offlineWaveRef)
-    : player(p), offlineWave(offlineWaveRef)
+    ColorizedOfflineWaveComponent& offlineWaveRef, SampleImporter& importerRef)
+    : player(p), offlineWave(offlineWaveRef), importer(importerRef)
 {
     // Random mode button
     addAndMakeVisible(randomModeButton);
@@ -22,10 +25,38 @@ DragDropOfflineWave::DragDropOfflineWave(AudioFilePlayer& p,
     addAndMakeVisible(granularModeButton);
     granularModeButton.setVisible(false); // hidden until a file is dropped
     granularModeButton.onClick = [this] { toggleGranularMode(); };
+
+    // Progress bar, shown only while a file is loading
+    addChildComponent(progressBar);
+
+    // Sample list, hidden until something has been imported. The importer lives in
+    // the processor, so entries imported while the editor was closed are listed too.
+    addChildComponent(sampleListBox);
+    sampleListBox.setTextWhenNothingSelected("Imported samples");
+    sampleListBox.onChange = [this] { selectImportedSample(sampleListBox.getSelectedItemIndex()); };
+
+    for (auto* sample : importer.getSamples())
+        addSampleToList(*sample);
+
+    addChildComponent(importProgressBar);
+
+    importer.onSampleImported = [this](ImportedSample::Ptr sample) { addSampleToList(*sample); };
+    importer.onImportFinished = [this] { importFinished(); };
+
+    if (importer.isImporting())
+    {
+        importProgressBar.setVisible(true);
+        startTimerHz(30);
+    }
 }
 
 DragDropOfflineWave::~DragDropOfflineWave()
 {
+    stopTimer();
+
+    // The importer outlives this editor component
+    importer.onSampleImported = nullptr;
+    importer.onImportFinished = nullptr;
 }
 
 bool DragDropOfflineWave::isInterestedInFileDrag(const juce::StringArray&)
@@ -51,39 +82,159 @@ void DragDropOfflineWave::filesDropped(const juce::StringArray& files, int, int)
     isDraggingOver = false;
     repaint();
 
-    if (files.size() > 0)
+    if (files.isEmpty())
+        return;
+
+    // One file plays straight away; folders and selections go to the sample list
+    juce::File droppedFile(files[0]);
+    if (files.size() == 1 && droppedFile.existsAsFile())
+        loadFile(droppedFile);
+    else
+        startImport(files);
+}
+
+void DragDropOfflineWave::loadFile(const juce::File& file)
+{
+    // Decode on a background worker; a load still in progress is cancelled
+    loadingFileName = file.getFileName();
+    loadProgress = 0.0;
+
+    randomModeButton.setVisible(false);
+    granularModeButton.setVisible(false);
+    progressBar.setVisible(true);
+    startTimerHz(30);
+
+    juce::Component::SafePointer<DragDropOfflineWave> safeThis(this);
+    player.loadFileAsync(file,
+        [safeThis](bool ok)
+        {
+            if (safeThis != nullptr)
+                safeThis->fileLoaded(ok);
+        },
+        [safeThis](WaveformOverview::Ptr cachedOverview)
+        {
+            // Peaks from the cache: show the waveform while the audio decodes
+            if (safeThis != nullptr)
+                safeThis->offlineWave.setOverview(cachedOverview);
+        });
+}
+
+void DragDropOfflineWave::startImport(const juce::StringArray& files)
+{
+    importer.importFiles(files);
+
+    importProgress = 0.0;
+    importProgressBar.setTextToDisplay("Scanning...");
+    importProgressBar.setVisible(true);
+    resized();
+    startTimerHz(30);
+}
+
+void DragDropOfflineWave::timerCallback()
+{
+    loadProgress = (double)player.getLoadProgress();
+
+    if (importProgressBar.isVisible())
     {
-        juce::File droppedFile(files[0]);
-        if (droppedFile.existsAsFile())
+        const auto progress = importer.getProgress();
+
+        if (progress.numQueued > 0)
         {
-            // 1) Load into the AudioFilePlayer
-            bool okTransport = player.loadFile(droppedFile);
-            // 2) Load to offline buffer for the visual waveform
-            bool okOffline = player.loadFileToBuffer(droppedFile);
-
-            if (okOffline)
-            {
-                // Update the waveform display with the newly loaded offlineBuffer
-                offlineWave.setOfflineBuffer(player.getOfflineBuffer());
-                offlineWave.setPlayheadPosition(0.0);
-                // Clear any region selection
-                offlineWave.setRegionSelectionNormalized(0.0, 0.0);
-            }
-
-            // Show the 2 toggle buttons (Random / Granular)
-            randomModeButton.setVisible(true);
-            granularModeButton.setVisible(true);
-
-            // Reset states
-            player.setRandomMode(false);
-            isRandomModeOn = false;
-            randomModeButton.setButtonText("Enable Random Mode");
-
-            player.setGranularMode(false);
-            isGranularModeOn = false;
-            granularModeButton.setButtonText("Enable Granular Mode");
+            importProgress = (double)progress.numFinished / (double)progress.numQueued;
+            importProgressBar.setTextToDisplay(juce::String(progress.numFinished) + " / " + juce::String(progress.numQueued)
+                + " files, " + juce::String(progress.getMegabytesPerSecond(), 1) + " MB/s, "
+                + juce::String(progress.getFilesPerSecond(), 1) + " files/s");
         }
     }
+
+    if (loadingFileName.isEmpty() && !importProgressBar.isVisible())
+        stopTimer();
+}
+
+void DragDropOfflineWave::addSampleToList(const ImportedSample& sample)
+{
+    const auto peakDb = juce::Decibels::gainToDecibels(sample.peak);
+    const auto rmsDb = juce::Decibels::gainToDecibels(sample.rms);
+
+    // Item IDs are list indices + 1 (0 means nothing selected)
+    sampleListBox.addItem(sample.file.getFileName()
+        + "  (" + juce::String(sample.getLengthInSeconds(), 1) + " s, peak "
+        + juce::String(peakDb, 1) + " dB, RMS " + juce::String(rmsDb, 1) + " dB)",
+        sampleListBox.getNumItems() + 1);
+
+    if (!sampleListBox.isVisible())
+    {
+        sampleListBox.setVisible(true);
+        resized();
+    }
+}
+
+void DragDropOfflineWave::importFinished()
+{
+    importProgress = 1.0;
+    importProgressBar.setVisible(false);
+    resized();
+
+    if (loadingFileName.isEmpty())
+        stopTimer();
+
+    // Nothing playing yet: start with the first entry
+    if (!randomModeButton.isVisible() && loadingFileName.isEmpty() && sampleListBox.getNumItems() > 0)
+        sampleListBox.setSelectedItemIndex(0);
+
+    repaint();
+}
+
+void DragDropOfflineWave::selectImportedSample(int index)
+{
+    const auto& samples = importer.getSamples();
+    if (!juce::isPositiveAndBelow(index, samples.size()))
+        return;
+
+    const auto* sample = samples.getUnchecked(index);
+
+    // Too large for RAM: streamed like a dropped file
+    if (!sample->isResident())
+    {
+        loadFile(sample->file);
+        return;
+    }
+
+    player.loadDecodedAudio(sample->file, sample->nativeStore, sample->store, sample->overview);
+    fileLoaded(true);
+}
+
+void DragDropOfflineWave::fileLoaded(bool success)
+{
+    if (!importProgressBar.isVisible())
+        stopTimer();
+
+    progressBar.setVisible(false);
+    loadingFileName.clear();
+
+    if (success)
+    {
+        // Update the waveform display with the newly loaded overview
+        offlineWave.setOverview(player.getOfflineOverview());
+        offlineWave.setPlayheadPosition(0.0);
+        // Clear any region selection
+        offlineWave.setRegionSelectionNormalized(0.0, 0.0);
+
+        // Show the 2 toggle buttons (Random / Granular)
+        randomModeButton.setVisible(true);
+        granularModeButton.setVisible(true);
+
+        // Reset states
+        player.setRandomMode(false);
+        isRandomModeOn = false;
+        randomModeButton.setButtonText("Enable Random Mode");
+
+        player.setGranularMode(false);
+        isGranularModeOn = false;
+        granularModeButton.setButtonText("Enable Granular Mode");
+    }
+
+    repaint();
 }
 
 void DragDropOfflineWave::paint(juce::Graphics& g)
@@ -95,10 +246,17 @@ void DragDropOfflineWave::paint(juce::Graphics& g)
     g.setColour(juce::Colours::white);
     g.setFont(16.0f);
 
-    if (!randomModeButton.isVisible() && !granularModeButton.isVisible())
+    if (loadingFileName.isNotEmpty())
+    {
+        g.drawFittedText("Loading " + loadingFileName + "...",
+            getLocalBounds().reduced(4),
+            juce::Justification::centredTop,
+            1);
+    }
+    else if (!randomModeButton.isVisible() && !granularModeButton.isVisible())
     {
         // Inform the user that they can drop a file here
-        g.drawFittedText("Drop a file here to load and see the waveform",
+        g.drawFittedText("Drop a file here to load and see the waveform, or a folder to import its samples",
             getLocalBounds().reduced(4),
             juce::Justification::centred,
             3);
@@ -120,6 +278,20 @@ void DragDropOfflineWave::resized()
     // Position the two buttons at the bottom
     auto bottomRow = r.removeFromBottom(40);
 
+    // Once there is a sample list, it takes the left third, with the import progress beside it
+    if (sampleListBox.isVisible() || importProgressBar.isVisible())
+    {
+        auto listArea = bottomRow.removeFromLeft(bottomRow.getWidth() / 3);
+
+        if (importProgressBar.isVisible())
+            importProgressBar.setBounds(listArea.removeFromRight(sampleListBox.isVisible() ? listArea.getWidth() / 2 : listArea.getWidth()).reduced(2));
+
+        sampleListBox.setBounds(listArea.reduced(2));
+    }
+
+    // The progress bar takes the button row while loading
+    progressBar.setBounds(bottomRow.reduced(2));
+
     // Half the row for each button
     auto leftHalf = bottomRow.removeFromLeft(bottomRow.getWidth() / 2);
 
@@ -139,19 +311,11 @@ void DragDropOfflineWave::toggleRandomMode()
         player.setGranularMode(false);
         granularModeButton.setButtonText("Enable Granular Mode");
 
-        // Provide a callback so that each time a random region is chosen, we highlight it
-        player.onRandomRegionChanged =
-            [this](double startNorm, double endNorm, juce::Colour regionC, juce::Colour playheadC)
-            {
-                offlineWave.setRegionSelectionNormalized(startNorm, endNorm);
-                offlineWave.setRegionColor(regionC);
-                offlineWave.setPlayheadColor(playheadC);
-            };
+        // Each chosen region is highlighted by the editor's timer
     }
     else
     {
-        // Remove the callback and reset wave highlight
-        player.onRandomRegionChanged = nullptr;
+        // Reset wave highlight
         offlineWave.setRegionSelectionNormalized(0.0, 0.0);
         offlineWave.setPlayheadColor(juce::Colours::limegreen);
     }
@@ -172,20 +336,11 @@ void DragDropOfflineWave::toggleGranularMode()
         player.setRandomMode(false);
         randomModeButton.setButtonText("Enable Random Mode");
 
-        // Provide a callback for new granular regions
-        player.onRandomRegionChanged =
-            [this](double startNorm, double endNorm, juce::Colour regionC, juce::Colour playheadC)
-            {
-                // Each small grain region => highlight it
-                offlineWave.setRegionSelectionNormalized(startNorm, endNorm);
-                offlineWave.setRegionColor(regionC);
-                offlineWave.setPlayheadColor(playheadC);
-            };
+        // Each granular region is highlighted by the editor's timer
     }
     else
     {
-        // Remove the callback and reset wave highlight
-        player.onRandomRegionChanged = nullptr;
+        // Reset wave highlight
         offlineWave.setRegionSelectionNormalized(0.0, 0.0);
         offlineWave.setPlayheadColor(juce::Colours::limegreen);
     }
@@ -3,29 +3,38 @@
 #include <JuceHeader.h>
 #include "AudioFilePlayer.h"
 #include "ColorizedOfflineWaveComponent.h"
+#include "SampleImporter.h"
 
 /**
  * DragDropOfflineWave
  *
  * This component handles:
  *  1) Receiving WAV files via Drag & Drop,
- *  2) Loading those files into an AudioFilePlayer and displaying the waveform,
- *  3) Two toggle buttons for "Random Mode" and "Granular Mode".
+ *  2) Loading those files into an AudioFilePlayer (in the background, with a progress bar)
+ *     and displaying the waveform,
+ *  3) Importing dropped folders or multiple files into the sample list in parallel,
+ *     with a list to switch the player between imported samples instantly,
+ *  4) Two toggle buttons for "Random Mode" and "Granular Mode".
  *
  * When a file is dropped, the audio file is loaded and displayed in a ColorizedOfflineWaveComponent.
+ * Dropping another file while one is still loading cancels the earlier load.
+ * Dropping a folder or several files imports them all, reporting progress and throughput.
  * Buttons appear to let the user switch between Random Mode (random looping of short/medium regions)
  * and Granular Mode (random looping of very short “grains”).
  */
 class DragDropOfflineWave : public juce::Component,
-    public juce::FileDragAndDropTarget
+    public juce::FileDragAndDropTarget,
+    private juce::Timer
 {
 public:
     /**
      * Constructor
      * @param p - reference to the main AudioFilePlayer
      * @param offlineWaveRef - reference to the ColorizedOfflineWaveComponent that displays the waveform
+     * @param importerRef - the processor's SampleImporter holding the sample list
      */
-    DragDropOfflineWave(AudioFilePlayer& p, ColorizedOfflineWaveComponent& offlineWaveRef);
+    DragDropOfflineWave(AudioFilePlayer& p, ColorizedOfflineWaveComponent& offlineWaveRef,
+        SampleImporter& importerRef);
 
     /** Destructor */
     ~DragDropOfflineWave() override;
@@ -54,7 +63,28 @@ public:
     /** Called whenever the component is resized, used to place buttons. */
     void resized() override;
 
+    /** Loads one file into the player in the background, showing progress (as if dropped). */
+    void loadFile(const juce::File& file);
+
 private:
+    /** Polls the player's load progress and the importer's progress while either runs. */
+    void timerCallback() override;
+
+    /** Starts importing the dropped files and folders into the sample list. */
+    void startImport(const juce::StringArray& files);
+
+    /** Adds an imported sample to the list box. */
+    void addSampleToList(const ImportedSample& sample);
+
+    /** Called on the message thread when the importer has nothing left to do. */
+    void importFinished();
+
+    /** Switches the player to the sample list entry at this index. */
+    void selectImportedSample(int index);
+
+    /** Called on the message thread when a background load has finished. */
+    void fileLoaded(bool success);
+
     /** Toggles "Random Mode" on/off, updates the button text. */
     void toggleRandomMode();
 
@@ -66,9 +96,20 @@ private:
     //==============================================================================
     AudioFilePlayer& player;                          ///< AudioFilePlayer reference
     ColorizedOfflineWaveComponent& offlineWave;       ///< Waveform display reference
+    SampleImporter& importer;                         ///< Sample list (owned by the processor)
 
     bool isDraggingOver = false;                      ///< True if a file is being dragged over
 
+    // Background loading
+    double loadProgress = 0.0;                        ///< Polled by progressBar (0..1)
+    juce::ProgressBar progressBar{ loadProgress };
+    juce::String loadingFileName;                     ///< Non-empty while a file is loading
+
+    // Sample list, and the progress of an import in progress
+    juce::ComboBox sampleListBox;
+    double importProgress = 0.0;                      ///< Polled by importProgressBar (0..1)
+    juce::ProgressBar importProgressBar{ importProgress };
+
     // Buttons for toggling modes
     juce::TextButton randomModeButton{ "Enable Random Mode" };
     bool isRandomModeOn = false;
@@ -0,0 +1,671 @@
+#include "GranularEngine.h"
+
+/**
+ * GranularEngine.cpp
+ *
+ * Spawns grains at sample-accurate offsets, renders each one with polyphase
+ * sinc interpolation into scratch buffers, applies its window and mixes it into
+ * its slice's buffer with FloatVectorOperations.
+ *
+ * Per chunk, the audio thread spawns grains, copies each slice's active grains
+ * into a free job, marks it pending and bumps the pool's epoch. Workers and the
+ * audio thread then claim jobs with a compare-and-swap, so nobody ever blocks on
+ * a lock. After the deadline the audio thread renders any job still with a worker
+ * itself, from the same grains; the worker finishes into a copy nobody reads.
+ * Only the audio thread moves grains on, after the chunk is summed.
+ */
+
+//==============================================================================
+class GranularEngine::Worker : public juce::Thread
+{
+public:
+    Worker(WorkerPool& p, int index)
+        : juce::Thread("Grain Worker " + juce::String(index)), pool(p)
+    {
+    }
+
+    void run() override;
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wake.signal();
+        stopThread(1000);
+    }
+
+    /** Signalled by the message thread only (an engine joining, or shutting down). */
+    juce::WaitableEvent wake;
+
+private:
+    static constexpr double spinTimeMs = 1.0;
+    static constexpr double pollTimeMs = 1000.0;
+
+    WorkerPool& pool;
+};
+
+//==============================================================================
+/**
+ * The helper threads, shared by every engine in the process so that several
+ * plugin instances don't each start a thread per core. The threads start when
+ * the first engine enables them and stop with the last engine.
+ *
+ * The audio thread never signals them: it bumps an atomic epoch, which idle
+ * workers poll, so handing work over is a single wait-free increment.
+ */
+class GranularEngine::WorkerPool
+{
+public:
+    static std::shared_ptr<WorkerPool> getShared()
+    {
+        static juce::CriticalSection lock;
+        static std::weak_ptr<WorkerPool> instance;
+
+        const juce::ScopedLock sl(lock);
+
+        auto shared = instance.lock();
+        if (shared == nullptr)
+        {
+            shared = std::make_shared<WorkerPool>();
+            instance = shared;
+        }
+
+        return shared;
+    }
+
+    // Leave a core for the host and the message thread
+    WorkerPool() : maxThreads(juce::jlimit(0, maxSlices - 1, juce::SystemStats::getNumCpus() - 2)) {}
+
+    ~WorkerPool()
+    {
+        for (int i = 0; i < numStarted; ++i)
+            workers[(size_t)i]->stop();
+    }
+
+    int getMaxThreads() const { return maxThreads; }
+
+    void add(GranularEngine& engine)
+    {
+        {
+            const juce::ScopedWriteLock sl(enginesLock);
+            engines.addIfNotAlreadyThere(&engine);
+        }
+
+        const juce::ScopedLock sl(startLock);
+
+        for (int i = numStarted; i < maxThreads; ++i)
+        {
+            workers[(size_t)i] = std::make_unique<Worker>(*this, i + 1);
+            workers[(size_t)i]->startThread(juce::Thread::Priority::high);
+            numStarted = i + 1;
+        }
+
+        // Workers that have dozed off look for work again
+        for (int i = 0; i < numStarted; ++i)
+            workers[(size_t)i]->wake.signal();
+    }
+
+    /** Workers render under the read lock, so none is inside the engine once this returns. */
+    void remove(GranularEngine& engine)
+    {
+        const juce::ScopedWriteLock sl(enginesLock);
+        engines.removeFirstMatchingValue(&engine);
+    }
+
+    /** Audio thread: announces newly pending jobs. Wait-free. */
+    void publish() { epoch.fetch_add(1, std::memory_order_release); }
+
+    juce::uint32 getEpoch() const { return epoch.load(std::memory_order_acquire); }
+
+    bool renderPendingJobs()
+    {
+        const juce::ScopedReadLock sl(enginesLock);
+        bool renderedAny = false;
+
+        for (auto* engine : engines)
+            renderedAny = engine->renderPendingJobs() || renderedAny;
+
+        return renderedAny;
+    }
+
+private:
+    const int maxThreads;
+
+    std::array<std::unique_ptr<Worker>, maxSlices - 1> workers;
+    int numStarted = 0;   ///< Guarded by startLock
+    juce::CriticalSection startLock;
+
+    std::atomic<juce::uint32> epoch{ 0 };
+
+    juce::ReadWriteLock enginesLock;
+    juce::Array<GranularEngine*> engines;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WorkerPool)
+};
+
+void GranularEngine::Worker::run()
+{
+    juce::uint32 seenEpoch = pool.getEpoch();
+    double lastWork = juce::Time::getMillisecondCounterHiRes();
+
+    while (!threadShouldExit())
+    {
+        // Scan the engines when new jobs were announced, and keep going while there are any
+        const auto epoch = pool.getEpoch();
+        if (epoch != seenEpoch)
+        {
+            seenEpoch = epoch;
+            lastWork = juce::Time::getMillisecondCounterHiRes();
+
+            while (pool.renderPendingJobs() && !threadShouldExit())
+                lastWork = juce::Time::getMillisecondCounterHiRes();
+
+            continue;
+        }
+
+        // Stay hot for a moment, the next chunk usually follows right away; then poll
+        // every millisecond while a cloud is playing, and doze once it has stopped.
+        // A job nobody picks up in time is simply rendered by the audio thread.
+        const double idleMs = juce::Time::getMillisecondCounterHiRes() - lastWork;
+
+        if (idleMs < spinTimeMs)
+            juce::Thread::yield();
+        else if (idleMs < pollTimeMs)
+            juce::Thread::sleep(1);
+        else
+            wake.wait(50);
+    }
+}
+
+//==============================================================================
+GranularEngine::GranularEngine()
+    : pool(WorkerPool::getShared())
+{
+    for (size_t i = 0; i < windowTables.size(); ++i)
+        fillWindowTable(windowTables[i], (WindowShape)i);
+
+    rngState = RegionScheduler::makeRandomState(0);
+    requestedWorkers = pool->getMaxThreads();
+}
+
+GranularEngine::~GranularEngine()
+{
+    setWorkersEnabled(false);
+}
+
+void GranularEngine::fillWindowTable(std::vector<float>& table, WindowShape shape)
+{
+    table.resize((size_t)windowTableSize);
+
+    const double pi = juce::MathConstants<double>::pi;
+    const double tukeyTaper = 0.5;   // Fraction of the grain spent fading in and out
+    const double gaussianSigma = 0.15;
+
+    for (int i = 0; i < windowTableSize; ++i)
+    {
+        const double x = (double)i / (double)(windowTableSize - 1);
+        double w = 0.0;
+
+        switch (shape)
+        {
+        case WindowShape::hann:
+            w = 0.5 - 0.5 * std::cos(2.0 * pi * x);
+            break;
+
+        case WindowShape::tukey:
+            if (x < tukeyTaper * 0.5)
+                w = 0.5 - 0.5 * std::cos(2.0 * pi * x / tukeyTaper);
+            else if (x > 1.0 - tukeyTaper * 0.5)
+                w = 0.5 - 0.5 * std::cos(2.0 * pi * (1.0 - x) / tukeyTaper);
+            else
+                w = 1.0;
+            break;
+
+        case WindowShape::gaussian:
+            w = std::exp(-0.5 * std::pow((x - 0.5) / gaussianSigma, 2.0));
+            break;
+        }
+
+        table[(size_t)i] = (float)w;
+    }
+}
+
+//==============================================================================
+void GranularEngine::prepare(double deviceSampleRate, int maxBlockSize)
+{
+    deviceRate = deviceSampleRate > 0.0 ? deviceSampleRate : 44100.0;
+    scratchSize = juce::jmax(1, maxBlockSize);
+
+    // Workers keep out of the slices while they are rebuilt
+    if (workersEnabled.load())
+        pool->remove(*this);
+
+    numSlices = juce::jmin(requestedWorkers, pool->getMaxThreads()) + 1;
+    const int grainsPerSlice = maxGrains / numSlices;
+
+    for (int s = 0; s < numSlices; ++s)
+    {
+        auto& slice = slices[(size_t)s];
+        slice.firstGrain = s * grainsPerSlice;
+        slice.numGrains = (s == numSlices - 1) ? maxGrains - slice.firstGrain : grainsPerSlice;
+
+        slice.freeList.resize((size_t)slice.numGrains);
+
+        for (auto& job : slice.jobs)
+        {
+            job.grains.resize((size_t)slice.numGrains);
+            job.scratch.prepare(scratchSize, kernels->getMaxTaps());
+            job.state = Job::idle;
+        }
+    }
+
+    inlineScratch.prepare(scratchSize, kernels->getMaxTaps());
+
+    reset();
+
+    if (workersEnabled.load())
+        pool->add(*this);
+}
+
+void GranularEngine::reset()
+{
+    waitForWorkers();
+
+    for (auto& g : grains)
+        g.active = false;
+
+    for (int s = 0; s < numSlices; ++s)
+    {
+        auto& slice = slices[(size_t)s];
+
+        // freeList was sized in prepare(), so this never allocates
+        slice.numFree = (int)slice.freeList.size();
+        for (int i = 0; i < slice.numFree; ++i)
+            slice.freeList[(size_t)i] = slice.firstGrain + slice.numFree - 1 - i;
+
+        for (auto& job : slice.jobs)
+            job.state = Job::idle;
+
+        slice.current = nullptr;
+    }
+
+    numActiveGrains = 0;
+    samplesUntilNextGrain = 0.0;
+}
+
+void GranularEngine::setSource(const SampleStore* newSource)
+{
+    source = newSource;
+    reset();
+}
+
+void GranularEngine::setRegion(long long startSample, long long endSample)
+{
+    regionStart = juce::jmax(0LL, startSample);
+    regionEnd = juce::jmax(regionStart, endSample);
+    scanPosition = (double)regionStart;
+}
+
+void GranularEngine::setSeed(juce::uint64 seed)
+{
+    // Offset from the region seed so the grains don't replay the regions' numbers
+    pendingRngState = RegionScheduler::makeRandomState(seed == 0 ? 0 : seed ^ 0x6a09e667f3bcc909ULL);
+}
+
+GranularEngine::RenderStats GranularEngine::getRenderStats() const
+{
+    RenderStats stats;
+    stats.parallelChunks = parallelChunks.load();
+    stats.slicesOnWorkers = slicesOnWorkers.load();
+    stats.slicesInline = slicesInline.load();
+    stats.slicesLate = slicesLate.load();
+    return stats;
+}
+
+void GranularEngine::RenderScratch::prepare(int numSamples, int maxTaps)
+{
+    mix.setSize(2, numSamples);
+    grainScratch.setSize(2, numSamples);
+    tapScratch.assign((size_t)maxTaps, 0.0f);
+    windowScratch.assign((size_t)numSamples, 0.0f);
+    sourceWindow.prepare(2 * juce::jmax(numSamples, 1024) + 2 * maxTaps + 2);
+}
+
+//==============================================================================
+void GranularEngine::setWorkersEnabled(bool shouldUseWorkers)
+{
+    if (shouldUseWorkers == workersEnabled.load())
+        return;
+
+    // Joined before the audio thread starts offering slices, left after it stops
+    if (shouldUseWorkers)
+    {
+        pool->add(*this);
+        workersEnabled = true;
+    }
+    else
+    {
+        workersEnabled = false;
+        pool->remove(*this);
+    }
+}
+
+void GranularEngine::waitForWorkers()
+{
+    for (int s = 0; s < numSlices; ++s)
+        for (auto& job : slices[(size_t)s].jobs)
+            while (job.state.load() == Job::claimed)
+                juce::Thread::yield();
+}
+
+bool GranularEngine::renderPendingJobs()
+{
+    bool renderedAny = false;
+
+    for (int s = 0; s < numSlices; ++s)
+    {
+        for (auto& job : slices[(size_t)s].jobs)
+        {
+            int expected = Job::pending;
+
+            if (job.state.compare_exchange_strong(expected, Job::claimed))
+            {
+                renderJob(job);
+                job.state = Job::done;
+                ++slicesOnWorkers;
+                renderedAny = true;
+            }
+        }
+    }
+
+    return renderedAny;
+}
+
+GranularEngine::Job* GranularEngine::publishSlice(Slice& slice, int numSamples, int numOutputs, int chunkQuality)
+{
+    // A job still with a worker from an earlier chunk stays out of the way;
+    // with both of them busy the slice is rendered by the audio thread
+    for (auto& job : slice.jobs)
+    {
+        const int state = job.state.load();
+        if (state != Job::idle && state != Job::done)
+            continue;
+
+        job.numGrains = 0;
+        for (int i = slice.firstGrain; i < slice.firstGrain + slice.numGrains; ++i)
+            if (grains[(size_t)i].active)
+                job.grains[(size_t)job.numGrains++] = grains[(size_t)i];
+
+        job.numSamples = numSamples;
+        job.numOutputs = numOutputs;
+        job.quality = chunkQuality;
+
+        // The release makes the copies above visible to whoever claims the job
+        job.state = Job::pending;
+        return &job;
+    }
+
+    return nullptr;
+}
+
+void GranularEngine::renderJob(Job& job) const
+{
+    renderGrains(job.grains.data(), job.numGrains, job.numSamples, job.numOutputs, job.quality, job.scratch);
+}
+
+void GranularEngine::advanceSlice(Slice& slice, int numSamples)
+{
+    for (int i = slice.firstGrain; i < slice.firstGrain + slice.numGrains; ++i)
+    {
+        auto& grain = grains[(size_t)i];
+        if (!grain.active)
+            continue;
+
+        const int num = juce::jmin(numSamples - grain.startOffset, grain.length - grain.age);
+
+        if (num > 0)
+        {
+            grain.readPosition += num * grain.increment;
+            grain.age += num;
+        }
+
+        grain.startOffset = 0;
+
+        if (grain.age >= grain.length)
+        {
+            grain.active = false;
+            slice.freeList[(size_t)slice.numFree++] = i;
+            --numActiveGrains;
+        }
+    }
+}
+
+//==============================================================================
+bool GranularEngine::process(const juce::AudioSourceChannelInfo& info)
+{
+    info.clearActiveBufferRegion();
+
+    // States are odd, so 0 means no reseed is pending
+    if (const auto newState = pendingRngState.exchange(0))
+        rngState = newState;
+
+    if (source == nullptr || source->getNumSamples() < 2 || scratchSize == 0 || regionEnd <= regionStart)
+        return false;
+
+    // Hosts may send blocks larger than announced, so work in scratch-sized chunks
+    for (int done = 0; done < info.numSamples; )
+    {
+        const int num = juce::jmin(scratchSize, info.numSamples - done);
+        processChunk(*info.buffer, info.startSample + done, num);
+        done += num;
+    }
+
+    return scanPosition.load() >= (double)regionEnd;
+}
+
+void GranularEngine::processChunk(juce::AudioBuffer<float>& out, int startSample, int numSamples)
+{
+    const auto chunkStart = juce::Time::getHighResolutionTicks();
+
+    const double overlap = 1.0 + density * (maxOverlap - 1.0f);
+    const double grainLength = juce::jmax(1.0, grainSizeSec * deviceRate);
+    const double spawnInterval = grainLength / overlap;
+
+    // Spawn every grain that falls due inside this chunk at its exact offset
+    while (samplesUntilNextGrain < (double)numSamples)
+    {
+        spawnGrain((int)samplesUntilNextGrain);
+        samplesUntilNextGrain += spawnInterval;
+    }
+
+    samplesUntilNextGrain -= (double)numSamples;
+
+    const int numOutputs = juce::jmin(2, out.getNumChannels());
+    const int chunkQuality = quality.load();
+
+    if (workersEnabled.load() && numSlices > 1 && numActiveGrains >= minGrainsForWorkers)
+    {
+        for (int s = 0; s < numSlices; ++s)
+            slices[(size_t)s].current = publishSlice(slices[(size_t)s], numSamples, numOutputs, chunkQuality);
+
+        pool->publish();
+
+        // Render whatever the workers haven't claimed yet
+        for (int s = 0; s < numSlices; ++s)
+        {
+            auto* job = slices[(size_t)s].current;
+            int expected = Job::pending;
+
+            if (job != nullptr && job->state.compare_exchange_strong(expected, Job::claimed))
+            {
+                renderJob(*job);
+                job->state = Job::done;
+                ++slicesInline;
+            }
+        }
+
+        ++parallelChunks;
+    }
+
+    // Sum the slices in a fixed order. A job its worker hasn't finished by the deadline
+    // is abandoned and the slice rendered here from the same grains, so the sum is
+    // the same whoever rendered what, and the wait is bounded
+    const auto deadline = chunkStart
+        + juce::Time::secondsToHighResolutionTicks(workerDeadline * numSamples / deviceRate);
+
+    for (int s = 0; s < numSlices; ++s)
+    {
+        auto& slice = slices[(size_t)s];
+        const RenderScratch* result = nullptr;
+
+        if (auto* job = slice.current)
+        {
+            while (job->state.load() != Job::done && juce::Time::getHighResolutionTicks() < deadline)
+            {
+            }
+
+            if (job->state.load() == Job::done)
+                result = &job->scratch;
+            else
+                ++slicesLate;
+        }
+
+        if (result == nullptr)
+        {
+            renderGrains(grains.data() + slice.firstGrain, slice.numGrains, numSamples, numOutputs, chunkQuality, inlineScratch);
+            result = &inlineScratch;
+        }
+
+        for (int ch = 0; ch < numOutputs; ++ch)
+            out.addFrom(ch, startSample, result->mix, ch, 0, numSamples);
+
+        slice.current = nullptr;
+        advanceSlice(slice, numSamples);
+    }
+
+    const double baseIncrement = source->getSampleRate() / deviceRate * playbackRatio;
+    scanPosition = scanPosition.load() + numSamples * baseIncrement;    const double baseIncrement = source->getSampleRate() / deviceRate * playbackRatio;
+    scanPosition = scanPosition.load() + numSamples * baseIncrement;
+}
+
+void GranularEngine::spawnGrain(int offsetInChunk)
+{
+    // Spread new grains round-robin over the slices to balance the workers.
+    // When every voice is busy the new grain is dropped rather than allocated.
+    Slice* slice = nullptr;
+    for (int i = 0; i < numSlices && slice == nullptr; ++i)
+    {
+        auto& candidate = slices[(size_t)((nextSpawnSlice + i) % numSlices)];
+        if (candidate.numFree > 0)
+            slice = &candidate;
+    }
+
+    nextSpawnSlice = (nextSpawnSlice + 1) % numSlices;
+
+    if (slice == nullptr)
+        return;
+
+    const double baseIncrement = source->getSampleRate() / deviceRate * playbackRatio;
+    const double detune = pitchSpreadSemitones * (RegionScheduler::nextRandom(rngState) * 2.0 - 1.0);
+    const double increment = baseIncrement * std::pow(2.0, detune / 12.0);
+
+    // Grains must fit inside the file, leaving one sample for interpolation
+    const double lastReadable = (double)(source->getNumSamples() - 2);
+    const int length = juce::jmin(juce::roundToInt(grainSizeSec * deviceRate), (int)(lastReadable / increment));
+    if (length < 16)
+        return;
+
+    // Start around the scan position, jittered by up to half a grain either side
+    const double centre = scanPosition.load() + offsetInChunk * baseIncrement;
+    const double jitter = (RegionScheduler::nextRandom(rngState) - 0.5) * length * baseIncrement;
+    const double start = juce::jlimit(0.0, lastReadable - length * increment, centre + jitter);
+
+    // Equal-power pan, scaled down as more grains overlap
+    const double overlap = 1.0 + density * (maxOverlap - 1.0f);
+    const float level = (float)juce::jmin(1.0, std::sqrt(4.0 / overlap));
+    const float pan = 0.5f + panSpread * ((float)RegionScheduler::nextRandom(rngState) - 0.5f);
+
+    auto& grain = grains[(size_t)slice->freeList[(size_t)--slice->numFree]];
+    grain.active = true;
+    grain.readPosition = start;
+    grain.increment = increment;
+    grain.cutoff = SincKernelBank::getCutoffIndex(increment);
+    grain.length = length;
+    grain.age = 0;
+    grain.startOffset = offsetInChunk;
+    grain.window = windowShape.load();
+    grain.gains[0] = level * std::cos(pan * juce::MathConstants<float>::halfPi);
+    grain.gains[1] = level * std::sin(pan * juce::MathConstants<float>::halfPi);
+
+    ++numActiveGrains;
+}
+
+void GranularEngine::renderGrains(const Grain* grainList, int count, int numSamples, int numOutputs,
+    int chunkQuality, RenderScratch& scratch) const
+{
+    for (int ch = 0; ch < numOutputs; ++ch)
+        scratch.mix.clear(ch, 0, numSamples);
+
+    for (int i = 0; i < count; ++i)
+        if (grainList[i].active)
+            renderGrain(grainList[i], numSamples, numOutputs, chunkQuality, scratch);
+}
+
+void GranularEngine::renderGrain(const Grain& grain, int numSamples, int numOutputs, int chunkQuality,
+    RenderScratch& scratch) const
+{
+    const int begin = grain.startOffset;
+    const int num = juce::jmin(numSamples - begin, grain.length - grain.age);
+
+    if (num > 0)
+    {
+        // Envelope for this part of the grain, shared by both channels
+        const float* table = windowTables[(size_t)grain.window].data();
+        const double tableStep = (double)(windowTableSize - 1) / (double)grain.length;
+        float* window = scratch.windowScratch.data();
+
+        for (int i = 0; i < num; ++i)
+            window[i] = table[(int)((grain.age + i) * tableStep)];
+
+        const int numChannels = juce::jmin(numOutputs, 2);
+
+        float* channels[2];
+        for (int ch = 0; ch < numChannels; ++ch)
+            channels[ch] = scratch.grainScratch.getWritePointer(ch);
+
+        // One set of taps per output sample, shared by both channels
+        const auto& kernel = kernels->getKernel((SincKernelBank::Quality)chunkQuality, grain.cutoff);
+        double pos = grain.readPosition;
+
+        // Float sources are read in place in one go; compact ones a window at a time
+        for (int done = 0; done < num; )
+        {
+            const auto first = (long long)pos;
+            const int n = scratch.sourceWindow.load(*source, numChannels, first, pos - (double)first,
+                grain.increment, num - done, kernel.numTaps);
+            const float* data[2] = { scratch.sourceWindow.getData(0), scratch.sourceWindow.getData(1) };
+            const long long windowStart = scratch.sourceWindow.getStart();
+            const long long windowLength = scratch.sourceWindow.getLength();
+
+            for (int i = done; i < done + n; ++i)
+            {
+                const auto idx = (long long)pos;
+                const float* taps = kernel.getTaps((float)(pos - (double)idx), scratch.tapScratch.data());
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    channels[ch][i] = SincKernelBank::read(kernel, taps, data[ch], windowLength, idx - windowStart);
+
+                pos += grain.increment;
+            }
+
+            done += n;
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const float gain = numOutputs == 1 ? 0.5f * (grain.gains[0] + grain.gains[1]) : grain.gains[ch];
+
+            juce::FloatVectorOperations::multiply(channels[ch], window, num);
+            juce::FloatVectorOperations::addWithMultiply(scratch.mix.getWritePointer(ch, begin), channels[ch], gain, num);
+        }
+    }
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "RegionScheduler.h"
+#include "SampleStore.h"
+#include "SincResampler.h"
+
+/**
+ * GranularEngine
+ *
+ * A polyphonic grain cloud that reads straight from a RAM-resident SampleStore:
+ *  - A fixed pool of grains, allocated in prepare() (nothing is allocated while rendering),
+ *  - Grains overlap: GRAIN_SIZE sets their length, GRAIN_DENSITY how many play at once,
+ *  - Each grain has its own pitch and pan, and is shaped by a precomputed
+ *    Hann, Tukey or Gaussian window table,
+ *  - Grains are read with the shared polyphase sinc kernels (band-limited for
+ *    grains pitched up), rendered into scratch buffers and mixed with vectorised multiply-adds.
+ *
+ * New grains are spawned around a scan position that moves through the current
+ * region at the playback ratio, exactly like the transport used to.
+ *
+ * Dense clouds are split into slices of the grain pool that helper threads render
+ * in parallel within each block. Each chunk, a slice's active grains are copied into
+ * a job that a worker renders into its own buffer, and the slices are summed in a
+ * fixed order. Jobs no worker has picked up are rendered by the audio thread, and
+ * so is any a worker hasn't finished shortly after the chunk began: the worker's
+ * result is then abandoned. Every slice is rendered from the same grains with the
+ * same arithmetic either way, so the output does not depend on which thread
+ * rendered what, and a descheduled worker never holds up the block.
+ *
+ * The helper threads are shared by every engine in the process, only started once
+ * an engine enables them, and find new jobs by polling an atomic epoch, so the
+ * audio thread never signals them or takes a lock.
+ */
+class GranularEngine
+{
+public:
+    enum class WindowShape { hann = 0, tukey, gaussian };
+
+    static constexpr int maxGrains = 4096;
+    static constexpr int maxSlices = 8;
+    static constexpr int windowTableSize = 2048;
+
+    /** Below this many active grains the whole cloud is rendered inline. */
+    static constexpr int minGrainsForWorkers = 64;
+
+    /**
+     * How long into a chunk (as a share of its duration) the audio thread waits for
+     * workers before rendering their slices itself.
+     */
+    static constexpr double workerDeadline = 0.1;
+
+    /** Counters for profiling how the rendering was shared out. */
+    struct RenderStats
+    {
+        juce::uint64 parallelChunks = 0;    ///< Chunks whose slices were offered to workers
+        juce::uint64 slicesOnWorkers = 0;
+        juce::uint64 slicesInline = 0;      ///< Offered slices the audio thread rendered itself
+        juce::uint64 slicesLate = 0;        ///< Slices re-rendered inline because their worker missed the deadline
+    };
+
+    GranularEngine();
+    ~GranularEngine();
+
+    /**
+     * Allocates the grain pool and scratch buffers.
+     * Call before process(), never while it is running.
+     */
+    void prepare(double deviceSampleRate, int maxBlockSize);
+
+    /** Silences all grains, once no worker is rendering any of them. Not for the audio thread. */
+    void reset();
+
+    /**
+     * Sets the samples grains read from. The caller must make sure process()
+     * is not running at the same time (AudioFilePlayer holds its audio lock).
+     */
+    void setSource(const SampleStore* newSource);
+
+    /** Sets the region (in source samples) and moves the scan position to its start. */
+    void setRegion(long long startSample, long long endSample);
+
+    /**
+     * Restarts the grains' randomness (detune, position jitter, pan) from `seed`
+     * at the next block; 0 picks a new random seed. Not for the audio thread.
+     */
+    void setSeed(juce::uint64 seed);
+
+    /**
+     * Message thread: lets the shared helper threads render this engine's slices
+     * (starting them if this is the first engine to use them), or stops it.
+     */
+    void setWorkersEnabled(bool shouldUseWorkers);
+
+    /**
+     * Number of helper threads grain rendering is spread over (0 renders
+     * everything on the audio thread), at most the size of the shared pool.
+     * Takes effect at the next prepare().
+     */
+    void setNumWorkerThreads(int numThreads) { requestedWorkers = juce::jlimit(0, maxSlices - 1, numThreads); }
+    int  getNumWorkerThreads() const { return workersEnabled.load() ? numSlices - 1 : 0; }
+
+    RenderStats getRenderStats() const;
+
+    //==============================================================================
+    // Parameters
+    //==============================================================================
+    void setGrainSize(float seconds)        { grainSizeSec = juce::jlimit(0.005f, 2.0f, seconds); }
+    void setDensity(float newDensity)       { density = juce::jlimit(0.0f, 1.0f, newDensity); }
+    void setPlaybackRatio(double ratio)     { playbackRatio = juce::jmax(0.01, ratio); }
+    void setPitchSpread(float semitones)    { pitchSpreadSemitones = juce::jmax(0.0f, semitones); }
+    void setPanSpread(float spread)         { panSpread = juce::jlimit(0.0f, 1.0f, spread); }
+    void setWindowShape(WindowShape shape)  { windowShape = (int)shape; }
+    void setQuality(SincKernelBank::Quality q) { quality = (int)q; }
+
+    /** How many grains overlap at full density (16 by default, up to the pool size). */
+    void setMaxOverlap(float grains)        { maxOverlap = juce::jlimit(1.0f, (float)maxGrains, grains); }
+
+    //==============================================================================
+    /**
+     * Replaces the contents of info with the grain cloud.
+     * Returns true once the scan position has passed the end of the region.
+     */
+    bool process(const juce::AudioSourceChannelInfo& info);
+
+    /** Current scan position in source samples (safe to read from any thread). */
+    double getScanPosition() const { return scanPosition.load(); }
+
+    int getNumActiveGrains() const { return numActiveGrains; }
+
+private:
+    class Worker;
+    class WorkerPool;
+
+    struct Grain
+    {
+        bool   active = false;
+        double readPosition = 0.0;   ///< In source samples
+        double increment = 1.0;      ///< Source samples per output sample (pitch)
+        int    cutoff = 0;           ///< SincKernelBank cutoff index for the increment
+        int    length = 0;           ///< In output samples
+        int    age = 0;              ///< Output samples already rendered
+        int    startOffset = 0;      ///< Where in the current chunk the grain begins
+        int    window = 0;           ///< Window table, fixed for the grain's lifetime
+        float  gains[2] = { 0.0f, 0.0f };
+    };
+
+    /** Buffers for rendering one slice: one set per job, and one for the audio thread. */
+    struct RenderScratch
+    {
+        juce::AudioBuffer<float> mix;
+        juce::AudioBuffer<float> grainScratch;
+        std::vector<float> tapScratch;
+        std::vector<float> windowScratch;
+        SampleWindow       sourceWindow;     ///< Expanded span of a compact source
+
+        void prepare(int numSamples, int maxTaps);
+    };
+
+    /** One chunk of a slice's work, with its own copy of the grains so it can be abandoned. */
+    struct Job
+    {
+        enum State { idle = 0, pending, claimed, done };
+
+        std::vector<Grain> grains;       ///< The slice's active grains at the start of the chunk
+        int numGrains = 0;
+        int numSamples = 0;
+        int numOutputs = 0;
+        int quality = 0;
+
+        RenderScratch scratch;
+
+        std::atomic<int> state{ idle };
+    };
+
+    /**
+     * A contiguous part of the grain pool. Its grains are only changed by the audio
+     * thread; workers render copies of them. Two jobs, so one can still be with a
+     * late worker while the next chunk uses the other.
+     */
+    struct Slice
+    {
+        int firstGrain = 0;
+        int numGrains = 0;
+
+        std::vector<int> freeList;       ///< Indices of inactive grains in this slice
+        int numFree = 0;
+
+        std::array<Job, 2> jobs;
+        Job* current = nullptr;          ///< Audio thread: this chunk's job, null to render inline
+    };
+
+    /** Renders part of the block: spawns due grains, then mixes every active one. */
+    void processChunk(juce::AudioBuffer<float>& out, int startSample, int numSamples);
+
+    void spawnGrain(int offsetInChunk);
+
+    /** Audio thread: copies the slice's grains into a free job and marks it pending, or returns null. */
+    Job* publishSlice(Slice& slice, int numSamples, int numOutputs, int chunkQuality);
+
+    void renderJob(Job& job) const;
+    void renderGrains(const Grain* grainList, int count, int numSamples, int numOutputs, int chunkQuality,
+        RenderScratch& scratch) const;
+    void renderGrain(const Grain& grain, int numSamples, int numOutputs, int chunkQuality, RenderScratch& scratch) const;
+
+    /** Audio thread: moves the slice's grains on by a chunk and frees those that ended. */
+    void advanceSlice(Slice& slice, int numSamples);
+
+    /** Called by workers: claims and renders any pending jobs. Returns true if it rendered one. */
+    bool renderPendingJobs();
+
+    /** Waits until no worker is rendering one of the jobs. Not for the audio thread. */
+    void waitForWorkers();
+
+    static void fillWindowTable(std::vector<float>& table, WindowShape shape);
+
+    //==============================================================================
+    const SampleStore* source = nullptr;
+
+    std::array<Grain, maxGrains> grains;
+    int numActiveGrains = 0;
+
+    std::array<Slice, maxSlices> slices;
+    int numSlices = 1;
+    int nextSpawnSlice = 0;
+    RenderScratch inlineScratch;
+
+    std::shared_ptr<WorkerPool> pool;
+    std::atomic<bool> workersEnabled{ false };
+    int requestedWorkers = 0;
+
+    std::atomic<juce::uint64> parallelChunks{ 0 };
+    std::atomic<juce::uint64> slicesOnWorkers{ 0 };
+    std::atomic<juce::uint64> slicesInline{ 0 };
+    std::atomic<juce::uint64> slicesLate{ 0 };
+
+    std::array<std::vector<float>, 3> windowTables;
+
+    double deviceRate = 44100.0;
+    int    scratchSize = 0;
+
+    long long regionStart = 0;
+    long long regionEnd = 0;
+    std::atomic<double> scanPosition{ 0.0 };
+    double samplesUntilNextGrain = 0.0;
+
+    // Parameters
+    float  grainSizeSec = 0.1f;
+    float  density = 0.5f;
+    float  maxOverlap = 16.0f;
+    double playbackRatio = 1.0;
+    float  pitchSpreadSemitones = 0.0f;
+    float  panSpread = 0.5f;
+    std::atomic<int> windowShape{ (int)WindowShape::hann };
+    std::atomic<int> quality{ (int)SincKernelBank::Quality::normal };
+
+    juce::SharedResourcePointer<SincKernelBank> kernels;
+
+    // Grain randomness, reseeded by the audio thread when a new state is pending
+    juce::uint64              rngState = 1;
+    std::atomic<juce::uint64> pendingRngState{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GranularEngine)
+};
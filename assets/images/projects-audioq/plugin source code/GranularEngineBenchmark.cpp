@@ -0,0 +1,101 @@
+#include "GranularEngine.h"
+
+/**
+ * GranularEngineBenchmark.cpp
+ *
+ * How many grains one core keeps up with in real time at common block sizes,
+ * on the audio thread alone and with the shared workers. Built with
+ * JUCE_UNIT_TESTS; run with juce::UnitTestRunner().runTestsInCategory("Benchmarks").
+ */
+
+#if JUCE_UNIT_TESTS
+
+class GranularEngineBenchmark : public juce::UnitTest
+{
+public:
+    GranularEngineBenchmark() : juce::UnitTest("GranularEngine grains per core", "Benchmarks") {}
+
+    void runTest() override
+    {
+        // Ten seconds of stereo noise to read the grains from
+        SampleStore store(2, (int)(10.0 * sampleRate), sampleRate);
+        juce::Random random(1);
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < store.getNumSamples(); ++i)
+                store.getBuffer().setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+        for (const int blockSize : { 64, 128, 256, 512, 1024 })
+        {
+            beginTest("Block size " + juce::String(blockSize));
+            measure(store, blockSize, false);
+            measure(store, blockSize, true);
+        }
+    }
+
+private:
+    static constexpr double sampleRate = 48000.0;
+    static constexpr double secondsMeasured = 2.0;
+
+    void measure(const SampleStore& store, int blockSize, bool withWorkers)
+    {
+        GranularEngine engine;
+        engine.setWorkersEnabled(withWorkers);
+        engine.prepare(sampleRate, blockSize);
+        engine.setSource(&store);
+        engine.setRegion(0, store.getNumSamples());
+        engine.setSeed(1);
+
+        // 100 ms grains, 256 of them overlapping, a semitone of detune
+        engine.setGrainSize(0.1f);
+        engine.setMaxOverlap(256.0f);
+        engine.setDensity(1.0f);
+        engine.setPitchSpread(1.0f);
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        const juce::AudioSourceChannelInfo info(&buffer, 0, blockSize);
+
+        // Fill the cloud before timing
+        for (int i = 0; i < (int)(0.2 * sampleRate / blockSize) + 1; ++i)
+            render(engine, store, info);
+
+        const int numBlocks = (int)(secondsMeasured * sampleRate / blockSize);
+        double grainBlocks = 0.0;
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            render(engine, store, info);
+            grainBlocks += engine.getNumActiveGrains();
+        }
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        const double audioSeconds = numBlocks * blockSize / sampleRate;
+        const double averageGrains = grainBlocks / numBlocks;
+        const int cores = withWorkers ? engine.getNumWorkerThreads() + 1 : 1;
+        const double grainsPerCore = averageGrains * audioSeconds / seconds / cores;
+
+        expect(seconds > 0.0 && averageGrains > 0.0);
+
+        const auto stats = engine.getRenderStats();
+
+        logMessage("  " + juce::String(withWorkers ? "with " + juce::String(cores - 1) + " workers" : "audio thread only")
+            + ": " + juce::String(averageGrains, 0) + " grains, " + juce::String(audioSeconds / seconds, 1)
+            + "x real time, " + juce::String(grainsPerCore, 0) + " grains per core"
+            + (withWorkers ? " (" + juce::String((juce::int64)stats.slicesOnWorkers) + " slices on workers, "
+                + juce::String((juce::int64)stats.slicesInline) + " inline, "
+                + juce::String((juce::int64)stats.slicesLate) + " late)" : juce::String()));
+    }
+
+    static void render(GranularEngine& engine, const SampleStore& store, const juce::AudioSourceChannelInfo& info)
+    {
+        // Scan the whole file over and over
+        if (engine.process(info))
+            engine.setRegion(0, store.getNumSamples());
+    }
+};
+
+static GranularEngineBenchmark granularEngineBenchmark;
+
+#endif
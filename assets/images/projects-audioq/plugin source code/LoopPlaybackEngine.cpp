@@ -0,0 +1,244 @@
+#include "LoopPlaybackEngine.h"
+
+/**
+ * LoopPlaybackEngine.cpp
+ *
+ * Cursor arithmetic, interpolation and dual-voice crossfades for
+ * sample-accurate RAM playback.
+ */
+
+//==============================================================================
+void LoopPlaybackEngine::prepare(double deviceSampleRate, int maxBlockSize)
+{
+    deviceRate = deviceSampleRate > 0.0 ? deviceSampleRate : 44100.0;
+    updateIncrement();
+
+    const int size = juce::jmax(1, maxBlockSize);
+    tailScratch.setSize(2, size);
+    fadeInScratch.assign((size_t)size, 0.0f);
+    fadeOutScratch.assign((size_t)size, 0.0f);
+    tapScratch.assign((size_t)kernels->getMaxTaps(), 0.0f);
+
+    // Room for a couple of blocks at normal speed; faster voices take more windows
+    window.prepare(2 * juce::jmax(size, 1024) + 2 * kernels->getMaxTaps() + 2);
+    endTail();
+}
+
+void LoopPlaybackEngine::setSource(const SampleStore* newSource)
+{
+    source = newSource;
+    voice.store = newSource;
+    pendingPosition = -1;
+    setPosition(0);
+    updateIncrement();
+}
+
+void LoopPlaybackEngine::setPlaybackRatio(double ratio)
+{
+    playbackRatio = juce::jmax(0.01, ratio);
+    updateIncrement();
+}
+
+void LoopPlaybackEngine::updateIncrement()
+{
+    // Only the main voice follows: a fading tail keeps the speed it had
+    const double fileRate = source != nullptr ? source->getSampleRate() : deviceRate;
+    voice.increment = fileRate / deviceRate * playbackRatio;
+    voice.cutoffIndex = SincKernelBank::getCutoffIndex(voice.increment);
+}
+
+void LoopPlaybackEngine::setPosition(long long sample)
+{
+    voice.position = juce::jmax(0LL, sample);
+    voice.fraction = 0.0;
+    endTail();
+    publishedPosition = (double)voice.position;
+}
+
+void LoopPlaybackEngine::beginCrossfade(long long segmentLength)
+{
+    const int tableLength = fades != nullptr ? fades->getLength() : 0;
+
+    // Never fade for longer than the segment that is starting
+    const int length = (int)juce::jmin((double)tableLength, (double)segmentLength / voice.increment);
+
+    if (length <= 0 || tailScratch.getNumSamples() == 0)
+    {
+        endTail();
+        return;
+    }
+
+    tail = voice;
+    tailLength = length;
+    tailAge = 0;
+    tailRemaining = length;
+    fadingSource = tail.store;
+}
+
+void LoopPlaybackEngine::wrapTo(long long newStart, long long boundary, long long segmentLength)
+{
+    // A normal crossing overshoots by less than one step; anything else was a jump
+    double overshoot = (double)(voice.position - boundary) + voice.fraction;
+    if (overshoot < 0.0 || overshoot >= voice.increment)
+        overshoot = 0.0;
+
+    beginCrossfade(segmentLength);
+
+    const auto whole = (long long)overshoot;
+    voice.position = juce::jmax(0LL, newStart) + whole;
+    voice.fraction = overshoot - (double)whole;
+    publishedPosition = (double)voice.position + voice.fraction;
+}
+
+void LoopPlaybackEngine::jumpTo(long long newStart, long long segmentLength)
+{
+    beginCrossfade(segmentLength);
+
+    voice.position = juce::jmax(0LL, newStart);
+    voice.fraction = 0.0;
+    publishedPosition = (double)voice.position;
+}
+
+void LoopPlaybackEngine::switchSource(const SampleStore* newSource, long long newStart, long long segmentLength)
+{
+    beginCrossfade(segmentLength);
+
+    source = newSource;
+    voice.store = newSource;
+    voice.position = juce::jmax(0LL, newStart);
+    voice.fraction = 0.0;
+    updateIncrement();
+    publishedPosition = (double)voice.position;
+}
+
+long long LoopPlaybackEngine::getCrossfadeLengthInSource() const
+{
+    const int tableLength = fades != nullptr ? fades->getLength() : 0;
+    return (long long)std::ceil((double)tableLength * voice.increment);
+}
+
+//==============================================================================
+int LoopPlaybackEngine::render(juce::AudioBuffer<float>& out, int startSample, int numSamples, long long endSample)
+{
+    const auto requested = pendingPosition.exchange(-1);
+    if (requested >= 0)
+        setPosition(requested);
+
+    if (source == nullptr || numSamples <= 0)
+        return 0;
+
+    endSample = juce::jmin(endSample, (long long)source->getNumSamples());
+
+    // Output samples until the cursor reaches the boundary
+    const double remaining = (double)(endSample - voice.position) - voice.fraction;
+    if (remaining <= 0.0)
+        return 0;
+
+    const int num = (int)juce::jmin((double)numSamples, std::ceil(remaining / voice.increment));
+
+    renderVoice(voice, out, startSample, out.getNumChannels(), num);
+
+    if (tailRemaining > 0)
+        mixTail(out, startSample, num);
+
+    publishedPosition = (double)voice.position + voice.fraction;
+    return num;
+}
+
+void LoopPlaybackEngine::renderVoice(Voice& v, juce::AudioBuffer<float>& dest, int destStart, int numChannels, int num)
+{
+    const int numSrc = v.store->getNumChannels();
+    const long long total = v.store->getNumSamples();
+    numChannels = juce::jmin(numChannels, 2);
+
+    float* out[2];
+    for (int ch = 0; ch < numChannels; ++ch)
+        out[ch] = dest.getWritePointer(ch, destStart);
+
+    // Same rate, same speed, on a sample: nothing to interpolate.
+    // Mono files play on every output channel.
+    if (v.increment == 1.0 && v.fraction == 0.0)
+    {
+        const int numAvailable = (int)juce::jlimit(0LL, (long long)num, total - v.position);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            if (numAvailable > 0)
+                v.store->read(juce::jmin(ch, numSrc - 1), v.position, numAvailable, out[ch]);
+
+            juce::FloatVectorOperations::clear(out[ch] + numAvailable, num - numAvailable);
+        }
+
+        v.position += num;
+        return;
+    }
+
+    // The taps depend only on the fraction, so they are shared by both channels
+    const auto& kernel = kernels->getKernel((SincKernelBank::Quality)quality.load(), v.cutoffIndex);
+
+    // Float stores are read in place in one go; compact ones a window at a time
+    for (int done = 0; done < num; )
+    {
+        const int n = window.load(*v.store, numChannels, v.position, v.fraction, v.increment, num - done, kernel.numTaps);
+        const float* data[2] = { window.getData(0), window.getData(1) };
+        const long long windowStart = window.getStart();
+        const long long windowLength = window.getLength();
+
+        for (int i = done; i < done + n; ++i)
+        {
+            if (v.position < total)
+            {
+                const float* taps = kernel.getTaps((float)v.fraction, tapScratch.data());
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    out[ch][i] = SincKernelBank::read(kernel, taps, data[ch], windowLength, v.position - windowStart);
+            }
+            else
+            {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    out[ch][i] = 0.0f;
+            }
+
+            v.fraction += v.increment;
+            const auto whole = (long long)v.fraction;
+            v.position += whole;
+            v.fraction -= (double)whole;
+        }
+
+        done += n;
+    }
+}
+
+void LoopPlaybackEngine::mixTail(juce::AudioBuffer<float>& out, int startSample, int num)
+{
+    const int numChannels = juce::jmin(out.getNumChannels(), tailScratch.getNumChannels());
+    const int numToMix = juce::jmin(num, tailRemaining);
+
+    for (int done = 0; done < numToMix; )
+    {
+        const int chunk = juce::jmin(numToMix - done, tailScratch.getNumSamples());
+
+        renderVoice(tail, tailScratch, 0, numChannels, chunk);
+
+        const float* gainIn = fades->getGains(true, tailAge, chunk, tailLength, fadeInScratch.data());
+        const float* gainOut = fades->getGains(false, tailAge, chunk, tailLength, fadeOutScratch.data());
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            float* dest = out.getWritePointer(ch, startSample + done);
+            float* tailData = tailScratch.getWritePointer(ch);
+
+            // incoming * fadeIn + outgoing * fadeOut
+            juce::FloatVectorOperations::multiply(dest, gainIn, chunk);
+            juce::FloatVectorOperations::multiply(tailData, gainOut, chunk);
+            juce::FloatVectorOperations::add(dest, tailData, chunk);
+        }
+
+        tailAge += chunk;
+        tailRemaining -= chunk;
+        done += chunk;
+    }
+
+    if (tailRemaining <= 0)
+        endTail();
+}
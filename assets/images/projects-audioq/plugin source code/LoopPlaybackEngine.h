@@ -0,0 +1,156 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+#include "SampleStore.h"
+#include "CrossfadeTables.h"
+#include "SincResampler.h"
+
+/**
+ * LoopPlaybackEngine
+ *
+ * Plays a RAM-resident SampleStore with a sample-accurate cursor: an integer
+ * sample index plus a fractional part, advanced by (file rate / device rate) *
+ * playback ratio per output sample and read with a polyphase windowed-sinc kernel
+ * (SincKernelBank), band-limited when reading faster than the source rate. At
+ * exactly the source rate and speed the samples are copied straight through.
+ *
+ * render() stops exactly where the cursor reaches a boundary (a loop or region
+ * end), so the owner can wrap as many times per block as it needs. Wrapping
+ * only moves the cursor: there is no seek, no lock and the fractional overshoot
+ * is kept, so loop lengths stay exact at any tempo.
+ *
+ * Wraps and jumps are true crossfades: the outgoing voice keeps playing past the
+ * boundary and fades out while the incoming one fades in, both at once, using
+ * the owner's CrossfadeTables. The outgoing voice keeps its own source, so the
+ * engine can also crossfade from one file into the next.
+ */
+class LoopPlaybackEngine
+{
+public:
+    LoopPlaybackEngine() = default;
+
+    /** Allocates the crossfade scratch buffers. */
+    void prepare(double deviceSampleRate, int maxBlockSize);
+
+    /**
+     * Sets the samples to play and rewinds to the start. The caller must make
+     * sure render() is not running at the same time (AudioFilePlayer holds its audio lock).
+     */
+    void setSource(const SampleStore* newSource);
+
+    /**
+     * Fade curves for wraps and jumps (nullptr or empty tables: hard cuts).
+     * Same threading rule as setSource().
+     */
+    void setCrossfade(const CrossfadeTables* tables) { fades = tables; endTail(); }
+
+    void setPlaybackRatio(double ratio);
+
+    /** Interpolation quality tier (any thread; applies at the next render). */
+    void setQuality(SincKernelBank::Quality newQuality) { quality = (int)newQuality; }
+
+    /**
+     * Renders up to numSamples into out, stopping early when the cursor reaches
+     * endSample. Returns the number of samples written.
+     */
+    int render(juce::AudioBuffer<float>& out, int startSample, int numSamples, long long endSample);
+
+    /** True once the cursor is at or past endSample. */
+    bool hasReached(long long endSample) const { return (double)(voice.position - endSample) + voice.fraction >= 0.0; }
+
+    /**
+     * Moves the cursor from a boundary it just crossed to newStart, carrying over
+     * the fractional overshoot so the loop stays sample-accurate, and crossfades.
+     * segmentLength (source samples from newStart to the next boundary) keeps the
+     * fade shorter than very short loops.
+     */
+    void wrapTo(long long newStart, long long boundary, long long segmentLength);
+
+    /** Audio thread: crossfades to a new position (e.g. the start of a new random region). */
+    void jumpTo(long long newStart, long long segmentLength);
+
+    /**
+     * Audio thread: carries on in another source from newStart, crossfading from
+     * the current one, which keeps playing its own samples while it fades out
+     * (segmentLength 0: a hard, sample-exact cut). The old source must stay alive
+     * until the fade is over, i.e. for getCrossfadeLengthInSource() of its samples.
+     */
+    void switchSource(const SampleStore* newSource, long long newStart, long long segmentLength);
+
+    /**
+     * Any thread: the source the fading-out voice is still reading, or nullptr once
+     * no fade is running. A source left by switchSource() may be released when this
+     * no longer returns it.
+     */
+    const SampleStore* getFadingSource() const { return fadingSource.load(); }
+
+    /** Source samples the current voice moves through during one crossfade (0 without fades). */
+    long long getCrossfadeLengthInSource() const;
+
+    /** Audio thread: jumps straight to a sample, without a crossfade. */
+    void setPosition(long long sample);
+
+    /** Any thread: asks for a jump, applied at the start of the next render(). */
+    void requestPosition(long long sample) { pendingPosition = juce::jmax(0LL, sample); }
+
+    /** Current position in source samples (safe to read from any thread). */
+    double getPosition() const { return publishedPosition.load(); }
+
+private:
+    struct Voice
+    {
+        const SampleStore* store = nullptr;
+        long long position = 0;   ///< Integer part of the cursor
+        double    fraction = 0.0; ///< Fractional part, in [0, 1)
+        double    increment = 1.0;  ///< Source samples per output sample
+        int       cutoffIndex = 0;  ///< Kernel for that increment
+    };
+
+    /**
+     * Renders a voice into numChannels (up to 2) channels of dest and advances it;
+     * silent past the end of the file.
+     */
+    void renderVoice(Voice& v, juce::AudioBuffer<float>& dest, int destStart, int numChannels, int num);
+
+    /** Mixes the fading-out tail voice over the start of what the main voice just rendered. */
+    void mixTail(juce::AudioBuffer<float>& out, int startSample, int num);
+
+    /** Starts a crossfade from the current voice, which is then moved by the caller. */
+    void beginCrossfade(long long segmentLength);
+
+    /** Stops the fading-out voice. */
+    void endTail() { tailRemaining = 0; fadingSource = nullptr; }
+
+    void updateIncrement();
+
+    //==============================================================================
+    const SampleStore*     source = nullptr;
+    const CrossfadeTables* fades = nullptr;
+
+    Voice voice;
+
+    // The outgoing voice during a crossfade
+    Voice tail;
+    int   tailLength = 0;
+    int   tailAge = 0;
+    int   tailRemaining = 0;
+    std::atomic<const SampleStore*> fadingSource{ nullptr };   ///< tail.store while tailRemaining > 0
+
+    juce::AudioBuffer<float> tailScratch;
+    std::vector<float>       fadeInScratch, fadeOutScratch;
+
+    double deviceRate = 44100.0;
+    double playbackRatio = 1.0;
+
+    juce::SharedResourcePointer<SincKernelBank> kernels;
+    std::atomic<int>   quality{ (int)SincKernelBank::Quality::normal };
+    std::vector<float> tapScratch;
+    SampleWindow       window;           ///< Expanded span of a compact store being read
+
+    std::atomic<long long> pendingPosition{ -1 };
+    std::atomic<double>    publishedPosition{ 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopPlaybackEngine)
+};
@@ -0,0 +1,292 @@
+#include "PagedSampleStore.h"
+
+/**
+ * PagedSampleStore.cpp
+ *
+ * Page pool allocation, the audio thread's pin-and-copy reads, and the
+ * worker's request / read-ahead / LRU eviction loop.
+ */
+
+PagedSampleStore::PagedSampleStore(std::unique_ptr<juce::AudioFormatReader> fileReader, juce::TimeSliceThread& backgroundThread,
+    long long memoryBudgetBytes, UpcomingRegions upcomingProvider)
+    : reader(std::move(fileReader)),
+      thread(backgroundThread),
+      upcomingRegions(std::move(upcomingProvider))
+{
+    jassert(reader != nullptr);
+
+    numChannels = juce::jlimit(1, 2, (int)reader->numChannels);
+    numSamples = reader->lengthInSamples;
+    sampleRate = reader->sampleRate;
+
+    const int numPages = getPageCount();
+    const long long pageBytes = (long long)pageSamples * numChannels * (long long)sizeof(float);
+
+    // At least enough pages for the playhead, its read-ahead and a jump target
+    numFrames = (int)juce::jlimit(2LL * (readAheadPages + 1), juce::jmax(2LL * (readAheadPages + 1), (long long)numPages),
+        memoryBudgetBytes / pageBytes);
+
+    // One block for the whole pool, with room to align its start to 64 bytes
+    memory.allocate((size_t)(numFrames * pageBytes + 64), false);
+    auto* base = reinterpret_cast<float*>((reinterpret_cast<juce::pointer_sized_uint>(memory.get()) + 63) & ~(juce::pointer_sized_uint)63);
+
+    frames = std::make_unique<Frame[]>((size_t)numFrames);
+    for (int f = 0; f < numFrames; ++f)
+        for (int ch = 0; ch < numChannels; ++ch)
+            frames[(size_t)f].data[ch] = base + ((size_t)f * (size_t)numChannels + (size_t)ch) * (size_t)pageSamples;
+
+    pageFrame = std::make_unique<std::atomic<int>[]>((size_t)numPages);
+    for (int p = 0; p < numPages; ++p)
+        pageFrame[(size_t)p] = -1;
+
+    upcoming.resize((size_t)maxUpcomingRegions);
+    thread.addTimeSliceClient(this);
+}
+
+PagedSampleStore::~PagedSampleStore()
+{
+    thread.removeTimeSliceClient(this);
+}
+
+//==============================================================================
+int PagedSampleStore::getNumResident(long long start, int maxSamples)
+{
+    playPosition = start;
+
+    const long long end = juce::jmin(numSamples, start + maxSamples);
+    long long pos = juce::jmax(0LL, start);
+
+    while (pos < end)
+    {
+        const int page = (int)(pos / pageSamples);
+
+        if (pageFrame[(size_t)page].load() < 0)
+        {
+            request(page);
+            break;
+        }
+
+        pos = (long long)(page + 1) * pageSamples;
+    }
+
+    // Keep the worker reading ahead of sequential playback
+    const int nextPage = (int)(start / pageSamples) + 1;
+    if (nextPage < getPageCount() && pageFrame[(size_t)nextPage].load() < 0)
+        request(nextPage);
+
+    return (int)juce::jlimit(0LL, (long long)maxSamples, juce::jmin(pos, end) - start);
+}
+
+int PagedSampleStore::read(juce::AudioBuffer<float>& dest, int destStart, long long start, int num)
+{
+    int done = 0;
+    const auto now = clock.load();
+
+    while (done < num && start + done < numSamples)
+    {
+        const long long pos = start + done;
+        const int page = (int)(pos / pageSamples);
+        const int frameIndex = pageFrame[(size_t)page].load();
+
+        if (frameIndex < 0)
+            break;
+
+        // Pin, then check the worker did not take the frame in the meantime
+        auto& frame = frames[(size_t)frameIndex];
+        ++frame.pins;
+
+        if (pageFrame[(size_t)page].load() != frameIndex)
+        {
+            --frame.pins;
+            break;
+        }
+
+        const int offset = (int)(pos - (long long)page * pageSamples);
+        const int n = juce::jmin(num - done, pageSamples - offset, (int)(numSamples - pos));
+
+        for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+            dest.copyFrom(ch, destStart + done, frame.data[juce::jmin(ch, numChannels - 1)] + offset, n);
+
+        frame.lastUsed = now;
+        --frame.pins;
+        done += n;
+    }
+
+    return done;
+}
+
+void PagedSampleStore::request(int page)
+{
+    int start1, size1, start2, size2;
+    requestFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 > 0)
+    {
+        requests[(size_t)start1] = page;
+        requestFifo.finishedWrite(1);
+    }
+}
+
+//==============================================================================
+int PagedSampleStore::useTimeSlice()
+{
+    ++clock;
+
+    auto isMissing = [this](int page)
+    {
+        return page >= 0 && page < getPageCount() && pageFrame[(size_t)page].load() < 0;
+    };
+
+    // What the audio thread ran into comes first
+    while (requestFifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        requestFifo.prepareToRead(1, start1, size1, start2, size2);
+        const int page = requests[(size_t)start1];
+        requestFifo.finishedRead(1);
+
+        if (isMissing(page))
+        {
+            pageIn(page);
+            return 1;
+        }
+    }
+
+    // Then the pages just ahead of the playhead
+    const int playPage = (int)(playPosition.load() / pageSamples);
+    for (int p = playPage; p <= playPage + readAheadPages; ++p)
+    {
+        if (isMissing(p))
+        {
+            pageIn(p);
+            return 1;
+        }
+    }
+
+    // Then the start of each upcoming random region, nearest first
+    const int numUpcoming = upcomingRegions != nullptr ? upcomingRegions(upcoming.data(), (int)upcoming.size()) : 0;
+    for (int i = 0; i < numUpcoming; ++i)
+    {
+        const int page = (int)((long long)(upcoming[(size_t)i] * sampleRate) / pageSamples);
+
+        if (isMissing(page))
+        {
+            pageIn(page);
+            return 1;
+        }
+    }
+
+    return 10;
+}
+
+void PagedSampleStore::pageIn(int page)
+{
+    const int playPage = (int)(playPosition.load() / pageSamples);
+
+    // A free frame, or the least recently read one not needed by the playhead
+    int victim = -1;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        const int held = frames[(size_t)f].page.load();
+
+        if (held < 0)
+        {
+            victim = f;
+            break;
+        }
+
+        if (held >= playPage && held <= playPage + readAheadPages)
+            continue;
+
+        if (victim < 0 || frames[(size_t)f].lastUsed.load() < frames[(size_t)victim].lastUsed.load())
+            victim = f;
+    }
+
+    if (victim < 0)
+        return;
+
+    auto& frame = frames[(size_t)victim];
+
+    // Unmap first, so no new reads start, then let reads in progress finish
+    const int old = frame.page.load();
+    if (old >= 0)
+        pageFrame[(size_t)old] = -1;
+
+    frame.page = -1;
+
+    while (frame.pins.load() > 0)
+        juce::Thread::yield();
+
+    const long long start = (long long)page * pageSamples;
+    const int num = (int)juce::jmin((long long)pageSamples, numSamples - start);
+
+    juce::AudioBuffer<float> view(frame.data, numChannels, pageSamples);
+    reader->read(&view, 0, num, start, true, numChannels > 1);
+
+    frame.page = page;
+    frame.lastUsed = clock.load();
+    pageFrame[(size_t)page] = victim;
+}
+
+//==============================================================================
+PagedSampleSource::PagedSampleSource(std::unique_ptr<PagedSampleStore> pagedStore, RegionPrefetchSource::Counters& jumpCounters)
+    : store(std::move(pagedStore)),
+      counters(jumpCounters),
+      fadeSamples(juce::jmax(1, juce::roundToInt(store->getSampleRate() * 0.005)))
+{
+}
+
+void PagedSampleSource::setNextReadPosition(juce::int64 newPosition)
+{
+    positionMoved = positionMoved || newPosition != position.load();
+    position = newPosition;
+}
+
+void PagedSampleSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
+{
+    auto pos = position.load();
+
+    // Look a fade's length past the block, so a fade-out can end right at a missing page
+    const int available = store->getNumResident(pos, info.numSamples + fadeSamples);
+
+    if (positionMoved)
+    {
+        if (available > 0)
+            ++counters.hits;
+        else
+            ++counters.misses;
+
+        positionMoved = false;
+    }
+
+    // The end of the file counts as resident, so it is not faded like a miss
+    const bool reachesEnd = pos + available >= store->getNumSamples();
+    const int playable = juce::jmin(info.numSamples, available);
+    const int copied = store->read(*info.buffer, info.startSample, pos, playable);
+
+    if (copied < info.numSamples)
+        info.buffer->clear(info.startSample + copied, info.numSamples - copied);
+
+    // Fast path: fully resident ahead and no fade in progress
+    if (gain < 1.0f || (available < info.numSamples + fadeSamples && !reachesEnd))
+    {
+        const float step = 1.0f / (float)fadeSamples;
+
+        for (int i = 0; i < copied; ++i)
+        {
+            const float target = (reachesEnd || i + fadeSamples < available) ? 1.0f : 0.0f;
+            gain = target > gain ? juce::jmin(target, gain + step) : juce::jmax(target, gain - step);
+
+            for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+                info.buffer->getWritePointer(ch, info.startSample)[i] *= gain;
+        }
+
+        // Stopped at a missing page: resume from silence
+        if (copied < info.numSamples && !reachesEnd)
+            gain = 0.0f;
+    }
+
+    // At a missing page the position waits for it; past the end of the file it
+    // runs on, so the transport sees the stream finish
+    position = pos + (reachesEnd && copied == available ? info.numSamples : copied);
+}
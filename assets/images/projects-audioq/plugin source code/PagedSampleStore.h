@@ -0,0 +1,142 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "RegionPrefetchSource.h"
+
+/**
+ * PagedSampleStore
+ *
+ * Decoded audio of a file too large for RAM, held as fixed-size pages in a
+ * pool of a fixed memory budget, so multi-hour files use constant memory.
+ *
+ *  - Pages are pageSamples long and 64-byte aligned, one block per channel,
+ *  - A TimeSliceThread pages in what the audio thread asked for, the pages
+ *    ahead of the playhead and the start of each upcoming random region,
+ *  - When the pool is full, the least recently read page is evicted.
+ *
+ * The audio thread only ever copies resident pages: a missing page is queued
+ * for the worker (through a wait-free FIFO) and reported as missing, never
+ * waited for. A page being copied is pinned, and the worker waits for pins to
+ * drop before it reuses the memory.
+ */
+class PagedSampleStore : private juce::TimeSliceClient
+{
+public:
+    static constexpr int pageSamples = 32768;
+
+    /** Upcoming random regions, as for RegionPrefetchSource. */
+    using UpcomingRegions = RegionPrefetchSource::UpcomingRegions;
+
+    PagedSampleStore(std::unique_ptr<juce::AudioFormatReader> reader, juce::TimeSliceThread& thread,
+        long long memoryBudgetBytes, UpcomingRegions upcomingRegions);
+
+    ~PagedSampleStore() override;
+
+    int       getNumChannels() const { return numChannels; }
+    long long getNumSamples()  const { return numSamples; }
+    double    getSampleRate()  const { return sampleRate; }
+
+    //==============================================================================
+    // Audio thread
+    //==============================================================================
+    /**
+     * How many samples from `start` on (up to maxSamples) are resident. The first
+     * missing page is requested, and so is the one after `start`'s page.
+     */
+    int getNumResident(long long start, int maxSamples);
+
+    /**
+     * Copies up to numSamples from `start` into dest, stopping at the first page
+     * that is not resident. Mono files feed every channel. Returns the number copied.
+     */
+    int read(juce::AudioBuffer<float>& dest, int destStart, long long start, int numSamples);
+
+private:
+    struct Frame
+    {
+        float*                    data[2] = {};          ///< pageSamples per channel
+        std::atomic<int>          page{ -1 };
+        std::atomic<int>          pins{ 0 };
+        std::atomic<juce::uint32> lastUsed{ 0 };
+    };
+
+    /** Pages in one missing page per call. */
+    int useTimeSlice() override;
+
+    /** Worker: reads a page into a free or evicted frame. */
+    void pageIn(int page);
+
+    /** Audio thread: asks the worker for a page (dropped if the queue is full). */
+    void request(int page);
+
+    int getPageCount() const { return (int)((numSamples + pageSamples - 1) / pageSamples); }
+
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::TimeSliceThread&                   thread;
+    UpcomingRegions                          upcomingRegions;
+
+    int       numChannels = 0;
+    long long numSamples = 0;
+    double    sampleRate = 0.0;
+
+    // The page pool and which page lives where
+    juce::HeapBlock<char>                  memory;
+    std::unique_ptr<Frame[]>               frames;
+    int                                    numFrames = 0;
+    std::unique_ptr<std::atomic<int>[]>    pageFrame;   ///< Frame of each page of the file, or -1
+
+    // Requests from the audio thread; the last position read says where to read ahead
+    static constexpr int                   requestQueueSize = 64;
+    juce::AbstractFifo                     requestFifo{ requestQueueSize };
+    std::array<int, requestQueueSize>      requests{};
+    std::atomic<long long>                 playPosition{ 0 };
+    std::atomic<juce::uint32>              clock{ 1 };
+
+    // Worker scratch for upcoming region starts
+    std::vector<double> upcoming;
+
+    static constexpr int readAheadPages = 2;
+    static constexpr int maxUpcomingRegions = 16;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PagedSampleStore)
+};
+
+//==============================================================================
+/**
+ * PagedSampleSource
+ *
+ * Plays a PagedSampleStore through the transport. When playback runs into a
+ * page that is not resident yet, it fades out over a few milliseconds ending
+ * exactly at the missing page (it looks that far ahead), stays silent at that
+ * position until the page arrives, then fades back in.
+ */
+class PagedSampleSource : public juce::PositionableAudioSource
+{
+public:
+    PagedSampleSource(std::unique_ptr<PagedSampleStore> store, RegionPrefetchSource::Counters& counters);
+
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override;
+
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override { return position.load(); }
+    juce::int64 getTotalLength() const override { return store->getNumSamples(); }
+    bool isLooping() const override { return false; }
+
+private:
+    std::unique_ptr<PagedSampleStore> store;
+    RegionPrefetchSource::Counters&   counters;
+    const int fadeSamples;
+
+    std::atomic<juce::int64> position{ 0 };
+    bool  positionMoved = false;   ///< A jump to count as a hit or miss at the next block
+    float gain = 1.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PagedSampleSource)
+};
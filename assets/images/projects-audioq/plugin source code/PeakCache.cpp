@@ -0,0 +1,192 @@
+#include "PeakCache.h"
+#include <cstring>
+
+/**
+ * PeakCache.cpp
+ *
+ * Reads and writes peak cache files. Reading validates the whole header against
+ * the audio file before the peak data is used in place from the memory map.
+ */
+
+namespace
+{
+    const char cacheMagic[4] = { 'A', 'Q', 'P', 'K' };
+
+    static_assert(sizeof(WaveformOverview::Peak) == 6, "Peak must match the on-disk layout");
+
+    /** Bounds-checked little-endian reads from a mapped cache file. */
+    struct HeaderReader
+    {
+        const char* data = nullptr;
+        size_t      size = 0;
+        size_t      pos = 0;
+        bool        ok = true;
+
+        bool ensure(size_t numBytes)
+        {
+            ok = ok && pos + numBytes <= size;
+            return ok;
+        }
+
+        juce::int64 readInt64()
+        {
+            if (!ensure(8))
+                return 0;
+
+            auto v = (juce::int64)juce::ByteOrder::littleEndianInt64(data + pos);
+            pos += 8;
+            return v;
+        }
+
+        int readInt()
+        {
+            if (!ensure(4))
+                return 0;
+
+            auto v = (int)juce::ByteOrder::littleEndianInt(data + pos);
+            pos += 4;
+            return v;
+        }
+    };
+}
+
+//==============================================================================
+WaveformOverview::Ptr PeakCache::load(const juce::File& audioFile)
+{
+   #if JUCE_BIG_ENDIAN
+    // Peaks are used in place from the map, which assumes a little-endian host
+    juce::ignoreUnused(audioFile);
+    return nullptr;
+   #else
+    auto cacheFile = getCacheFileFor(audioFile);
+    if (!cacheFile.existsAsFile())
+        return nullptr;
+
+    auto mapped = std::make_unique<juce::MemoryMappedFile>(cacheFile, juce::MemoryMappedFile::readOnly);
+    if (mapped->getData() == nullptr)
+        return nullptr;
+
+    HeaderReader r;
+    r.data = static_cast<const char*>(mapped->getData());
+    r.size = mapped->getSize();
+
+    if (!r.ensure(4) || std::memcmp(r.data, cacheMagic, 4) != 0)
+        return nullptr;
+    r.pos = 4;
+
+    const int version = r.readInt();
+    const juce::int64 fileSize = r.readInt64();
+    const juce::int64 modTime = r.readInt64();
+    const juce::int64 totalSamples = r.readInt64();
+    const int numLevels = r.readInt();
+    const int pathBytes = r.readInt();
+
+    // Stale or foreign cache files are simply ignored (and later overwritten)
+    if (!r.ok || version != formatVersion
+        || fileSize != audioFile.getSize()
+        || modTime != audioFile.getLastModificationTime().toMilliseconds()
+        || totalSamples <= 0 || numLevels <= 0 || numLevels > 64 || pathBytes < 0)
+        return nullptr;
+
+    std::vector<WaveformOverview::Level> levels;
+    for (int i = 0; i < numLevels; ++i)
+    {
+        const juce::int64 samplesPerPeak = r.readInt64();
+        const juce::int64 firstPeak = r.readInt64();
+        const juce::int64 numPeaks = r.readInt64();
+
+        if (samplesPerPeak <= 0 || firstPeak < 0 || numPeaks <= 0)
+            return nullptr;
+
+        levels.push_back({ (long long)samplesPerPeak, (size_t)firstPeak, (size_t)numPeaks });
+    }
+
+    if (!r.ensure((size_t)pathBytes)
+        || juce::String::fromUTF8(r.data + r.pos, pathBytes) != audioFile.getFullPathName())
+        return nullptr;
+
+    r.pos = (r.pos + (size_t)pathBytes + 7) & ~(size_t)7;
+
+    const size_t totalPeaks = levels.back().firstPeak + levels.back().numPeaks;
+    for (const auto& level : levels)
+        if (level.firstPeak + level.numPeaks > totalPeaks)
+            return nullptr;
+
+    if (!r.ensure(totalPeaks * sizeof(WaveformOverview::Peak)))
+        return nullptr;
+
+    auto* peaks = reinterpret_cast<const WaveformOverview::Peak*>(r.data + r.pos);
+    return new WaveformOverview((long long)totalSamples, std::move(levels), std::move(mapped), peaks);
+   #endif
+}
+
+bool PeakCache::save(const juce::File& audioFile, const WaveformOverview& overview)
+{
+   #if JUCE_BIG_ENDIAN
+    juce::ignoreUnused(audioFile, overview);
+    return false;
+   #else
+    if (overview.isEmpty())
+        return false;
+
+    auto cacheFile = getCacheFileFor(audioFile);
+    if (!cacheFile.getParentDirectory().createDirectory().wasOk())
+        return false;
+
+    // Write to a temporary file and swap it in at the end,
+    // so another instance never maps a half-written cache file
+    juce::TemporaryFile temp(cacheFile);
+
+    {
+        juce::FileOutputStream out(temp.getFile());
+        if (!out.openedOk())
+            return false;
+
+        auto path = audioFile.getFullPathName().toUTF8();
+        const int pathBytes = (int)path.sizeInBytes() - 1;
+
+        out.write(cacheMagic, 4);
+        out.writeInt(formatVersion);
+        out.writeInt64(audioFile.getSize());
+        out.writeInt64(audioFile.getLastModificationTime().toMilliseconds());
+        out.writeInt64(overview.getTotalSamples());
+        out.writeInt(overview.getNumLevels());
+        out.writeInt(pathBytes);
+
+        for (int i = 0; i < overview.getNumLevels(); ++i)
+        {
+            const auto& level = overview.getLevel(i);
+            out.writeInt64(level.samplesPerPeak);
+            out.writeInt64((juce::int64)level.firstPeak);
+            out.writeInt64((juce::int64)level.numPeaks);
+        }
+
+        out.write(path.getAddress(), (size_t)pathBytes);
+
+        while (out.getPosition() % 8 != 0)
+            out.writeByte(0);
+
+        out.write(overview.getPeakData(), overview.getTotalNumPeaks() * sizeof(WaveformOverview::Peak));
+        out.flush();
+
+        if (out.getStatus().failed())
+            return false;
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+   #endif
+}
+
+juce::File PeakCache::getCacheFileFor(const juce::File& audioFile)
+{
+    const auto key = juce::String::toHexString(audioFile.getFullPathName().hashCode64());
+    return getCacheDirectory().getChildFile(key + ".aqpk");
+}
+
+juce::File PeakCache::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Szunio LLC")
+        .getChildFile("AudioQ")
+        .getChildFile("PeakCache");
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveformOverview.h"
+
+/**
+ * PeakCache
+ *
+ * Persists WaveformOverview peak pyramids as compact binary cache files, one per
+ * audio file, keyed by the audio file's path, size and modification time.
+ * A valid cache file is memory-mapped on load, so reopening a large file shows
+ * its waveform without decoding any audio.
+ *
+ * File layout (little-endian):
+ *   "AQPK", version, file size, mod time (ms), total samples,
+ *   level count, path length, levels { samplesPerPeak, firstPeak, numPeaks },
+ *   UTF-8 path, padding to 8 bytes, then every level's { min, max, rms } int16 peaks.
+ */
+class PeakCache
+{
+public:
+    /** Returns the cached pyramid for this audio file, or nullptr if none is valid. */
+    static WaveformOverview::Ptr load(const juce::File& audioFile);
+
+    /** Writes the pyramid for this audio file. Returns false if it could not be written. */
+    static bool save(const juce::File& audioFile, const WaveformOverview& overview);
+
+    /** Where the cache file for an audio file lives. */
+    static juce::File getCacheFileFor(const juce::File& audioFile);
+
+    /** The folder that holds all peak cache files. */
+    static juce::File getCacheDirectory();
+
+private:
+    static constexpr int formatVersion = 1;
+};
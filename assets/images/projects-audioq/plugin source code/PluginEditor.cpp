@@ -16,7 +16,7 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     : AudioProcessorEditor(&p),
     audioProcessor(p),
     // Initialize the DragDropOfflineWave with references
-    topWaveDragDrop(audioProcessor.getAudioFilePlayer(), topColorWave)
+    topWaveDragDrop(audioProcessor.getAudioFilePlayer(), topColorWave, audioProcessor.getSampleImporter())
 {
     // Our overall size
     setSize(1300, 900);
@@ -56,6 +56,12 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
             }
         });
 
+    // Raw samples for zoomed-in views of the top waveform
+    topColorWave.setSampleProvider([this](juce::AudioBuffer<float>& dest, long long startSample, int numSamples)
+        {
+            return audioProcessor.getAudioFilePlayer().readDisplaySamples(dest, startSample, numSamples);
+        });
+
     topColorWave.setRegionSelectedCallback([this](double startNorm, double endNorm)
         {
             auto& player = audioProcessor.getAudioFilePlayer();
@@ -88,6 +94,13 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     tempoAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(
         audioProcessor.getAPVTS(), "TEMPO", tempoSlider);
 
+    // Tempo mode (items must exist before the attachment is made)
+    if (auto* stretchParam = dynamic_cast<juce::AudioParameterChoice*>(audioProcessor.getAPVTS().getParameter("STRETCH")))
+        stretchModeBox.addItemList(stretchParam->choices, 1);
+    addAndMakeVisible(stretchModeBox);
+    stretchModeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(
+        audioProcessor.getAPVTS(), "STRETCH", stretchModeBox);
+
     // LPF
     lpfSlider.setSliderStyle(juce::Slider::RotaryVerticalDrag);
     lpfSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
@@ -243,6 +256,10 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     addAndMakeVisible(topWaveDragDrop);
     addAndMakeVisible(bottomWave);
 
+    // Picking a library entry loads it like a dropped file
+    addAndMakeVisible(libraryBrowser);
+    libraryBrowser.onFileChosen = [this](const juce::File& file) { topWaveDragDrop.loadFile(file); };
+
     //------------------------------------------------------------------------------
     // Volume warning
     //------------------------------------------------------------------------------
@@ -314,7 +331,9 @@ void NewProjectAudioProcessorEditor::resized()
     auto topRow = area.removeFromTop(180);
 
     gainSlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
-    tempoSlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
+    auto tempoColumn = topRow.removeFromLeft(80);
+    tempoSlider.setBounds(tempoColumn.withSizeKeepingCentre(60, 60));
+    stretchModeBox.setBounds(tempoColumn.withSizeKeepingCentre(76, 22).translated(0, 50));
 
     grainSizeSlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
     grainDensitySlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
@@ -334,12 +353,15 @@ void NewProjectAudioProcessorEditor::resized()
     tremoloRateSlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
     tremoloDepthSlider.setBounds(topRow.removeFromLeft(80).withSizeKeepingCentre(60, 60));
 
-    // Next, top wave area (30% of remaining height)
-    auto colorWaveArea = area.removeFromTop((int)(area.getHeight() * 0.3f));
+    // Next, top wave area (30% of remaining height) and 50 px for drag & drop instructions,
+    // with the library browser beside both
+    auto waveArea = area.removeFromTop((int)(area.getHeight() * 0.3f) + 50);
+    libraryBrowser.setBounds(waveArea.removeFromRight(380).withTrimmedLeft(6));
+
+    auto colorWaveArea = waveArea.removeFromTop(waveArea.getHeight() - 50);
     topColorWave.setBounds(colorWaveArea);
 
-    // Then 50 px for drag & drop instructions
-    auto ddArea = area.removeFromTop(50);
+    auto ddArea = waveArea;
     topWaveDragDrop.setBounds(ddArea);
 
     // 60 px at the bottom for volume warning
@@ -354,14 +376,31 @@ void NewProjectAudioProcessorEditor::resized()
 
 void NewProjectAudioProcessorEditor::timerCallback()
 {
-    // 1) Update top wave's playhead
-    double currentPos = audioProcessor.getAudioFilePlayer().getPosition();
-    double length = audioProcessor.getAudioFilePlayer().getLength();
-    double posFraction = (length > 0.0) ? (currentPos / length) : 0.0;
-    topColorWave.setPlayheadPosition(posFraction);
+    auto& player = audioProcessor.getAudioFilePlayer();
+
+    // 1) Update top wave's playhead and random/granular region from the audio thread's
+    //    latest published state (anything in between frames is coalesced)
+    DisplayStateMailbox::Snapshot state;
+    if (player.getDisplayState().read(state))
+    {
+        topColorWave.setPlayheadPosition(state.playheadNorm);
+
+        if (state.regionVersion != lastRegionVersion)
+        {
+            lastRegionVersion = state.regionVersion;
+
+            // A region chosen just before the mode was switched off is not shown
+            if (player.isRandomMode() || player.isGranularMode())
+            {
+                topColorWave.setRegionSelectionNormalized(state.regionStartNorm, state.regionEndNorm);
+                topColorWave.setRegionColor(state.regionColour);
+                topColorWave.setPlayheadColor(state.playheadColour);
+            }
+        }
+    }
 
     // 2) Update the Play button text
-    if (audioProcessor.getAudioFilePlayer().isPlaying())
+    if (player.isPlaying())
         playButton.setButtonText("Stop");
     else
         playButton.setButtonText("Play");
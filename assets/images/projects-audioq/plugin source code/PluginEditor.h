@@ -4,6 +4,7 @@
 #include "PluginProcessor.h"
 #include "MyLookAndFeel.h"
 #include "DragDropOfflineWave.h"
+#include "SampleLibraryBrowser.h"
 #include "ColorizedOfflineWaveComponent.h"
 #include "CustomDynamicWaveComponent.h"
 
@@ -13,6 +14,7 @@
  * This is the main GUI editor for the plugin. It contains:
  *  - Offline waveform display (ColorizedOfflineWaveComponent),
  *  - A drag-and-drop area (DragDropOfflineWave),
+ *  - A browser of every file loaded so far (SampleLibraryBrowser),
  *  - A bottom real-time waveform (CustomDynamicWaveComponent),
  *  - Various Sliders & Buttons for Gain, Tempo, HPF, LPF, Compressor, Granular, Tremolo, etc.
  *  - A volume-exceeded warning mechanism (if the audio is dangerously loud).
@@ -53,6 +55,7 @@ private:
     // Waveform components
     ColorizedOfflineWaveComponent topColorWave; ///< The top offline wave
     DragDropOfflineWave           topWaveDragDrop; ///< The drag-and-drop area
+    SampleLibraryBrowser          libraryBrowser; ///< The sample library, beside the waves
     CustomDynamicWaveComponent    bottomWave; ///< The bottom real-time wave
 
     //==============================================================================
@@ -60,6 +63,10 @@ private:
     juce::Slider gainSlider, tempoSlider;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> gainAttachment, tempoAttachment;
 
+    // Tempo mode: resample or time-stretch
+    juce::ComboBox stretchModeBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> stretchModeAttachment;
+
     juce::Slider lpfSlider, hpfSlider;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> lpfAttachment, hpfAttachment;
 
@@ -91,6 +98,9 @@ private:
     juce::Label grainSizeLabel, grainDensityLabel;
     juce::Label tremoloRateLabel, tremoloDepthLabel;
 
+    // Last random/granular region shown, from the player's DisplayStateMailbox
+    juce::uint32 lastRegionVersion = 0;
+
     //==============================================================================
     // Volume-exceeded warning
     juce::Label     volumeExceededLabel;
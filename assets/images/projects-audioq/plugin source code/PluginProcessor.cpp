@@ -6,8 +6,9 @@
  *
  * The core audio-processing logic, including:
  *  - Loading / playing audio via AudioFilePlayer,
- *  - Applying filters & compression,
- *  - Handling tempo-based resampling,
+ *  - Applying filters & compression, updating coefficients only for
+ *    parameters that moved and smoothing the cutoffs and gain,
+ *  - Handling tempo-based resampling or time-stretching,
  *  - Granular (small random loops),
  *  - A manual tremolo (simple LFO),
  *  - Volume safety detection (stops audio if peaks exceed 0.99f).
@@ -25,6 +26,22 @@ NewProjectAudioProcessor::NewProjectAudioProcessor()
     // Configure our two StateVariable filters
     lpf.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
     hpf.setType(juce::dsp::StateVariableTPTFilterType::highpass);
+
+    // Look every parameter the audio thread reads up once, rather than by ID every block
+    params.gain = apvts.getRawParameterValue("GAIN");
+    params.tempo = apvts.getRawParameterValue("TEMPO");
+    params.stretch = apvts.getRawParameterValue("STRETCH");
+    params.resampleQuality = apvts.getRawParameterValue("RESAMPLE_QUALITY");
+    params.lpf = apvts.getRawParameterValue("LPF");
+    params.hpf = apvts.getRawParameterValue("HPF");
+    params.compThreshold = apvts.getRawParameterValue("COMPTHRESH");
+    params.compRatio = apvts.getRawParameterValue("COMPRATIO");
+    params.compAttack = apvts.getRawParameterValue("COMPATTACK");
+    params.compRelease = apvts.getRawParameterValue("COMPRELEASE");
+    params.grainSize = apvts.getRawParameterValue("GRAIN_SIZE");
+    params.grainDensity = apvts.getRawParameterValue("GRAIN_DENSITY");
+    params.tremRate = apvts.getRawParameterValue("TREM_RATE");
+    params.tremDepth = apvts.getRawParameterValue("TREM_DEPTH");
 }
 
 NewProjectAudioProcessor::~NewProjectAudioProcessor()
@@ -65,13 +82,24 @@ void NewProjectAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBl
     // Prepare our audio file player
     audioFilePlayer.prepareToPlay(samplesPerBlock, sampleRate);
 
+    // Imported samples are converted to the device rate up front, so switching needs no
+    // conversion (an atomic store, safe from the host's thread)
+    sampleImporter.setTargetSampleRate(sampleRate);
+
     // Setup DSP chain
     juce::dsp::ProcessSpec spec;
     spec.sampleRate = sampleRate;
     spec.maximumBlockSize = (juce::uint32)samplesPerBlock;
     spec.numChannels = 2;
 
-    // Prepare filters
+    // Prepare filters, starting at the current cutoffs rather than gliding to them
+    lpfCutoff.reset(sampleRate, cutoffRampSeconds);
+    hpfCutoff.reset(sampleRate, cutoffRampSeconds);
+    lpfCutoff.setCurrentAndTargetValue(params.lpf->load());
+    hpfCutoff.setCurrentAndTargetValue(params.hpf->load());
+    lpf.setCutoffFrequency(lpfCutoff.getTargetValue());
+    hpf.setCutoffFrequency(hpfCutoff.getTargetValue());
+
     lpf.prepare(spec);
     hpf.prepare(spec);
     lpf.reset();
@@ -81,6 +109,12 @@ void NewProjectAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBl
     compressor.prepare(spec);
     compressor.reset();
 
+    // Push every parameter again on the first block
+    applied = AppliedValues();
+
+    gainSmoothed.reset(sampleRate, gainRampSeconds);
+    gainSmoothed.setCurrentAndTargetValue(params.gain->load());
+
     // Visualization buffer
     visualizerBuffer.setSize(2, samplesPerBlock);
     visualizerBuffer.clear();
@@ -110,54 +144,24 @@ void NewProjectAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
         return;
     }
 
-    // Grab parameter values from APVTS
-    float gainValue = *apvts.getRawParameterValue("GAIN");
-    float tempoValue = *apvts.getRawParameterValue("TEMPO");
-    float lpfCutoff = *apvts.getRawParameterValue("LPF");
-    float hpfCutoff = *apvts.getRawParameterValue("HPF");
-
-    float cThresh = *apvts.getRawParameterValue("COMPTHRESH");
-    float cRatio = *apvts.getRawParameterValue("COMPRATIO");
-    float cAttack = *apvts.getRawParameterValue("COMPATTACK");
-    float cRelease = *apvts.getRawParameterValue("COMPRELEASE");
-
-    float grainSize = *apvts.getRawParameterValue("GRAIN_SIZE");
-    float grainDensity = *apvts.getRawParameterValue("GRAIN_DENSITY");
-
-    float tremRate = *apvts.getRawParameterValue("TREM_RATE");   // 0.1..10 Hz
-    float tremDepth = *apvts.getRawParameterValue("TREM_DEPTH");  // 0..1
-
-    // Adjust file player speed from tempo
-    double ratio = (double)tempoValue / 120.0;
-    audioFilePlayer.setResamplingRatio(ratio);
-
-    // Granular
-    audioFilePlayer.setGrainSize(grainSize);
-    audioFilePlayer.setGrainDensity(grainDensity);
+    // Only what moved since the last block reaches the player and the compressor
+    applyParameterChanges();
 
     // Fetch audio from the file player
     juce::AudioSourceChannelInfo info(buffer);
     audioFilePlayer.getNextAudioBlock(info);
 
-    // Set filter cutoffs
-    lpf.setCutoffFrequency(lpfCutoff);
-    hpf.setCutoffFrequency(hpfCutoff);
-
     // Wrap the buffer in a dsp block
     juce::dsp::AudioBlock<float> dspBlock(buffer);
     juce::dsp::ProcessContextReplacing<float> ctx(dspBlock);
 
-    // Process filters
-    lpf.process(ctx);
-    hpf.process(ctx);
-
-    // Process compressor
-    compressor.setThreshold(cThresh);
-    compressor.setRatio(cRatio);
-    compressor.setAttack(cAttack);
-    compressor.setRelease(cRelease);
+    // Process filters, then the compressor
+    processFilters(dspBlock);
     compressor.process(ctx);
 
+    const float tremRate = params.tremRate->load();    // 0.1..10 Hz
+    const float tremDepth = params.tremDepth->load();  // 0..1
+
     // Manual tremolo if enabled
     if (tremoloOn && tremDepth > 0.0f)
     {
@@ -184,8 +188,18 @@ void NewProjectAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
         }
     }
 
-    // Final overall gain
-    buffer.applyGain(gainValue);
+    // Final overall gain, ramped per sample while it moves
+    gainSmoothed.setTargetValue(params.gain->load());
+
+    if (gainSmoothed.isSmoothing())
+    {
+        const float startGain = gainSmoothed.getCurrentValue();
+        buffer.applyGainRamp(0, buffer.getNumSamples(), startGain, gainSmoothed.skip(buffer.getNumSamples()));
+    }
+    else
+    {
+        buffer.applyGain(gainSmoothed.getTargetValue());
+    }
 
     // Copy to visualizer
     {
@@ -250,6 +264,16 @@ juce::AudioProcessorValueTreeState::ParameterLayout NewProjectAudioProcessor::cr
         "TEMPO", "Tempo (BPM)", 20.0f, 300.0f, 120.0f
     ));
 
+    // How tempo is applied: tape-style resampling, or time-stretching that keeps the pitch
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        "STRETCH", "Tempo Mode", juce::StringArray{ "Resample", "Stretch (WSOLA)", "Stretch (Tonal)" }, 0
+    ));
+
+    // Interpolation quality for speed changes: more taps = less aliasing, more CPU
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        "RESAMPLE_QUALITY", "Resampling Quality", juce::StringArray{ "Draft", "Normal", "Mastering" }, 1
+    ));
+
     // LPF, HPF
     params.push_back(std::make_unique<juce::AudioParameterFloat>(
         "LPF", "LPF (Hz)", 20.0f, 20000.0f, 20000.0f
@@ -291,6 +315,94 @@ juce::AudioProcessorValueTreeState::ParameterLayout NewProjectAudioProcessor::cr
     return { params.begin(), params.end() };
 }
 
+TimeStretcher::Mode NewProjectAudioProcessor::getStretchModeParameter() const
+{
+    // Choice indices match TimeStretcher::Mode
+    return (TimeStretcher::Mode)juce::roundToInt(params.stretch->load());
+}
+
+void NewProjectAudioProcessor::applyParameterChanges()
+{
+    // True (and remembered) when a value differs from the one last applied
+    auto changed = [](float value, float& last)
+    {
+        if (value == last)
+            return false;
+
+        last = value;
+        return true;
+    };
+
+    // The ratio goes to the stretcher or the resampler depending on the mode, so a new mode re-applies it
+    const bool modeChanged = changed(params.stretch->load(), applied.stretch);
+    if (modeChanged)
+        audioFilePlayer.setTimeStretchMode(getStretchModeParameter());
+
+    const float tempo = params.tempo->load();
+    if (changed(tempo, applied.tempo) || modeChanged)
+        audioFilePlayer.setResamplingRatio((double)tempo / 120.0);
+
+    const float quality = params.resampleQuality->load();
+    if (changed(quality, applied.resampleQuality))
+        audioFilePlayer.setResamplingQuality((SincKernelBank::Quality)juce::roundToInt(quality));
+
+    // Granular
+    const float grainSize = params.grainSize->load();
+    if (changed(grainSize, applied.grainSize))
+        audioFilePlayer.setGrainSize(grainSize);
+
+    const float grainDensity = params.grainDensity->load();
+    if (changed(grainDensity, applied.grainDensity))
+        audioFilePlayer.setGrainDensity(grainDensity);
+
+    // Each compressor setter recomputes its own coefficients
+    const float threshold = params.compThreshold->load();
+    if (changed(threshold, applied.compThreshold))
+        compressor.setThreshold(threshold);
+
+    const float ratio = params.compRatio->load();
+    if (changed(ratio, applied.compRatio))
+        compressor.setRatio(ratio);
+
+    const float attack = params.compAttack->load();
+    if (changed(attack, applied.compAttack))
+        compressor.setAttack(attack);
+
+    const float release = params.compRelease->load();
+    if (changed(release, applied.compRelease))
+        compressor.setRelease(release);
+}
+
+void NewProjectAudioProcessor::processFilters(juce::dsp::AudioBlock<float>& block)
+{
+    lpfCutoff.setTargetValue(params.lpf->load());
+    hpfCutoff.setTargetValue(params.hpf->load());
+
+    const int numSamples = (int)block.getNumSamples();
+
+    for (int start = 0; start < numSamples; )
+    {
+        // Steady cutoffs keep their coefficients for the rest of the block
+        const bool lpfGliding = lpfCutoff.isSmoothing();
+        const bool hpfGliding = hpfCutoff.isSmoothing();
+        const int num = (lpfGliding || hpfGliding) ? juce::jmin(filterSubBlockSize, numSamples - start) : numSamples - start;
+
+        if (lpfGliding)
+            lpf.setCutoffFrequency(lpfCutoff.skip(num));
+
+        if (hpfGliding)
+            hpf.setCutoffFrequency(hpfCutoff.skip(num));
+
+        auto subBlock = block.getSubBlock((size_t)start, (size_t)num);
+        juce::dsp::ProcessContextReplacing<float> ctx(subBlock);
+
+        lpf.process(ctx);
+        hpf.process(ctx);
+
+        start += num;
+    }
+}
+
 void NewProjectAudioProcessor::getVisualizerBuffer(juce::AudioBuffer<float>& outBuffer)
 {
     // Copy the internal buffer used for visualization
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <atomic>
+#include <limits>
 #include "AudioFilePlayer.h"
+#include "SampleImporter.h"
 #include "MyLookAndFeel.h"
 
 /**
@@ -9,9 +12,9 @@
  *
  * Main audio processing class that manages:
  *  - AudioFilePlayer for playback,
- *  - High-pass / Low-pass filters,
+ *  - High-pass / Low-pass filters (cutoffs smoothed, so automation doesn't zipper),
  *  - A compressor,
- *  - Gain & tempo (via resampling),
+ *  - Gain & tempo (via resampling, or a pitch-preserving time-stretch),
  *  - Granular (grainSize/grainDensity),
  *  - Manual tremolo effect (enabled via a toggle, with rate/depth),
  *  - A buffer for real-time waveform visualization,
@@ -69,6 +72,7 @@ public:
     //==============================================================================
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
     AudioFilePlayer& getAudioFilePlayer() { return audioFilePlayer; }
+    SampleImporter& getSampleImporter() { return sampleImporter; }
 
     /**
      * Thread-safe method to retrieve the buffer used for real-time wave visualization.
@@ -90,10 +94,22 @@ private:
     /** Creates the set of parameters used by AudioProcessorValueTreeState. */
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameters();
 
+    /** The STRETCH parameter as a TimeStretcher mode. */
+    TimeStretcher::Mode getStretchModeParameter() const;
+
+    /** Audio thread: passes the parameters that moved since the last block on to the player and compressor. */
+    void applyParameterChanges();
+
+    /** Runs the filters, in short sub-blocks with fresh coefficients while a cutoff glides. */
+    void processFilters(juce::dsp::AudioBlock<float>& block);
+
     //==============================================================================
     // File player
     AudioFilePlayer audioFilePlayer;
 
+    // Sample list filled by folder and multi-file drops
+    SampleImporter sampleImporter;
+
     // Filters
     juce::dsp::StateVariableTPTFilter<float> lpf;
     juce::dsp::StateVariableTPTFilter<float> hpf;
@@ -104,6 +120,47 @@ private:
     // Parameter storage
     juce::AudioProcessorValueTreeState apvts;
 
+    /** The raw values the audio thread reads, looked up by ID once (they live as long as the APVTS). */
+    struct ParameterPointers
+    {
+        std::atomic<float>* gain = nullptr;
+        std::atomic<float>* tempo = nullptr;
+        std::atomic<float>* stretch = nullptr;
+        std::atomic<float>* resampleQuality = nullptr;
+        std::atomic<float>* lpf = nullptr;
+        std::atomic<float>* hpf = nullptr;
+        std::atomic<float>* compThreshold = nullptr;
+        std::atomic<float>* compRatio = nullptr;
+        std::atomic<float>* compAttack = nullptr;
+        std::atomic<float>* compRelease = nullptr;
+        std::atomic<float>* grainSize = nullptr;
+        std::atomic<float>* grainDensity = nullptr;
+        std::atomic<float>* tremRate = nullptr;
+        std::atomic<float>* tremDepth = nullptr;
+    };
+
+    ParameterPointers params;
+
+    /** The values last passed on by applyParameterChanges(); NaN (never equal) forces the next push. */
+    struct AppliedValues
+    {
+        static constexpr float unset = std::numeric_limits<float>::quiet_NaN();
+
+        float tempo = unset, stretch = unset, resampleQuality = unset;
+        float grainSize = unset, grainDensity = unset;
+        float compThreshold = unset, compRatio = unset, compAttack = unset, compRelease = unset;
+    };
+
+    AppliedValues applied;
+
+    // Smoothed towards their parameters: cutoffs per sub-block, gain per sample
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> lpfCutoff, hpfCutoff;
+    juce::SmoothedValue<float> gainSmoothed;
+
+    static constexpr int    filterSubBlockSize = 32;
+    static constexpr double cutoffRampSeconds = 0.05;
+    static constexpr double gainRampSeconds = 0.02;
+
     // Real-time visualization buffer
     juce::AudioBuffer<float> visualizerBuffer;
     juce::CriticalSection    bufferLock;
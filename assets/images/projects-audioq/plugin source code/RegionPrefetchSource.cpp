@@ -0,0 +1,215 @@
+#include "RegionPrefetchSource.h"
+
+/**
+ * RegionPrefetchSource.cpp
+ *
+ * The audio thread claims a ready slot on a jump and plays it out before
+ * falling back to the read-ahead buffer; the worker keeps the slots filled
+ * with the upcoming regions, evicting the least recently used ones.
+ */
+
+RegionPrefetchSource::RegionPrefetchSource(std::unique_ptr<juce::PositionableAudioSource> inputSource,
+    std::unique_ptr<juce::AudioFormatReader> prefetchReader,
+    juce::TimeSliceThread& backgroundThread, int readAheadSamples, int numRegions, int regionSamples,
+    UpcomingRegions upcomingProvider, Counters& jumpCounters)
+    : input(std::move(inputSource)),
+      reader(std::move(prefetchReader)),
+      thread(backgroundThread),
+      upcomingRegions(std::move(upcomingProvider)),
+      counters(jumpCounters),
+      regionLength(juce::jmax(0, regionSamples))
+{
+    jassert(input != nullptr);
+
+    // Not prefilled on prepare: that would block whoever prepares it (the transport, under a lock)
+    if (readAheadSamples > 0)
+        buffered = std::make_unique<juce::BufferingAudioSource>(input.get(), thread, false, readAheadSamples, 2, false);
+
+    direct = buffered != nullptr ? static_cast<juce::PositionableAudioSource*>(buffered.get()) : input.get();
+
+    if (reader != nullptr && upcomingRegions != nullptr && regionLength > 0)
+    {
+        for (int i = 0; i < numRegions; ++i)
+        {
+            auto slot = std::make_unique<Slot>();
+            slot->samples.setSize(2, regionLength);
+            slots.push_back(std::move(slot));
+        }
+
+        upcoming.resize((size_t)slots.size());
+        thread.addTimeSliceClient(this);
+    }
+}
+
+RegionPrefetchSource::~RegionPrefetchSource()
+{
+    thread.removeTimeSliceClient(this);
+
+    // The read-ahead buffer reads from input, so it goes first
+    buffered = nullptr;
+}
+
+//==============================================================================
+void RegionPrefetchSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    direct->prepareToPlay(samplesPerBlockExpected, sampleRate);
+}
+
+void RegionPrefetchSource::releaseResources()
+{
+    releaseSlot();
+    direct->releaseResources();
+}
+
+void RegionPrefetchSource::setNextReadPosition(juce::int64 newPosition)
+{
+    // Only count real jumps, not the transport re-stating where it already is
+    const bool isJump = newPosition != position.load();
+
+    releaseSlot();
+    position = newPosition;
+
+    for (int i = 0; i < (int)slots.size(); ++i)
+    {
+        auto& slot = *slots[(size_t)i];
+        const auto start = slot.start.load();
+
+        if (start < 0 || newPosition < start || newPosition >= start + regionLength)
+            continue;
+
+        int expected = ready;
+        if (!slot.state.compare_exchange_strong(expected, playing))
+            continue;
+
+        // The worker may have refilled it with another region between the two reads
+        if (slot.start.load() != start)
+        {
+            slot.state = ready;
+            continue;
+        }
+
+        servingSlot = i;
+        direct->setNextReadPosition(start + regionLength);
+
+        if (isJump)
+            ++counters.hits;
+
+        return;
+    }
+
+    direct->setNextReadPosition(newPosition);
+
+    if (isJump && !slots.empty())
+        ++counters.misses;
+}
+
+void RegionPrefetchSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
+{
+    int done = 0;
+    auto pos = position.load();
+
+    if (servingSlot >= 0)
+    {
+        const auto& slot = *slots[(size_t)servingSlot];
+        const auto offset = (int)(pos - slot.start.load());
+        done = juce::jmin(info.numSamples, regionLength - offset);
+
+        for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+            info.buffer->copyFrom(ch, info.startSample, slot.samples,
+                juce::jmin(ch, slot.samples.getNumChannels() - 1), offset, done);
+
+        pos += done;
+
+        if (offset + done >= regionLength)
+            releaseSlot();
+    }
+
+    // The read-ahead buffer was pointed past the cached part when playback entered it
+    if (done < info.numSamples)
+    {
+        direct->getNextAudioBlock(juce::AudioSourceChannelInfo(info.buffer, info.startSample + done, info.numSamples - done));
+        pos = direct->getNextReadPosition();
+    }
+
+    position = pos;
+}
+
+void RegionPrefetchSource::releaseSlot()
+{
+    if (servingSlot < 0)
+        return;
+
+    slots[(size_t)servingSlot]->state = ready;
+    servingSlot = -1;
+}
+
+//==============================================================================
+int RegionPrefetchSource::useTimeSlice()
+{
+    const int numUpcoming = upcomingRegions(upcoming.data(), (int)upcoming.size());
+    const double sampleRate = reader->sampleRate;
+
+    // Where the slot for a region starts filling
+    auto slotStart = [&](double startSec)
+    {
+        return juce::jmax((juce::int64)0, (juce::int64)(startSec * sampleRate) - startTolerance);
+    };
+
+    auto isUpcoming = [&](juce::int64 start)
+    {
+        for (int i = 0; i < numUpcoming; ++i)
+            if (slotStart(upcoming[(size_t)i]) == start)
+                return true;
+
+        return false;
+    };
+
+    ++useCounter;
+
+    for (int i = 0; i < numUpcoming; ++i)
+    {
+        const auto start = slotStart(upcoming[(size_t)i]);
+
+        // Already cached: keep it fresh for the eviction order
+        Slot* cached = nullptr;
+        for (auto& slot : slots)
+            if (slot->start.load() == start && slot->state.load() != filling)
+                cached = slot.get();
+
+        if (cached != nullptr)
+        {
+            cached->lastUsed = useCounter;
+            continue;
+        }
+
+        // Evict an empty slot, or the least recently used one no upcoming region needs
+        Slot* victim = nullptr;
+        for (auto& slot : slots)
+        {
+            const int state = slot->state.load();
+            if (state == playing || (state == ready && isUpcoming(slot->start.load())))
+                continue;
+
+            if (victim == nullptr || state == empty || (victim->state.load() != empty && slot->lastUsed < victim->lastUsed))
+                victim = slot.get();
+        }
+
+        if (victim == nullptr)
+            break;
+
+        int expected = victim->state.load();
+        if (expected == playing || !victim->state.compare_exchange_strong(expected, filling))
+            return 1;
+
+        victim->start = -1;
+        reader->read(&victim->samples, 0, regionLength, start, true, true);
+        victim->start = start;
+        victim->lastUsed = useCounter;
+        victim->state = ready;
+
+        // One region per slice, so other clients of the thread keep their turn
+        return 1;
+    }
+
+    return 20;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * RegionPrefetchSource
+ *
+ * Sits between a streamed file and the AudioTransportSource and hides the cost
+ * of seeking:
+ *  - A read-ahead buffer (juce::BufferingAudioSource) keeps sequential playback
+ *    ahead of the disk,
+ *  - A small cache holds the first part of each upcoming random region, read by
+ *    a TimeSliceThread with its own reader before the audio thread jumps there.
+ *
+ * When a jump lands in a cached region, playback starts from the cache and the
+ * read-ahead buffer is pointed at the end of the cached part, so it has the
+ * cache's length to catch up. Jumps the cache does not cover seek the buffer
+ * directly, as before.
+ *
+ * Cache slots are handed between the worker and the audio thread with a state
+ * per slot (empty / filling / ready / playing), so the audio thread never
+ * waits, allocates or reads the disk for a hit.
+ */
+class RegionPrefetchSource : public juce::PositionableAudioSource,
+                             private juce::TimeSliceClient
+{
+public:
+    /** Jump counters, shared across files so the cache can be sized per machine. */
+    struct Counters
+    {
+        std::atomic<juce::uint64> hits{ 0 };     ///< Jumps served from the cache
+        std::atomic<juce::uint64> misses{ 0 };   ///< Jumps that had to seek the file
+    };
+
+    /**
+     * Fills `startSec` with the start times of the regions that will be played
+     * next, nearest first, and returns how many. Called on the TimeSliceThread.
+     */
+    using UpcomingRegions = std::function<int(double* startSec, int maxRegions)>;
+
+    /**
+     * @param input            The file's streaming source (owned)
+     * @param prefetchReader   A second reader of the same file for the cache (owned, may be null)
+     * @param thread           Runs the read-ahead and the prefetching
+     * @param readAheadSamples Size of the read-ahead buffer (0: read the input directly)
+     * @param numRegions       Number of regions the cache holds
+     * @param regionSamples    Samples cached from the start of each region
+     */
+    RegionPrefetchSource(std::unique_ptr<juce::PositionableAudioSource> input,
+        std::unique_ptr<juce::AudioFormatReader> prefetchReader,
+        juce::TimeSliceThread& thread, int readAheadSamples, int numRegions, int regionSamples,
+        UpcomingRegions upcomingRegions, Counters& counters);
+
+    ~RegionPrefetchSource() override;
+
+    //==============================================================================
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override;
+
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override { return position.load(); }
+    juce::int64 getTotalLength() const override { return direct->getTotalLength(); }
+    bool isLooping() const override { return direct->isLooping(); }
+    void setLooping(bool shouldLoop) override { direct->setLooping(shouldLoop); }
+
+    /**
+     * Samples each slot is filled from before its region's start. The transport
+     * converts seconds to samples through the device rate, truncating twice, so
+     * a jump to a region can land a sample or two before the slot's own
+     * conversion; those jumps still hit.
+     */
+    static constexpr int startTolerance = 16;
+
+private:
+    enum SlotState { empty = 0, filling, ready, playing };
+
+    struct Slot
+    {
+        juce::AudioBuffer<float> samples;
+        std::atomic<juce::int64> start{ -1 };   ///< First cached sample, startTolerance before the region
+        std::atomic<int>         state{ empty };
+        juce::uint32             lastUsed = 0;   ///< Worker only
+    };
+
+    /** Reads one upcoming region into the cache per call. */
+    int useTimeSlice() override;
+
+    /** Audio thread: hands the slot being played back to the worker. */
+    void releaseSlot();
+
+    std::unique_ptr<juce::PositionableAudioSource> input;
+    std::unique_ptr<juce::BufferingAudioSource>    buffered;
+    juce::PositionableAudioSource*                 direct = nullptr;   ///< buffered, or input without read-ahead
+
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::TimeSliceThread&                   thread;
+    UpcomingRegions                          upcomingRegions;
+    Counters&                                counters;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    const int regionLength;
+
+    // Written by the audio thread (the position is also read by the message thread)
+    std::atomic<juce::int64> position{ 0 };
+    int                      servingSlot = -1;
+
+    // Worker
+    std::vector<double> upcoming;
+    juce::uint32        useCounter = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RegionPrefetchSource)
+};
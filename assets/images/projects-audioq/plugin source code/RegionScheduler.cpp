@@ -0,0 +1,145 @@
+#include "RegionScheduler.h"
+
+/**
+ * RegionScheduler.cpp
+ *
+ * The producer reseeds its PRNG whenever it sees a new generation, then fills
+ * the FIFO. The consumer drops entries left over from an older generation.
+ */
+
+void RegionScheduler::restart(double fileLengthSec, double minLengthSec, double maxLengthSec)
+{
+    const juce::SpinLock::ScopedLockType sl(configLock);
+    pendingConfig.fileLengthSec = fileLengthSec;
+    pendingConfig.minLengthSec = minLengthSec;
+    pendingConfig.maxLengthSec = maxLengthSec;
+    ++generation;
+}
+
+//==============================================================================
+bool RegionScheduler::popNextRegion(Region& region)
+{
+    const auto current = generation.load();
+
+    // At most queueSize stale entries can be ahead of a current one
+    for (;;)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+        {
+            ++underruns;
+            return false;
+        }
+
+        const auto& entry = entries[(size_t)start1];
+        const bool isCurrent = (entry.generation == current);
+
+        if (isCurrent)
+            region = entry.region;
+
+        fifo.finishedRead(1);
+
+        if (isCurrent)
+            return true;
+    }
+}
+
+int RegionScheduler::getUpcomingRegions(double* startSec, int maxRegions) const
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(juce::jmax(0, maxRegions), start1, size1, start2, size2);
+
+    // Entries are only rewritten by the producer, i.e. this thread, so reading them is safe
+    int numFound = 0;
+    auto addRange = [&](int start, int size)
+    {
+        for (int i = start; i < start + size; ++i)
+            if (entries[(size_t)i].generation == producerGeneration)
+                startSec[numFound++] = entries[(size_t)i].region.startSec;
+    };
+
+    addRange(start1, size1);
+    addRange(start2, size2);
+    return numFound;
+}
+
+//==============================================================================
+int RegionScheduler::useTimeSlice()
+{
+    {
+        const juce::SpinLock::ScopedLockType sl(configLock);
+        const auto current = generation.load();
+
+        if (current != producerGeneration)
+        {
+            producerGeneration = current;
+            config = pendingConfig;
+            rngState = makeRandomState(seed.load());
+        }
+    }
+
+    if (config.fileLengthSec <= 0.05)
+        return 50;
+
+    while (fifo.getFreeSpace() > 0)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        auto& entry = entries[(size_t)start1];
+        entry.region = createRegion(config);
+        entry.generation = producerGeneration;
+
+        fifo.finishedWrite(1);
+    }
+
+    // Check back sooner while the queue is low (e.g. just after a restart)
+    return fifo.getNumReady() < queueSize / 2 ? 5 : 20;
+}
+
+RegionScheduler::Region RegionScheduler::createRegion(const Config& c)
+{
+    const double fileLen = c.fileLengthSec;
+    double minLen = c.minLengthSec;
+    const double maxLen = juce::jmax(minLen, c.maxLengthSec);
+
+    if (minLen > fileLen)
+        minLen = fileLen * 0.5;
+
+    const double range = juce::jmax(0.0, fileLen - minLen);
+
+    Region r;
+    r.startSec = nextRandom(rngState) * range;
+    r.endSec = juce::jmin(fileLen, r.startSec + minLen + nextRandom(rngState) * (maxLen - minLen));
+
+    // Some random colours for region + playhead
+    r.regionColour = juce::Colour::fromHSV((float)nextRandom(rngState), 0.4f + 0.4f * (float)nextRandom(rngState), 1.0f, 0.3f);
+    r.playheadColour = juce::Colour::fromHSV((float)nextRandom(rngState), 0.9f, 0.95f, 1.0f);
+    return r;
+}
+
+//==============================================================================
+juce::uint64 RegionScheduler::makeRandomState(juce::uint64 seed)
+{
+    if (seed == 0)
+        seed = (juce::uint64)juce::Time::getHighResolutionTicks() ^ (juce::uint64)juce::Random::getSystemRandom().nextInt64();
+
+    // SplitMix64 step, so nearby seeds still give unrelated sequences
+    seed += 0x9e3779b97f4a7c15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    return (seed ^ (seed >> 31)) | 1;
+}
+
+double RegionScheduler::nextRandom(juce::uint64& state)
+{
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+
+    const juce::uint64 bits = state * 0x2545f4914f6cdd1dULL;
+    return (double)(bits >> 11) * (1.0 / 9007199254740992.0);
+}
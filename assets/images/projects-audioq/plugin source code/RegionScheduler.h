@@ -0,0 +1,105 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+/**
+ * RegionScheduler
+ *
+ * Plans the random regions used by Random and Granular modes ahead of time.
+ * A TimeSliceThread keeps a small queue of upcoming regions (bounds and display
+ * colours) topped up, drawing from the scheduler's own seeded PRNG. The audio
+ * thread pops the next region from a single-producer/single-consumer FIFO, which
+ * is wait-free and O(1): no locks, no allocation and no std::rand.
+ *
+ * With a non-zero seed every restart replays the same sequence of regions,
+ * which makes granular runs reproducible.
+ */
+class RegionScheduler : public juce::TimeSliceClient
+{
+public:
+    struct Region
+    {
+        double       startSec = 0.0;
+        double       endSec = 0.0;
+        juce::Colour regionColour;
+        juce::Colour playheadColour;
+    };
+
+    /**
+     * Starts a new sequence of regions for a file of the given length, each
+     * between minLengthSec and maxLengthSec long. Regions queued before are
+     * discarded. Call from any thread except the audio thread, then move this
+     * client to the front of its TimeSliceThread so the new sequence is ready quickly.
+     */
+    void restart(double fileLengthSec, double minLengthSec, double maxLengthSec);
+
+    /** Seed for the region sequence; 0 picks a new random seed on every restart. */
+    void setSeed(juce::uint64 newSeed) { seed = newSeed; }
+    juce::uint64 getSeed() const { return seed; }
+
+    /**
+     * The PRNG behind the regions, also used for the grains so one seed replays
+     * both: makeRandomState() turns a seed (0: a new random one) into an
+     * xorshift64* state, nextRandom() draws from it uniformly in [0, 1).
+     */
+    static juce::uint64 makeRandomState(juce::uint64 seed);
+    static double nextRandom(juce::uint64& state);
+
+    /**
+     * Audio thread: takes the next planned region. Returns false if none is
+     * ready yet, in which case the caller keeps its current region.
+     */
+    bool popNextRegion(Region& region);
+
+    /**
+     * Start times of the regions queued for the audio thread, next first.
+     * Only call on the TimeSliceThread running this scheduler (the producer side),
+     * e.g. to prefetch their audio; a region being popped meanwhile may still be listed.
+     */
+    int getUpcomingRegions(double* startSec, int maxRegions) const;
+
+    /** How often popNextRegion() found the queue empty. */
+    int getNumUnderruns() const { return underruns.load(); }
+
+    /** Fills the queue on the TimeSliceThread. */
+    int useTimeSlice() override;
+
+private:
+    struct Entry
+    {
+        Region       region;
+        juce::uint32 generation = 0;
+    };
+
+    struct Config
+    {
+        double fileLengthSec = 0.0;
+        double minLengthSec = 0.0;
+        double maxLengthSec = 0.0;
+    };
+
+    Region createRegion(const Config& config);
+
+    static constexpr int queueSize = 32;
+
+    juce::AbstractFifo            fifo{ queueSize };
+    std::array<Entry, queueSize>  entries;
+
+    // Bumped by restart(); entries from older generations are skipped
+    std::atomic<juce::uint32> generation{ 0 };
+    std::atomic<int>          underruns{ 0 };
+    std::atomic<juce::uint64> seed{ 0 };
+
+    // Shared by restart() and the producer only, never by the audio thread
+    juce::SpinLock configLock;
+    Config         pendingConfig;
+
+    // Producer thread state
+    juce::uint32 producerGeneration = 0;
+    Config       config;
+    juce::uint64 rngState = 1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RegionScheduler)
+};
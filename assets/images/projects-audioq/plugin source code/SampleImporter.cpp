@@ -0,0 +1,283 @@
+#include "SampleImporter.h"
+
+/**
+ * SampleImporter.cpp
+ *
+ * Folder scanning and one decode-and-measure job per file on the pool, with the
+ * results and the end of the import reported to the message thread through
+ * MessageManager::callAsync.
+ */
+
+SampleImporter::SampleImporter()
+{
+    // Files are already decoded side by side, one per core: splitting each one
+    // into ranges as well would only make the jobs compete for the same cores
+    loader.setParallelDecodeEnabled(false);
+}
+
+SampleImporter::~SampleImporter()
+{
+    ++generation;
+
+    if (pool != nullptr)
+        pool->removeAllJobs(true, 5000);
+}
+
+//==============================================================================
+void SampleImporter::importFiles(const juce::StringArray& pathsOrFolders)
+{
+    if (pathsOrFolders.isEmpty())
+        return;
+
+    // A new import starts the throughput figures over; files added to a running one join it
+    if (!isImporting())
+    {
+        const juce::ScopedLock sl(queuedLock);
+        numQueued = 0;
+        numFinished = 0;
+        numFailed = 0;
+        bytesDecoded = 0;
+        startTime = juce::Time::getMillisecondCounterHiRes();
+    }
+
+    if (pool == nullptr)
+        pool = std::make_unique<juce::ThreadPool>(juce::SystemStats::getNumCpus());
+
+    finishPending = true;
+    ++numScans;
+
+    const int gen = generation.load();
+    juce::WeakReference<SampleImporter> weak(this);
+
+    // The importer waits for its jobs before it goes, so `this` is safe on the pool
+    pool->addJob([this, weak, pathsOrFolders, gen]
+        {
+            scanAndQueue(pathsOrFolders, gen);
+
+            juce::MessageManager::callAsync([weak]
+                {
+                    if (weak != nullptr)
+                        weak->checkFinished();
+                });
+        });
+}
+
+void SampleImporter::cancel()
+{
+    {
+        const juce::ScopedLock sl(queuedLock);
+        ++generation;
+
+        // Files that were only queued may be dropped again later
+        queuedPaths.clearQuick();
+        for (auto* sample : samples)
+            queuedPaths.add(sample->file.getFullPathName());
+
+        numScans = 0;
+        numQueued = numFinished.load();
+        endTime = juce::Time::getMillisecondCounterHiRes();
+    }
+
+    if (pool != nullptr)
+        pool->removeAllJobs(true, 0);
+
+    checkFinished();
+}
+
+void SampleImporter::clear()
+{
+    cancel();
+
+    {
+        const juce::ScopedLock sl(queuedLock);
+        queuedPaths.clearQuick();
+        samples.clear();
+    }
+
+    loader.releaseUnusedAudio();
+}
+
+SampleImporter::Progress SampleImporter::getProgress() const
+{
+    Progress progress;
+    progress.numQueued = numQueued.load();
+    progress.numFinished = numFinished.load();
+    progress.numFailed = numFailed.load();
+    progress.bytesDecoded = bytesDecoded.load();
+
+    const double end = isImporting() ? juce::Time::getMillisecondCounterHiRes() : endTime.load();
+    progress.seconds = juce::jmax(0.0, end - startTime.load()) * 0.001;
+    return progress;
+}
+
+//==============================================================================
+void SampleImporter::scanAndQueue(const juce::StringArray& pathsOrFolders, int importGeneration)
+{
+    const auto wildcard = loader.getWildcardForAllFormats();
+    juce::WeakReference<SampleImporter> weak(this);
+
+    auto queue = [&](const juce::File& file)
+    {
+        const juce::ScopedLock sl(queuedLock);
+
+        if (generation.load() != importGeneration || queuedPaths.contains(file.getFullPathName()))
+            return;
+
+        queuedPaths.add(file.getFullPathName());
+        ++numQueued;
+
+        pool->addJob([this, weak, file, importGeneration]
+            {
+                auto sample = importFile(file, importGeneration);
+
+                {
+                    const juce::ScopedLock counterLock(queuedLock);
+
+                    if (generation.load() != importGeneration)
+                        return;
+
+                    if (sample == nullptr)
+                        ++numFailed;
+                    else
+                        bytesDecoded += sample->lengthInSamples * sample->numChannels * (long long)sizeof(float);
+
+                    if (++numFinished == numQueued.load() && numScans.load() == 0)
+                        endTime = juce::Time::getMillisecondCounterHiRes();
+                }
+
+                juce::MessageManager::callAsync([weak, file, sample, importGeneration]
+                    {
+                        if (weak != nullptr)
+                        {
+                            if (sample == nullptr)
+                            {
+                                // Not listed, so dropping it again retries
+                                const juce::ScopedLock pathLock(weak->queuedLock);
+                                weak->queuedPaths.removeString(file.getFullPathName());
+                            }
+
+                            weak->sampleFinished(sample, importGeneration);
+                        }
+                    });
+            });
+    };
+
+    for (const auto& path : pathsOrFolders)
+    {
+        if (generation.load() != importGeneration)
+            break;
+
+        const juce::File item(path);
+
+        if (item.isDirectory())
+        {
+            for (const auto& entry : juce::RangedDirectoryIterator(item, true, wildcard, juce::File::findFiles))
+            {
+                if (generation.load() != importGeneration)
+                    break;
+
+                queue(entry.getFile());
+            }
+        }
+        else if (item.existsAsFile())
+        {
+            queue(item);
+        }
+    }
+
+    const juce::ScopedLock sl(queuedLock);
+
+    if (generation.load() == importGeneration && --numScans == 0 && numFinished.load() == numQueued.load())
+        endTime = juce::Time::getMillisecondCounterHiRes();
+}
+
+ImportedSample::Ptr SampleImporter::importFile(const juce::File& file, int importGeneration)
+{
+    auto loaded = loader.load(file, [this, importGeneration] { return generation.load() != importGeneration; });
+
+    if (loaded == nullptr || loaded->overview == nullptr)
+        return nullptr;
+
+    ImportedSample::Ptr sample = new ImportedSample();
+    sample->file = file;
+    sample->store = loaded->store;
+    sample->nativeStore = loaded->nativeStore;
+    sample->overview = loaded->overview;
+    sample->sampleRate = loaded->sampleRate;
+    sample->lengthInSamples = loaded->lengthInSamples;
+
+    if (const auto* native = sample->nativeStore.get())
+    {
+        // Exact figures from the decoded samples, expanded a chunk at a time if compact
+        const int numChannels = native->getNumChannels();
+        const int numSamples = native->getNumSamples();
+        std::vector<float> chunk(native->isCompact() ? (size_t)statsChunkSamples : 0);
+        double sumOfSquares = 0.0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            for (int pos = 0; pos < numSamples; pos += statsChunkSamples)
+            {
+                const int num = juce::jmin(statsChunkSamples, numSamples - pos);
+                const float* data = native->getFloatData(ch);
+
+                if (data != nullptr)
+                {
+                    data += pos;
+                }
+                else
+                {
+                    native->read(ch, pos, num, chunk.data());
+                    data = chunk.data();
+                }
+
+                const auto range = juce::FloatVectorOperations::findMinAndMax(data, num);
+                sample->peak = juce::jmax(sample->peak, std::abs(range.getStart()), std::abs(range.getEnd()));
+
+                for (int i = 0; i < num; ++i)
+                    sumOfSquares += (double)data[i] * (double)data[i];
+            }
+        }
+
+        sample->numChannels = numChannels;
+        sample->rms = (float)std::sqrt(sumOfSquares / juce::jmax(1.0, (double)numChannels * numSamples));
+    }
+    else
+    {
+        // Streamed: the whole-file peak of the overview's coarsest level is close enough
+        const auto& overview = *sample->overview;
+        const auto whole = overview.getPeak(overview.getNumLevels() - 1, 0, overview.getTotalSamples());
+
+        sample->numChannels = loaded->displayReader != nullptr ? (int)loaded->displayReader->numChannels : 0;
+        sample->peak = juce::jmax(std::abs(whole.minValue), std::abs(whole.maxValue));
+        sample->rms = whole.rms;
+    }
+
+    return sample;
+}
+
+//==============================================================================
+void SampleImporter::sampleFinished(ImportedSample::Ptr sample, int importGeneration)
+{
+    if (sample != nullptr && importGeneration == generation.load())
+    {
+        samples.add(sample);
+        library->addFile(sample->file, sample->sampleRate, sample->lengthInSamples, sample->numChannels, *sample->overview);
+
+        if (onSampleImported)
+            onSampleImported(sample);
+    }
+
+    checkFinished();
+}
+
+void SampleImporter::checkFinished()
+{
+    if (!finishPending || isImporting())
+        return;
+
+    finishPending = false;
+
+    if (onImportFinished)
+        onImportFinished();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include "AudioFileLoader.h"
+#include "SampleLibrary.h"
+
+/**
+ * ImportedSample
+ *
+ * One entry of the sample list: the decoded audio, its peak pyramid and a few
+ * statistics measured during import. Immutable once imported, so the message
+ * thread and the player can share it freely.
+ */
+struct ImportedSample : public juce::ReferenceCountedObject
+{
+    using Ptr = juce::ReferenceCountedObjectPtr<ImportedSample>;
+
+    juce::File            file;
+    SampleStore::Ptr      store;          ///< Samples for playback, at the target rate (null if too large for RAM)
+    SampleStore::Ptr      nativeStore;    ///< Decoded samples at the file's own rate
+    WaveformOverview::Ptr overview;
+
+    double    sampleRate = 0.0;           ///< The file's own rate
+    long long lengthInSamples = 0;
+    int       numChannels = 0;
+
+    float peak = 0.0f;                    ///< Largest absolute sample value
+    float rms = 0.0f;                     ///< RMS level over the whole file (all channels)
+
+    double getLengthInSeconds() const { return sampleRate > 0.0 ? (double)lengthInSamples / sampleRate : 0.0; }
+
+    /** True if the entry can be switched to without any disk access. */
+    bool isResident() const { return store != nullptr; }
+};
+
+//==============================================================================
+/**
+ * SampleImporter
+ *
+ * Imports many files at once into an in-plugin sample list:
+ *  - Dropped folders are scanned recursively for every format the loader opens,
+ *  - One job per file runs on a pool with a thread per core; each job decodes the
+ *    file (through the DecodedAudioCache, converted to the target rate), builds
+ *    its peak pyramid (or takes it from the PeakCache) and measures peak and RMS.
+ *    The pool is created by the first import, so instances that never import
+ *    hold no threads,
+ *  - Finished entries are handed to the message thread one by one, in the order
+ *    they complete, so the list fills while the rest is still decoding, and are
+ *    indexed in the SampleLibrary.
+ *
+ * Files larger than the loader's RAM-resident limit are listed with their
+ * overview and statistics only; they are streamed when switched to. Resident
+ * entries keep their audio in RAM while they are listed; clear() releases it.
+ *
+ * getProgress() and the settings (setTargetSampleRate() and the setters after it)
+ * may be called from any thread; everything else is message-thread only.
+ */
+class SampleImporter
+{
+public:
+    SampleImporter();
+    ~SampleImporter();
+
+    /**
+     * Adds the files, and the audio files inside any folders, to the import queue.
+     * Files already in the list or queued are skipped. The folder scan itself runs on
+     * the pool, so dropping a large library does not block the message thread.
+     */
+    void importFiles(const juce::StringArray& pathsOrFolders);
+
+    /** Stops the import: queued files are dropped, entries already imported are kept. */
+    void cancel();
+
+    /** Removes every entry (cancelling any import in progress) and releases their audio. */
+    void clear();
+
+    bool isImporting() const { return numQueued.load() > numFinished.load() || numScans.load() > 0; }
+
+    /** Counters of the current import, for progress and throughput display (any thread). */
+    struct Progress
+    {
+        int       numQueued = 0;
+        int       numFinished = 0;        ///< Imported or failed
+        int       numFailed = 0;
+        long long bytesDecoded = 0;       ///< Decoded audio, as 32-bit float
+        double    seconds = 0.0;          ///< Since the import started
+
+        double getFilesPerSecond()     const { return seconds > 0.0 ? numFinished / seconds : 0.0; }
+        double getMegabytesPerSecond() const { return seconds > 0.0 ? (double)bytesDecoded / (1024.0 * 1024.0) / seconds : 0.0; }
+    };
+
+    Progress getProgress() const;
+
+    //==============================================================================
+    const juce::ReferenceCountedArray<ImportedSample>& getSamples() const { return samples; }
+
+    /** Called on the message thread for each entry added to the list. */
+    std::function<void(ImportedSample::Ptr)> onSampleImported;
+
+    /** Called on the message thread once every queued file has been imported or has failed. */
+    std::function<void()> onImportFinished;
+
+    //==============================================================================
+    // Settings: any thread (they are atomics in the loader, read once per file), so the
+    // processor can set the rate from prepareToPlay. Imports already running keep the
+    // value they started the file with.
+    //==============================================================================
+    /** Rate resident entries are converted to, normally the device rate (0: keep each file's rate). */
+    void setTargetSampleRate(double rate) { loader.setTargetSampleRate(rate); }
+
+    /** Files whose decoded size exceeds this are listed but not held in RAM. */
+    void setRamResidentLimitBytes(long long numBytes) { loader.setRamResidentLimitBytes(numBytes); }
+
+    /** How resident entries are held in RAM (see AudioFileLoader::CompactStorage). */
+    void setCompactStorage(AudioFileLoader::CompactStorage mode) { loader.setCompactStorage(mode); }
+
+private:
+    /** Pool side of importFiles(): expands folders, then queues one job per file. */
+    void scanAndQueue(const juce::StringArray& pathsOrFolders, int importGeneration);
+
+    /** Message thread: adds a finished entry, or counts a failure. */
+    void sampleFinished(ImportedSample::Ptr sample, int importGeneration);
+
+    /** Worker: decodes one file and measures it. Returns nullptr on failure or cancel. */
+    ImportedSample::Ptr importFile(const juce::File& file, int importGeneration);
+
+    /** Message thread: calls onImportFinished once nothing is left to do. */
+    void checkFinished();
+
+    //==============================================================================
+    AudioFileLoader                   loader;
+    std::unique_ptr<juce::ThreadPool> pool;   ///< Created by the first importFiles()
+    juce::SharedResourcePointer<SampleLibrary> library;
+
+    juce::ReferenceCountedArray<ImportedSample> samples;
+
+    // Paths queued or imported, so a file dropped twice is only imported once. The lock
+    // also keeps the counters consistent with cancel(), which resets them.
+    juce::CriticalSection   queuedLock;
+    juce::StringArray       queuedPaths;
+
+    std::atomic<int>        generation{ 0 };
+    std::atomic<int>        numScans{ 0 };
+    std::atomic<int>        numQueued{ 0 };
+    std::atomic<int>        numFinished{ 0 };
+    std::atomic<int>        numFailed{ 0 };
+    std::atomic<long long>  bytesDecoded{ 0 };
+    std::atomic<double>     startTime{ 0.0 };
+    std::atomic<double>     endTime{ 0.0 };
+    bool                    finishPending = false;   ///< onImportFinished still to be called (message thread)
+
+    static constexpr int statsChunkSamples = 65536;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(SampleImporter)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleImporter)
+};
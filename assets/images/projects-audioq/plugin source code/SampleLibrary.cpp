@@ -0,0 +1,469 @@
+#include "SampleLibrary.h"
+#include "PeakCache.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * SampleLibrary.cpp
+ *
+ * Opening the mapped index, appending entries, the sorted indices and queries,
+ * and the overview analysis that fills in an entry's levels, tempo and thumbnail.
+ */
+
+namespace
+{
+    const char libraryMagic[4] = { 'A', 'Q', 'L', 'B' };
+    constexpr juce::int64 headerBytes = 16;
+}
+
+//==============================================================================
+SampleLibrary::SampleLibrary()
+    : SampleLibrary(getDefaultDirectory())
+{
+}
+
+SampleLibrary::SampleLibrary(const juce::File& directory)
+    : recordsFile(directory.getChildFile("SampleLibrary.aqlb")),
+      pathsFile(directory.getChildFile("SampleLibrary.aqls"))
+{
+    static_assert(sizeof(Record) == 160, "Record must match the on-disk layout");
+    open();
+}
+
+juce::File SampleLibrary::getDefaultDirectory()
+{
+    // Beside the PeakCache folder
+    return PeakCache::getCacheDirectory().getParentDirectory();
+}
+
+//==============================================================================
+void SampleLibrary::open()
+{
+   #if JUCE_BIG_ENDIAN
+    // Records are used in place from the map, which assumes a little-endian host;
+    // the library then only lives in memory
+    return;
+   #else
+    if (!recordsFile.existsAsFile())
+        return;
+
+    auto startAfresh = [this]
+    {
+        recordsMap = nullptr;
+        recordsCopy.reset();
+        mappedRecords = nullptr;
+        recordsFile.deleteFile();
+        pathsFile.deleteFile();
+    };
+
+    const auto recordsSize = recordsFile.getSize();
+
+    // A record cut short by a crash is dropped, so the next append lines up again
+    const auto wholeRecords = (recordsSize - headerBytes) / (juce::int64)sizeof(Record);
+    if (recordsSize >= headerBytes && headerBytes + wholeRecords * (juce::int64)sizeof(Record) != recordsSize)
+    {
+        juce::FileOutputStream out(recordsFile);
+        if (!out.openedOk() || !out.setPosition(headerBytes + wholeRecords * (juce::int64)sizeof(Record)) || out.truncate().failed())
+        {
+            startAfresh();
+            return;
+        }
+    }
+
+    // Foreign or older files are replaced, not read
+    numMappedRecords = mapRecords();
+    if (numMappedRecords < 0)
+    {
+        numMappedRecords = 0;
+        startAfresh();
+        return;
+    }
+
+    // Paths are only needed once, to build the index
+    juce::MemoryMappedFile pathsMap(pathsFile, juce::MemoryMappedFile::readOnly);
+    const auto* pathData = static_cast<const char*>(pathsMap.getData());
+
+    rows.reserve((size_t)numMappedRecords);
+    paths.reserve((size_t)numMappedRecords);
+    names.reserve((size_t)numMappedRecords);
+
+    for (int i = 0; i < numMappedRecords; ++i)
+    {
+        const auto& record = mappedRecords[i];
+
+        // A record whose path is missing is kept (indices must match the file) but never listed
+        const bool pathOk = pathData != nullptr && record.pathOffset >= 0 && record.pathBytes > 0
+            && record.pathOffset + record.pathBytes <= (juce::int64)pathsMap.getSize();
+
+        indexRecord(record, pathOk ? juce::String::fromUTF8(pathData + record.pathOffset, record.pathBytes) : juce::String(), false);
+    }
+
+    // One stable sort per key, so ties stay in the order they were added
+    for (int key = 1; key < numSortKeys; ++key)
+    {
+        auto& order = sorted[(size_t)key];
+        std::stable_sort(order.begin(), order.end(),
+            [this, key](int a, int b) { return sortsBefore((SortKey)key, a, b); });
+    }
+   #endif
+}
+
+int SampleLibrary::mapRecords()
+{
+    mappedRecords = nullptr;
+    recordsCopy.reset();
+
+    recordsMap = std::make_unique<juce::MemoryMappedFile>(recordsFile, juce::MemoryMappedFile::readOnly);
+    const auto* data = static_cast<const char*>(recordsMap->getData());
+    auto size = (juce::int64)recordsMap->getSize();
+
+    if (data == nullptr)
+    {
+        recordsMap = nullptr;
+
+        if (recordsFile.existsAsFile() && recordsFile.loadFileAsData(recordsCopy))
+        {
+            data = static_cast<const char*>(recordsCopy.getData());
+            size = (juce::int64)recordsCopy.getSize();
+        }
+    }
+
+    if (data == nullptr || size < headerBytes
+        || std::memcmp(data, libraryMagic, 4) != 0
+        || (int)juce::ByteOrder::littleEndianInt(data + 4) != formatVersion
+        || (int)juce::ByteOrder::littleEndianInt(data + 8) != (int)sizeof(Record))
+    {
+        recordsMap = nullptr;
+        recordsCopy.reset();
+        return -1;
+    }
+
+    mappedRecords = reinterpret_cast<const Record*>(data + headerBytes);
+    return (int)((size - headerBytes) / (juce::int64)sizeof(Record));
+}
+
+bool SampleLibrary::appendToFiles(Record& record, const juce::String& path)
+{
+    if (!recordsFile.getParentDirectory().createDirectory().wasOk())
+        return false;
+
+    // Path first, then the record that points at it, so a crash in between leaves no dangling record
+    auto utf8 = path.toUTF8();
+    const int pathBytes = (int)utf8.sizeInBytes() - 1;
+
+    {
+        juce::FileOutputStream pathsOut(pathsFile);
+        if (!pathsOut.openedOk())
+            return false;
+
+        record.pathOffset = pathsOut.getPosition();
+        record.pathBytes = pathBytes;
+
+        if (!pathsOut.write(utf8.getAddress(), (size_t)pathBytes))
+            return false;
+
+        pathsOut.flush();
+        if (pathsOut.getStatus().failed())
+            return false;
+    }
+
+    juce::FileOutputStream out(recordsFile);
+    if (!out.openedOk())
+        return false;
+
+    if (out.getPosition() == 0)
+    {
+        if (!out.write(libraryMagic, 4) || !out.writeInt(formatVersion)
+            || !out.writeInt((int)sizeof(Record)) || !out.writeInt(0))
+            return false;
+    }
+
+    // Anywhere but right after the last record the file has changed under us
+    if (out.getPosition() != headerBytes + (juce::int64)numMappedRecords * (juce::int64)sizeof(Record))
+        return false;
+
+    if (!out.write(&record, sizeof(Record)))
+        return false;
+
+    out.flush();
+    return !out.getStatus().failed();
+}
+
+void SampleLibrary::addFile(const juce::File& file, double sampleRate, long long lengthInSamples,
+    int numChannels, const WaveformOverview& overview)
+{
+    if (sampleRate <= 0.0 || lengthInSamples <= 0 || overview.isEmpty())
+        return;
+
+    const auto path = file.getFullPathName();
+    const auto fileSize = file.getSize();
+    const auto modTime = file.getLastModificationTime().toMilliseconds();
+
+    if (latestByPath.contains(path))
+    {
+        const auto& existing = getRecord(latestByPath[path]);
+        if (existing.fileSize == fileSize && existing.modTime == modTime)
+            return;
+    }
+
+    Record record;
+    std::memset(&record, 0, sizeof(Record));
+    record.fileSize = fileSize;
+    record.modTime = modTime;
+    record.lengthInSamples = lengthInSamples;
+    record.sampleRate = sampleRate;
+    record.numChannels = numChannels;
+
+    // Whole-file levels from the coarsest level: a handful of peaks
+    const auto whole = overview.getPeak(overview.getNumLevels() - 1, 0, overview.getTotalSamples());
+    record.peak = juce::jmax(std::abs(whole.minValue), std::abs(whole.maxValue));
+    record.rms = whole.rms;
+    record.tempo = estimateTempo(overview, sampleRate);
+
+    const double samplesPerPoint = (double)overview.getTotalSamples() / thumbnailPoints;
+    const int thumbnailLevel = overview.findLevelFor(samplesPerPoint);
+
+    for (int p = 0; p < thumbnailPoints; ++p)
+    {
+        const auto point = overview.getPeak(thumbnailLevel, (long long)(p * samplesPerPoint), (long long)((p + 1) * samplesPerPoint));
+        record.thumbnail[p * 2] = (juce::int8)juce::roundToInt(juce::jlimit(-1.0f, 1.0f, point.minValue) * 127.0f);
+        record.thumbnail[p * 2 + 1] = (juce::int8)juce::roundToInt(juce::jlimit(-1.0f, 1.0f, point.maxValue) * 127.0f);
+    }
+
+   #if ! JUCE_BIG_ENDIAN
+    if (!appendFailed)
+    {
+        // Windows will not open a mapped file for writing, so the map is dropped for the append
+        recordsMap = nullptr;
+        recordsCopy.reset();
+        mappedRecords = nullptr;
+
+        const bool appended = appendToFiles(record, path);
+        const int numOnDisk = mapRecords();
+
+        // Cut short or replaced behind our back: the rows would read past the map, so index it again
+        if (numMappedRecords > 0 && numOnDisk < numMappedRecords)
+        {
+            rows.clear();
+            paths.clear();
+            names.clear();
+            latestByPath.clear();
+            appendedRecords.clear();
+
+            for (auto& order : sorted)
+                order.clear();
+
+            numMappedRecords = 0;
+            open();
+        }
+        else if (appended && numOnDisk > numMappedRecords)
+        {
+            ++numMappedRecords;
+            indexRecord(mappedRecords[numMappedRecords - 1], path, true);
+            sendChangeMessage();
+            return;
+        }
+
+        appendFailed = true;
+    }
+   #endif
+
+    appendedRecords.push_back(record);
+    indexRecord(appendedRecords.back(), path, true);
+
+    sendChangeMessage();
+}
+
+//==============================================================================
+void SampleLibrary::indexRecord(const Record& record, const juce::String& path, bool keepSorted)
+{
+    const int index = (int)rows.size();
+
+    Row row;
+    row.seconds = record.sampleRate > 0.0 ? (float)((double)record.lengthInSamples / record.sampleRate) : 0.0f;
+    row.sampleRate = (float)record.sampleRate;
+    row.peakDb = juce::Decibels::gainToDecibels(record.peak);
+    row.tempo = record.tempo;
+    row.numChannels = (juce::int16)record.numChannels;
+    row.live = path.isNotEmpty();
+
+    rows.push_back(row);
+    paths.push_back(path);
+    names.push_back(juce::File(path).getFileName().toLowerCase());
+
+    // A newer record of the same file supersedes the older one
+    if (row.live)
+    {
+        if (latestByPath.contains(path))
+            rows[(size_t)latestByPath[path]].live = false;
+
+        latestByPath.set(path, index);
+    }
+
+    for (int key = 1; key < numSortKeys; ++key)
+    {
+        auto& order = sorted[(size_t)key];
+
+        if (keepSorted)
+        {
+            auto pos = std::upper_bound(order.begin(), order.end(), index,
+                [this, key](int a, int b) { return sortsBefore((SortKey)key, a, b); });
+            order.insert(pos, index);
+        }
+        else
+        {
+            order.push_back(index);
+        }
+    }
+}
+
+const SampleLibrary::Record& SampleLibrary::getRecord(int index) const
+{
+    return index < numMappedRecords ? mappedRecords[index] : appendedRecords[(size_t)(index - numMappedRecords)];
+}
+
+SampleLibrary::Entry SampleLibrary::getEntry(int index) const
+{
+    jassert(juce::isPositiveAndBelow(index, getNumEntries()));
+
+    const auto& record = getRecord(index);
+
+    Entry entry;
+    entry.file = paths[(size_t)index].isNotEmpty() ? juce::File(paths[(size_t)index]) : juce::File();
+    entry.sampleRate = record.sampleRate;
+    entry.lengthInSamples = record.lengthInSamples;
+    entry.numChannels = record.numChannels;
+    entry.peak = record.peak;
+    entry.rms = record.rms;
+    entry.tempo = record.tempo;
+    entry.thumbnail = record.thumbnail;
+    return entry;
+}
+
+bool SampleLibrary::sortsBefore(SortKey key, int a, int b) const
+{
+    const auto& ra = rows[(size_t)a];
+    const auto& rb = rows[(size_t)b];
+
+    switch (key)
+    {
+        case SortKey::name:         return names[(size_t)a] < names[(size_t)b];
+        case SortKey::duration:     return ra.seconds < rb.seconds;
+        case SortKey::sampleRate:   return ra.sampleRate < rb.sampleRate;
+        case SortKey::numChannels:  return ra.numChannels < rb.numChannels;
+        case SortKey::peak:         return ra.peakDb < rb.peakDb;
+        case SortKey::tempo:        return ra.tempo < rb.tempo;
+        case SortKey::dateAdded:
+        default:                    return a < b;
+    }
+}
+
+//==============================================================================
+void SampleLibrary::query(const Query& q, std::vector<int>& results) const
+{
+    results.clear();
+
+    const float minSeconds = (float)q.minSeconds;
+    const float maxSeconds = (float)juce::jmin(q.maxSeconds, (double)std::numeric_limits<float>::max());
+    const float sampleRate = (float)q.sampleRate;
+
+    auto matches = [&](const Row& row)
+    {
+        return row.live
+            && row.seconds >= minSeconds && row.seconds <= maxSeconds
+            && (q.sampleRate <= 0.0 || row.sampleRate == sampleRate)
+            && (q.numChannels <= 0 || row.numChannels == q.numChannels)
+            && row.peakDb >= q.minPeakDb && row.peakDb <= q.maxPeakDb
+            && row.tempo >= q.minTempo && row.tempo <= q.maxTempo;
+    };
+
+    const int n = (int)rows.size();
+    const int* order = q.sortBy == SortKey::dateAdded ? nullptr : sorted[(size_t)q.sortBy].data();
+
+    // One pass in sort order over the packed rows; no sorting at query time
+    for (int i = 0; i < n && (int)results.size() < q.maxResults; ++i)
+    {
+        const int position = q.descending ? n - 1 - i : i;
+        const int index = order != nullptr ? order[position] : position;
+
+        if (matches(rows[(size_t)index]))
+            results.push_back(index);
+    }
+}
+
+//==============================================================================
+float SampleLibrary::estimateTempo(const WaveformOverview& overview, double sampleRate)
+{
+    // The finest level with peaks at least 5 ms apart gives an envelope of up to 200 Hz
+    int levelIndex = -1;
+    for (int i = 0; i < overview.getNumLevels() && levelIndex < 0; ++i)
+        if ((double)overview.getLevel(i).samplesPerPeak >= sampleRate * 0.005)
+            levelIndex = i;
+
+    if (levelIndex < 0)
+        return 0.0f;
+
+    const auto& level = overview.getLevel(levelIndex);
+    const double hopSeconds = (double)level.samplesPerPeak / sampleRate;
+
+    // Too coarse to resolve beats, or too short to hold a few of them
+    if (hopSeconds > 0.025)
+        return 0.0f;
+
+    const int numPeaks = (int)juce::jmin(level.numPeaks, (size_t)(60.0 / hopSeconds));
+    if (numPeaks * hopSeconds < 6.0)
+        return 0.0f;
+
+    // Onset strength: rises of the RMS envelope
+    const auto* peaks = overview.getPeaks(levelIndex);
+    std::vector<float> onsets((size_t)numPeaks, 0.0f);
+
+    for (int i = 1; i < numPeaks; ++i)
+        onsets[(size_t)i] = (float)juce::jmax(0, (int)peaks[i].rms - (int)peaks[i - 1].rms);
+
+    // Autocorrelation over the lags of 60..180 BPM
+    const int minLag = juce::jmax(1, (int)std::floor(60.0 / 180.0 / hopSeconds));
+    const int maxLag = juce::jmin(numPeaks / 2, (int)std::ceil(60.0 / 60.0 / hopSeconds));
+    if (maxLag <= minLag + 1)
+        return 0.0f;
+
+    std::vector<double> correlation((size_t)(maxLag + 2), 0.0);
+    double sum = 0.0;
+
+    for (int lag = minLag; lag <= maxLag + 1; ++lag)
+    {
+        double c = 0.0;
+        for (int i = 0; i + lag < numPeaks; ++i)
+            c += (double)onsets[(size_t)i] * onsets[(size_t)(i + lag)];
+
+        correlation[(size_t)lag] = c / (double)(numPeaks - lag);
+
+        if (lag <= maxLag)
+            sum += correlation[(size_t)lag];
+    }
+
+    int best = minLag;
+    for (int lag = minLag + 1; lag <= maxLag; ++lag)
+        if (correlation[(size_t)lag] > correlation[(size_t)best])
+            best = lag;
+
+    // No clear periodicity: better no tempo than a made-up one
+    const double mean = sum / (double)(maxLag - minLag + 1);
+    if (mean <= 0.0 || correlation[(size_t)best] < mean * 1.5)
+        return 0.0f;
+
+    // Parabolic interpolation between lags for a finer estimate
+    double lag = (double)best;
+    if (best > minLag)
+    {
+        const double l = correlation[(size_t)(best - 1)];
+        const double c = correlation[(size_t)best];
+        const double r = correlation[(size_t)(best + 1)];
+        const double denominator = l - 2.0 * c + r;
+
+        if (denominator < 0.0)
+            lag += 0.5 * (l - r) / denominator;
+    }
+
+    return (float)(60.0 / (lag * hopSeconds));
+}
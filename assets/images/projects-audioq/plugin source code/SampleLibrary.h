@@ -0,0 +1,187 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <deque>
+#include <limits>
+#include <vector>
+#include "WaveformOverview.h"
+
+/**
+ * SampleLibrary
+ *
+ * A persistent index of every file loaded into the plugin, for finding samples
+ * by duration, sample rate, channel count, peak level and tempo without opening
+ * any audio. Use it through juce::SharedResourcePointer<SampleLibrary>, so every
+ * instance in the process shares one index.
+ *
+ * On disk it is two append-only files next to the PeakCache:
+ *  - SampleLibrary.aqlb: a 16-byte header ("AQLB", version, record size), then one
+ *    fixed-size Record per file, memory-mapped in place on open,
+ *  - SampleLibrary.aqls: the UTF-8 paths the records point into.
+ * Adding a file appends one path and one record; nothing is ever rewritten. A file
+ * indexed again after being edited (new size or modification time) gets a new
+ * record, which supersedes the old one. The map is dropped for each append and
+ * taken again after it, since Windows will not write a file that is mapped. If an
+ * append fails, that entry and every later one are kept in memory only, so the
+ * file always holds a prefix of the index.
+ *
+ * Queries run against a compact in-memory row per entry plus one index per sort
+ * key kept sorted as entries are added, so filtering and sorting 100k entries is a
+ * single pass over a couple of megabytes and takes well under a millisecond.
+ *
+ * Message thread only. Broadcasts a change whenever an entry is added.
+ */
+class SampleLibrary : public juce::ChangeBroadcaster
+{
+public:
+    /** Points in each entry's thumbnail overview. */
+    static constexpr int thumbnailPoints = 48;
+
+    /** Opens (or creates) the library in the default location. */
+    SampleLibrary();
+
+    /** Opens (or creates) the library in this folder. */
+    explicit SampleLibrary(const juce::File& directory);
+
+    //==============================================================================
+    /**
+     * Indexes a file that has just been loaded. Peak, RMS, tempo and the thumbnail
+     * are taken from its overview, so no audio is read. Files already indexed with
+     * the same size and modification time are skipped.
+     */
+    void addFile(const juce::File& file, double sampleRate, long long lengthInSamples,
+        int numChannels, const WaveformOverview& overview);
+
+    /** Number of indexed entries, including superseded ones (valid indices for getEntry). */
+    int getNumEntries() const { return (int)rows.size(); }
+
+    struct Entry
+    {
+        juce::File  file;
+        double      sampleRate = 0.0;
+        long long   lengthInSamples = 0;
+        int         numChannels = 0;
+        float       peak = 0.0f;                 ///< Linear, whole file
+        float       rms = 0.0f;                  ///< Linear, whole file
+        float       tempo = 0.0f;                ///< Estimated BPM, 0 if none was found
+        const juce::int8* thumbnail = nullptr;   ///< thumbnailPoints { min, max } pairs scaled to +-127
+
+        double getLengthInSeconds() const { return sampleRate > 0.0 ? (double)lengthInSamples / sampleRate : 0.0; }
+    };
+
+    /** The entry at this index. The thumbnail stays valid until the next addFile(). */
+    Entry getEntry(int index) const;
+
+    //==============================================================================
+    enum class SortKey
+    {
+        dateAdded = 0,
+        name,
+        duration,
+        sampleRate,
+        numChannels,
+        peak,
+        tempo
+    };
+
+    /** Filter ranges are inclusive. A tempo range starting at 0 includes files with no tempo. */
+    struct Query
+    {
+        double minSeconds = 0.0;
+        double maxSeconds = std::numeric_limits<double>::max();
+        double sampleRate = 0.0;                 ///< 0: any
+        int    numChannels = 0;                  ///< 0: any
+        float  minPeakDb = -std::numeric_limits<float>::max();
+        float  maxPeakDb = std::numeric_limits<float>::max();
+        float  minTempo = 0.0f;
+        float  maxTempo = std::numeric_limits<float>::max();
+
+        SortKey sortBy = SortKey::dateAdded;
+        bool    descending = false;
+        int     maxResults = std::numeric_limits<int>::max();
+    };
+
+    /**
+     * Fills `results` with the indices of the live entries matching the query, in
+     * its sort order. Reuse the vector between queries to avoid allocating.
+     */
+    void query(const Query& query, std::vector<int>& results) const;
+
+    /** The folder the library files are kept in by default. */
+    static juce::File getDefaultDirectory();
+
+private:
+    /** One entry as stored on disk (little-endian, used in place from the map). */
+    struct Record
+    {
+        juce::int64 fileSize;
+        juce::int64 modTime;
+        juce::int64 lengthInSamples;
+        juce::int64 pathOffset;                  ///< Into the paths file
+        double      sampleRate;
+        juce::int32 pathBytes;
+        juce::int32 numChannels;
+        float       peak;
+        float       rms;
+        float       tempo;
+        juce::int32 reserved;
+        juce::int8  thumbnail[thumbnailPoints * 2];
+    };
+
+    /** What queries look at, packed tightly so a scan stays in cache. */
+    struct Row
+    {
+        float       seconds;
+        float       sampleRate;
+        float       peakDb;
+        float       tempo;
+        juce::int16 numChannels;
+        bool        live;                        ///< False once superseded by a newer record
+    };
+
+    static constexpr int numSortKeys = 7;
+
+    /** Maps the files and rebuilds the in-memory index; starts afresh if they are unreadable. */
+    void open();
+
+    /**
+     * Maps the records file (or reads it, if it cannot be mapped) and returns the
+     * number of whole records in it, or -1 if it is missing or not a library file.
+     */
+    int mapRecords();
+
+    /** Appends the path, then the record pointing at it; false if anything failed. */
+    bool appendToFiles(Record& record, const juce::String& path);
+
+    /** Adds a record (mapped or just appended) to the rows and the sorted indices. */
+    void indexRecord(const Record& record, const juce::String& path, bool keepSorted);
+
+    const Record& getRecord(int index) const;
+
+    /** True if entry a sorts before entry b on this key (ties in order added). */
+    bool sortsBefore(SortKey key, int a, int b) const;
+
+    /** Estimates the tempo from the overview's RMS envelope, 0 if it finds no clear beat. */
+    static float estimateTempo(const WaveformOverview& overview, double sampleRate);
+
+    //==============================================================================
+    juce::File recordsFile, pathsFile;
+
+    std::unique_ptr<juce::MemoryMappedFile> recordsMap;
+    juce::MemoryBlock  recordsCopy;              ///< The records file, if it could not be mapped
+    const Record*      mappedRecords = nullptr;
+    int                numMappedRecords = 0;
+    std::deque<Record> appendedRecords;          ///< Kept in memory only, after an append failed
+    bool               appendFailed = false;
+
+    std::vector<Row>          rows;
+    std::vector<juce::String> paths;
+    std::vector<juce::String> names;             ///< Lower-case file names, for sorting by name
+    std::array<std::vector<int>, numSortKeys> sorted;   ///< Entry indices per sort key (dateAdded unused)
+    juce::HashMap<juce::String, int> latestByPath;
+
+    static constexpr int formatVersion = 1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleLibrary)
+};
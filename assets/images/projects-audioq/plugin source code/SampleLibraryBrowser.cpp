@@ -0,0 +1,200 @@
+#include "SampleLibraryBrowser.h"
+
+/**
+ * SampleLibraryBrowser.cpp
+ *
+ * Sets up the sort and filter controls, turns them into a SampleLibrary::Query,
+ * and draws each row from the index: thumbnail, name and figures.
+ */
+
+SampleLibraryBrowser::SampleLibraryBrowser()
+{
+    // Sort order (item IDs are SortKey values + 1)
+    addAndMakeVisible(sortBox);
+    sortBox.addItemList({ "Recently added", "Name", "Duration", "Sample rate", "Channels", "Peak", "Tempo" }, 1);
+    sortBox.setSelectedId(1, juce::dontSendNotification);
+    sortBox.onChange = [this] { refresh(); };
+
+    addAndMakeVisible(descendingButton);
+    descendingButton.setToggleState(true, juce::dontSendNotification);
+    descendingButton.onClick = [this] { refresh(); };
+
+    // Filters
+    addAndMakeVisible(sampleRateBox);
+    sampleRateBox.addItemList({ "Any rate", "44.1 kHz", "48 kHz", "88.2 kHz", "96 kHz" }, 1);
+    sampleRateBox.setSelectedId(1, juce::dontSendNotification);
+    sampleRateBox.onChange = [this] { refresh(); };
+
+    addAndMakeVisible(channelsBox);
+    channelsBox.addItemList({ "Any channels", "Mono", "Stereo" }, 1);
+    channelsBox.setSelectedId(1, juce::dontSendNotification);
+    channelsBox.onChange = [this] { refresh(); };
+
+    addAndMakeVisible(durationRange);
+    durationRange.setRange(0.0, maxFilterSeconds);
+    durationRange.setSkewFactorFromMidPoint(10.0);
+    durationRange.setMinAndMaxValues(0.0, maxFilterSeconds, juce::dontSendNotification);
+    durationRange.onValueChange = [this] { refresh(); };
+
+    addAndMakeVisible(tempoRange);
+    tempoRange.setRange(0.0, maxFilterTempo, 1.0);
+    tempoRange.setMinAndMaxValues(0.0, maxFilterTempo, juce::dontSendNotification);
+    tempoRange.onValueChange = [this] { refresh(); };
+
+    addAndMakeVisible(durationLabel);
+    addAndMakeVisible(tempoLabel);
+
+    addAndMakeVisible(list);
+    list.setRowHeight(22);
+
+    library->addChangeListener(this);
+    refresh();
+}
+
+SampleLibraryBrowser::~SampleLibraryBrowser()
+{
+    library->removeChangeListener(this);
+}
+
+//==============================================================================
+void SampleLibraryBrowser::refresh()
+{
+    SampleLibrary::Query query;
+    query.sortBy = (SampleLibrary::SortKey)(sortBox.getSelectedId() - 1);
+    query.descending = descendingButton.getToggleState();
+
+    const double rates[] = { 0.0, 44100.0, 48000.0, 88200.0, 96000.0 };
+    query.sampleRate = rates[juce::jlimit(0, 4, sampleRateBox.getSelectedId() - 1)];
+    query.numChannels = juce::jmax(0, channelsBox.getSelectedId() - 1);
+
+    // The top of each slider means "no upper limit"
+    query.minSeconds = durationRange.getMinValue();
+    if (durationRange.getMaxValue() < maxFilterSeconds)
+        query.maxSeconds = durationRange.getMaxValue();
+
+    query.minTempo = (float)tempoRange.getMinValue();
+    if (tempoRange.getMaxValue() < maxFilterTempo)
+        query.maxTempo = (float)tempoRange.getMaxValue();
+
+    durationLabel.setText(juce::String(query.minSeconds, 1) + " - "
+        + (durationRange.getMaxValue() < maxFilterSeconds ? juce::String(durationRange.getMaxValue(), 1) + " s" : juce::String("any length")),
+        juce::dontSendNotification);
+    tempoLabel.setText(juce::String((int)query.minTempo) + " - "
+        + (tempoRange.getMaxValue() < maxFilterTempo ? juce::String((int)tempoRange.getMaxValue()) + " BPM" : juce::String("any BPM")),
+        juce::dontSendNotification);
+
+    const double startMs = juce::Time::getMillisecondCounterHiRes();
+    library->query(query, results);
+    const double queryMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    statusText = juce::String((int)results.size()) + " of " + juce::String(library->getNumEntries())
+        + " samples (" + juce::String(queryMs, 2) + " ms)";
+
+    list.updateContent();
+    list.repaint();
+    repaint();
+}
+
+void SampleLibraryBrowser::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    refresh();
+}
+
+void SampleLibraryBrowser::chooseRow(int row)
+{
+    if (!juce::isPositiveAndBelow(row, (int)results.size()) || !onFileChosen)
+        return;
+
+    const auto entry = library->getEntry(results[(size_t)row]);
+
+    if (entry.file.existsAsFile())
+        onFileChosen(entry.file);
+}
+
+void SampleLibraryBrowser::listBoxItemDoubleClicked(int row, const juce::MouseEvent&)
+{
+    chooseRow(row);
+}
+
+void SampleLibraryBrowser::returnKeyPressed(int lastRowSelected)
+{
+    chooseRow(lastRowSelected);
+}
+
+//==============================================================================
+void SampleLibraryBrowser::paintListBoxItem(int row, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (!juce::isPositiveAndBelow(row, (int)results.size()))
+        return;
+
+    const auto entry = library->getEntry(results[(size_t)row]);
+
+    if (rowIsSelected)
+        g.fillAll(juce::Colours::darkgreen);
+
+    // Thumbnail from the index: one min/max bar per point
+    const juce::Rectangle<int> thumbArea(2, 2, 60, height - 4);
+    const float centreY = (float)thumbArea.getCentreY();
+    const float halfHeight = (float)thumbArea.getHeight() * 0.5f;
+    const float barWidth = (float)thumbArea.getWidth() / (float)SampleLibrary::thumbnailPoints;
+
+    g.setColour(juce::Colours::limegreen);
+    for (int p = 0; p < SampleLibrary::thumbnailPoints; ++p)
+    {
+        const float top = centreY - halfHeight * (float)entry.thumbnail[p * 2 + 1] / 127.0f;
+        const float bottom = centreY - halfHeight * (float)entry.thumbnail[p * 2] / 127.0f;
+        g.fillRect((float)thumbArea.getX() + p * barWidth, top, juce::jmax(1.0f, barWidth), juce::jmax(1.0f, bottom - top));
+    }
+
+    const double seconds = entry.getLengthInSeconds();
+    juce::String figures = juce::String((int)seconds / 60) + ":" + juce::String((int)seconds % 60).paddedLeft('0', 2)
+        + "  " + juce::String(entry.sampleRate / 1000.0, 1) + "k  " + juce::String(entry.numChannels) + "ch  "
+        + juce::String(juce::Decibels::gainToDecibels(entry.peak), 1) + " dB";
+
+    if (entry.tempo > 0.0f)
+        figures << "  " << juce::String(entry.tempo, 1) << " BPM";
+
+    auto textArea = juce::Rectangle<int>(0, 0, width, height).withTrimmedLeft(thumbArea.getRight() + 6).reduced(2, 0);
+
+    g.setColour(juce::Colours::white);
+    g.setFont(13.0f);
+    g.drawText(figures, textArea, juce::Justification::centredRight, true);
+    g.drawText(entry.file.getFileName(), textArea.withTrimmedRight(g.getCurrentFont().getStringWidth(figures) + 8),
+        juce::Justification::centredLeft, true);
+}
+
+void SampleLibraryBrowser::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colours::black.withAlpha(0.4f));
+
+    g.setColour(juce::Colours::white.withAlpha(0.7f));
+    g.setFont(12.0f);
+    g.drawText(statusText, getLocalBounds().removeFromBottom(18).reduced(4, 0), juce::Justification::centredLeft, true);
+}
+
+void SampleLibraryBrowser::resized()
+{
+    auto r = getLocalBounds().reduced(4);
+    r.removeFromBottom(14);   // Status line
+
+    // Sort row
+    auto row = r.removeFromTop(24);
+    descendingButton.setBounds(row.removeFromRight(60));
+    sortBox.setBounds(row.reduced(0, 1));
+
+    // Rate and channel filters
+    row = r.removeFromTop(24);
+    sampleRateBox.setBounds(row.removeFromLeft(row.getWidth() / 2).reduced(0, 1));
+    channelsBox.setBounds(row.reduced(0, 1));
+
+    // Range sliders, each with its current range as text
+    row = r.removeFromTop(22);
+    durationLabel.setBounds(row.removeFromRight(110));
+    durationRange.setBounds(row);
+
+    row = r.removeFromTop(22);
+    tempoLabel.setBounds(row.removeFromRight(110));
+    tempoRange.setBounds(row);
+
+    list.setBounds(r.withTrimmedTop(4));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <vector>
+#include "SampleLibrary.h"
+
+/**
+ * SampleLibraryBrowser
+ *
+ * Lists the SampleLibrary beside the drop area:
+ *  1) Sort by date added, name, duration, sample rate, channels, peak or tempo,
+ *     ascending or descending,
+ *  2) Filter by sample rate, channel count, duration range and tempo range,
+ *  3) Each row shows the entry's thumbnail and figures, all read from the index,
+ *     so the list fills in at once without opening any audio file.
+ *
+ * The query reruns whenever a control changes or the library grows; its time is
+ * shown under the list. Double-clicking a row (or pressing return) calls onFileChosen.
+ */
+class SampleLibraryBrowser : public juce::Component,
+    private juce::ListBoxModel,
+    private juce::ChangeListener
+{
+public:
+    SampleLibraryBrowser();
+    ~SampleLibraryBrowser() override;
+
+    /** Called when the user picks an entry to load. */
+    std::function<void(const juce::File&)> onFileChosen;
+
+    //==============================================================================
+    // JUCE Component overrides
+    //==============================================================================
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+
+private:
+    //==============================================================================
+    // ListBoxModel overrides
+    //==============================================================================
+    int getNumRows() override { return (int)results.size(); }
+    void paintListBoxItem(int row, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void listBoxItemDoubleClicked(int row, const juce::MouseEvent&) override;
+    void returnKeyPressed(int lastRowSelected) override;
+
+    /** The library has grown: runs the query again. */
+    void changeListenerCallback(juce::ChangeBroadcaster*) override;
+
+    /** Builds the query from the controls, runs it and refreshes the list. */
+    void refresh();
+
+    void chooseRow(int row);
+
+    //==============================================================================
+    juce::SharedResourcePointer<SampleLibrary> library;
+
+    std::vector<int> results;                          ///< Library indices, in display order
+    juce::String     statusText;
+
+    juce::ComboBox     sortBox;
+    juce::ToggleButton descendingButton{ "Desc" };
+    juce::ComboBox     sampleRateBox;
+    juce::ComboBox     channelsBox;
+    juce::Slider       durationRange{ juce::Slider::TwoValueHorizontal, juce::Slider::NoTextBox };
+    juce::Slider       tempoRange{ juce::Slider::TwoValueHorizontal, juce::Slider::NoTextBox };
+    juce::Label        durationLabel, tempoLabel;
+    juce::ListBox      list{ "Sample library", this };
+
+    static constexpr double maxFilterSeconds = 600.0;  ///< The duration slider's top means "any length"
+    static constexpr double maxFilterTempo = 200.0;    ///< Likewise for tempo
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleLibraryBrowser)
+};
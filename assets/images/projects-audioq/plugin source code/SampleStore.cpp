@@ -0,0 +1,309 @@
+#include "SampleStore.h"
+
+/**
+ * SampleStore.cpp
+ *
+ * Packing float samples into the compact encodings and expanding them again:
+ * SSE2 or NEON for 16-bit integers, F16C (where the build targets it) or a
+ * branchless integer conversion for half floats, plain byte assembly for 24-bit.
+ */
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#endif
+
+#if JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+#if defined(__F16C__)
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+    //==============================================================================
+    // Half floats (IEEE 754 binary16)
+
+    juce::uint32 floatBits(float f)      { juce::uint32 u; std::memcpy(&u, &f, sizeof(u)); return u; }
+    float bitsToFloat(juce::uint32 u)    { float f; std::memcpy(&f, &u, sizeof(f)); return f; }
+
+    /** Rounds to nearest, ties to even; overflows to infinity, NaN stays NaN. */
+    juce::uint16 floatToHalf(float value)
+    {
+        juce::uint32 x = floatBits(value);
+        const juce::uint32 sign = (x >> 16) & 0x8000u;
+        x &= 0x7fffffffu;
+
+        juce::uint32 h;
+
+        if (x >= 0x47800000u)                     // 65536 or more, inf or NaN
+        {
+            h = x > 0x7f800000u ? 0x7e00u : 0x7c00u;
+        }
+        else if (x < 0x38800000u)                 // Below 2^-14: subnormal (or zero)
+        {
+            // Adding 0.5 lines the half's mantissa up with the float's, rounding in the FPU
+            h = floatBits(bitsToFloat(x) + 0.5f) - 0x3f000000u;
+        }
+        else
+        {
+            const juce::uint32 mantissaOdd = (x >> 13) & 1u;
+            h = (x + ((juce::uint32)(15 - 127) << 23) + 0xfffu + mantissaOdd) >> 13;
+        }
+
+        return (juce::uint16)(h | sign);
+    }
+
+    /**
+     * Normal halves move their exponent and mantissa into place; subnormals are
+     * converted as integers times 2^-24, so no denormal float is ever formed.
+     */
+    float halfToFloat(juce::uint16 half)
+    {
+        const juce::uint32 magnitude = half & 0x7fffu;
+        const juce::uint32 sign = (juce::uint32)(half & 0x8000u) << 16;
+
+        juce::uint32 bits = (magnitude << 13) + ((juce::uint32)(127 - 15) << 23);
+        if (magnitude >= 0x7c00u)
+            bits += (juce::uint32)(128 - 16) << 23;   // inf / NaN keep the top exponent
+
+        const float normal = bitsToFloat(bits);
+        const float subnormal = (float)magnitude * (1.0f / 16777216.0f);
+
+        return bitsToFloat(floatBits(magnitude < 0x400u ? subnormal : normal) | sign);
+    }
+
+    void expandHalf(const juce::uint16* src, float* dest, int num)
+    {
+        int i = 0;
+
+       #if defined(__F16C__)
+        for (; i + 8 <= num; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+       #elif JUCE_USE_SSE_INTRINSICS
+        // The scalar conversion, four lanes at a time with a mask for the select
+        const __m128i magnitudeMask = _mm_set1_epi32(0x7fff);
+        const __m128i exponentAdjust = _mm_set1_epi32((127 - 15) << 23);
+        const __m128i infAdjust = _mm_set1_epi32((128 - 16) << 23);
+        const __m128i infThreshold = _mm_set1_epi32(0x7bff);
+        const __m128i subnormalLimit = _mm_set1_epi32(0x400);
+        const __m128 subnormalScale = _mm_set1_ps(1.0f / 16777216.0f);
+
+        for (; i + 4 <= num; i += 4)
+        {
+            const __m128i packed = _mm_loadl_epi64((const __m128i*)(src + i));
+            const __m128i h = _mm_unpacklo_epi16(packed, _mm_setzero_si128());
+            const __m128i magnitude = _mm_and_si128(h, magnitudeMask);
+            const __m128i sign = _mm_slli_epi32(_mm_andnot_si128(magnitudeMask, h), 16);
+
+            __m128i bits = _mm_add_epi32(_mm_slli_epi32(magnitude, 13), exponentAdjust);
+            bits = _mm_add_epi32(bits, _mm_and_si128(_mm_cmpgt_epi32(magnitude, infThreshold), infAdjust));
+
+            const __m128 subnormal = _mm_mul_ps(_mm_cvtepi32_ps(magnitude), subnormalScale);
+            const __m128 isSubnormal = _mm_castsi128_ps(_mm_cmplt_epi32(magnitude, subnormalLimit));
+            const __m128 value = _mm_or_ps(_mm_and_ps(isSubnormal, subnormal),
+                                           _mm_andnot_ps(isSubnormal, _mm_castsi128_ps(bits)));
+
+            _mm_storeu_ps(dest + i, _mm_or_ps(value, _mm_castsi128_ps(sign)));
+        }
+       #endif
+
+        for (; i < num; ++i)
+            dest[i] = halfToFloat(src[i]);
+    }
+
+    //==============================================================================
+    // Integers
+
+    void expandInt16(const juce::int16* src, float* dest, int num, float scale)
+    {
+        int i = 0;
+
+       #if JUCE_USE_SSE_INTRINSICS
+        const __m128 gain = _mm_set1_ps(scale);
+
+        for (; i + 8 <= num; i += 8)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+            // Sign-extend by putting each sample in the top half of a lane and shifting down
+            const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+            _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), gain));
+            _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), gain));
+        }
+       #elif JUCE_USE_ARM_NEON
+        for (; i + 8 <= num; i += 8)
+        {
+            const int16x8_t v = vld1q_s16(src + i);
+
+            vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+            vst1q_f32(dest + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+        }
+       #endif
+
+        for (; i < num; ++i)
+            dest[i] = (float)src[i] * scale;
+    }
+
+    void expandInt24(const juce::uint8* src, float* dest, int num, float scale)
+    {
+        // Little-endian; built in the top three bytes so the shift sign-extends
+        for (int i = 0; i < num; ++i, src += 3)
+        {
+            const auto value = (juce::int32)(((juce::uint32)src[0] << 8) | ((juce::uint32)src[1] << 16) | ((juce::uint32)src[2] << 24)) >> 8;
+            dest[i] = (float)value * scale;
+        }
+    }
+}
+
+//==============================================================================
+SampleStore::SampleStore(Encoding compactEncoding, int channels, int samples, double sourceSampleRate)
+    : encoding(compactEncoding), numChannels(channels), numSamples(samples), sampleRate(sourceSampleRate)
+{
+    packed.allocate((size_t)numChannels * (size_t)numSamples * (size_t)getBytesPerSample(encoding), false);
+}
+
+SampleStore::Ptr SampleStore::createCompact(SampleStore& source, Encoding encoding)
+{
+    if (encoding == Encoding::float32 || source.isCompact())
+        return &source;
+
+    Ptr compact = new SampleStore(encoding, source.numChannels, source.numSamples, source.sampleRate);
+    const int n = source.numSamples;
+
+    // Full scale is 2^15 (or 2^23) steps, as integer files are decoded, so those
+    // round-trip exactly; a store peaking above full scale is scaled to fit
+    float peak = 1.0f;
+    if (encoding != Encoding::float16)
+        for (int ch = 0; ch < source.numChannels; ++ch)
+            peak = juce::jmax(peak, source.buffer.getMagnitude(ch, 0, n));
+
+    const float fullScale = encoding == Encoding::int16 ? 32768.0f : 8388608.0f;
+    compact->scale = peak / fullScale;
+    const float toSteps = fullScale / peak;
+
+    for (int ch = 0; ch < source.numChannels; ++ch)
+    {
+        const float* src = source.buffer.getReadPointer(ch);
+        char* dest = compact->packed.get() + (size_t)ch * (size_t)n * (size_t)getBytesPerSample(encoding);
+
+        if (encoding == Encoding::float16)
+        {
+            auto* halves = reinterpret_cast<juce::uint16*>(dest);
+            for (int i = 0; i < n; ++i)
+                halves[i] = floatToHalf(src[i]);
+        }
+        else if (encoding == Encoding::int16)
+        {
+            auto* ints = reinterpret_cast<juce::int16*>(dest);
+            for (int i = 0; i < n; ++i)
+                ints[i] = (juce::int16)juce::jlimit(-32768, 32767, juce::roundToInt(src[i] * toSteps));
+        }
+        else
+        {
+            auto* bytes = reinterpret_cast<juce::uint8*>(dest);
+            for (int i = 0; i < n; ++i, bytes += 3)
+            {
+                const auto value = (juce::uint32)juce::jlimit(-8388608, 8388607, juce::roundToInt(src[i] * toSteps));
+                bytes[0] = (juce::uint8)value;
+                bytes[1] = (juce::uint8)(value >> 8);
+                bytes[2] = (juce::uint8)(value >> 16);
+            }
+        }
+    }
+
+    return compact;
+}
+
+SampleStore::Ptr SampleStore::createExpanded(const SampleStore& source)
+{
+    Ptr expanded = new SampleStore(source.numChannels, source.numSamples, source.sampleRate);
+
+    for (int ch = 0; ch < source.numChannels; ++ch)
+        source.read(ch, 0, source.numSamples, expanded->buffer.getWritePointer(ch));
+
+    return expanded;
+}
+
+void SampleStore::read(int channel, long long start, int num, float* dest) const
+{
+    jassert(juce::isPositiveAndBelow(channel, numChannels) && start >= 0 && start + num <= numSamples);
+
+    if (num <= 0)
+        return;
+
+    const char* src = isCompact() ? getPacked(channel) : nullptr;
+
+    switch (encoding)
+    {
+        case Encoding::int16:
+            expandInt16(reinterpret_cast<const juce::int16*>(src) + start, dest, num, scale);
+            break;
+
+        case Encoding::int24:
+            expandInt24(reinterpret_cast<const juce::uint8*>(src) + start * 3, dest, num, scale);
+            break;
+
+        case Encoding::float16:
+            expandHalf(reinterpret_cast<const juce::uint16*>(src) + start, dest, num);
+            break;
+
+        case Encoding::float32:
+        default:
+            juce::FloatVectorOperations::copy(dest, buffer.getReadPointer(channel, (int)start), num);
+            break;
+    }
+}
+
+//==============================================================================
+int SampleWindow::load(const SampleStore& store, int numOutputChannels, long long position, double fraction,
+    double increment, int num, int margin)
+{
+    const int numSrc = store.getNumChannels();
+    const long long total = store.getNumSamples();
+
+    // Float stores are read in place, whole
+    if (!store.isCompact())
+    {
+        for (int ch = 0; ch < 2; ++ch)
+            data[ch] = store.getFloatData(juce::jmin(ch, numSrc - 1));
+
+        start = 0;
+        length = total;
+        return num;
+    }
+
+    // As many outputs as the scratch has room for, keeping a sample spare for rounding
+    const double room = (double)(scratch.getNumSamples() - 2 * margin - 2) - fraction;
+    jassert(room >= increment);   // prepare() with more room for the kernels and speeds in use
+
+    const int fit = juce::jlimit(1, juce::jmax(1, num), (int)(room / increment));
+
+    start = juce::jlimit(0LL, total, position - margin);
+    length = juce::jlimit(start, total, position + (long long)(fraction + fit * increment) + margin + 1) - start;
+
+    // Mono files play on both channels from one expansion
+    data[1] = nullptr;
+    for (int ch = 0; ch < juce::jmin(numOutputChannels, 2); ++ch)
+    {
+        const int srcChannel = juce::jmin(ch, numSrc - 1);
+
+        if (ch > 0 && srcChannel == 0)
+        {
+            data[ch] = data[0];
+            continue;
+        }
+
+        float* dest = scratch.getWritePointer(ch);
+        store.read(srcChannel, start, (int)length, dest);
+        data[ch] = dest;
+    }
+
+    if (data[1] == nullptr)
+        data[1] = data[0];
+
+    return fit;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * SampleStore
+ *
+ * A reference-counted block of decoded audio. A file is decoded into a
+ * SampleStore exactly once; the transport (via SampleStoreSource) and the
+ * offline waveform display then share the same samples instead of each
+ * keeping its own copy. Through the DecodedAudioCache it is also shared with
+ * other plugin instances, so it must not be written once it has been loaded.
+ *
+ * Samples are 32-bit floats, or, in a compact store, 16-bit or packed 24-bit
+ * integers or 16-bit floats, which halve (or cut by a quarter) the memory and
+ * the bandwidth of reading them. Compact stores are read through read(), which
+ * expands a span to floats with SIMD where the encoding allows; interpolating
+ * readers go through a SampleWindow.
+ */
+class SampleStore : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SampleStore>;
+
+    enum class Encoding
+    {
+        float32 = 0,
+        int16,
+        int24,      ///< Packed, 3 bytes per sample
+        float16
+    };
+
+    /** A float store of this size, to be filled through getBuffer(). */
+    SampleStore(int channels, int samples, double sourceSampleRate)
+        : buffer(channels, samples), numChannels(channels), numSamples(samples), sampleRate(sourceSampleRate)
+    {
+    }
+
+    /**
+     * A compact copy of a float store. Integer encodings scale the whole store
+     * down if it peaks above full scale (after resampling, say) and back up on
+     * read, so nothing clips. Returns the source itself for float32, or if it is
+     * already compact.
+     */
+    static Ptr createCompact(SampleStore& source, Encoding encoding);
+
+    /** A float copy of any store. */
+    static Ptr createExpanded(const SampleStore& source);
+
+    Encoding getEncoding() const { return encoding; }
+    bool     isCompact()   const { return encoding != Encoding::float32; }
+
+    /** The samples of a float store (compact stores have none: use read()). */
+    juce::AudioBuffer<float>&       getBuffer()       { jassert(!isCompact()); return buffer; }
+    const juce::AudioBuffer<float>& getBuffer() const { jassert(!isCompact()); return buffer; }
+
+    /** A float store's channel, for reading in place; nullptr for compact stores. */
+    const float* getFloatData(int channel) const { return isCompact() ? nullptr : buffer.getReadPointer(channel); }
+
+    /**
+     * Copies samples [start, start + num) of a channel to dest as floats, whatever
+     * the encoding. Real-time safe; the span must lie inside the store.
+     */
+    void read(int channel, long long start, int num, float* dest) const;
+
+    int    getNumChannels() const { return numChannels; }
+    int    getNumSamples()  const { return numSamples; }
+    double getSampleRate()  const { return sampleRate; }
+
+    /** Memory the samples take. */
+    long long getSizeInBytes() const
+    {
+        return (long long)numChannels * numSamples * getBytesPerSample(encoding);
+    }
+
+    double getLengthInSeconds() const
+    {
+        return sampleRate > 0.0 ? (double)numSamples / sampleRate : 0.0;
+    }
+
+    static int getBytesPerSample(Encoding e)
+    {
+        return e == Encoding::float32 ? 4 : (e == Encoding::int24 ? 3 : 2);
+    }
+
+private:
+    SampleStore(Encoding compactEncoding, int channels, int samples, double sourceSampleRate);
+
+    const char* getPacked(int channel) const
+    {
+        return packed.get() + (size_t)channel * (size_t)numSamples * (size_t)getBytesPerSample(encoding);
+    }
+
+    juce::AudioBuffer<float> buffer;        ///< float32 stores
+    juce::HeapBlock<char>    packed;        ///< Compact stores: channel after channel
+    Encoding encoding = Encoding::float32;
+    float    scale = 1.0f;                  ///< Integer encodings: float value of one step
+    int      numChannels = 0;
+    int      numSamples = 0;
+    double   sampleRate = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleStore)
+};
+
+//==============================================================================
+/**
+ * SampleWindow
+ *
+ * A float view of the span of a SampleStore an interpolating reader is about to
+ * read. Float stores are read in place; compact ones are expanded into the
+ * window's own scratch, one stretch of output at a time, so the sinc kernels
+ * always read floats and only the window's few kilobytes of them.
+ */
+class SampleWindow
+{
+public:
+    /** Allocates room for this many samples per channel (never on the audio thread). */
+    void prepare(int maxSamples) { scratch.setSize(2, juce::jmax(1, maxSamples)); }
+
+    /**
+     * Makes up to `num` output samples readable for a cursor at position + fraction
+     * moving `increment` per output, with `margin` samples (at least the kernel
+     * length) on either side. Returns how many of the `num` fit; each channel's data
+     * is then at getData(ch), starting at source sample getStart().
+     */
+    int load(const SampleStore& store, int numOutputChannels, long long position, double fraction,
+        double increment, int num, int margin);
+
+    const float* getData(int channel) const { return data[channel]; }
+    long long    getStart()  const { return start; }
+    long long    getLength() const { return length; }
+
+private:
+    juce::AudioBuffer<float> scratch;
+    const float* data[2] = {};
+    long long start = 0;
+    long long length = 0;
+};
+
+/**
+ * SampleStoreSource
+ *
+ * A PositionableAudioSource that plays straight from a SampleStore in RAM,
+ * replacing the disk-streaming AudioFormatReaderSource for loaded files.
+ * Mono stores are duplicated to every output channel.
+ */
+class SampleStoreSource : public juce::PositionableAudioSource
+{
+public:
+    explicit SampleStoreSource(SampleStore::Ptr storeToPlay)
+        : store(std::move(storeToPlay))
+    {
+    }
+
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        const juce::int64 total = store != nullptr ? store->getNumSamples() : 0;
+        const int numAvailable = (int)juce::jlimit((juce::int64)0, (juce::int64)info.numSamples, total - position);
+
+        if (numAvailable < info.numSamples)
+            info.buffer->clear(info.startSample + numAvailable, info.numSamples - numAvailable);
+
+        if (numAvailable > 0)
+        {
+            const int srcChannels = store->getNumChannels();
+
+            for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+                store->read(juce::jmin(ch, srcChannels - 1), position, numAvailable,
+                    info.buffer->getWritePointer(ch, info.startSample));
+        }
+
+        position += info.numSamples;
+    }
+
+    void setNextReadPosition(juce::int64 newPosition) override { position = newPosition; }
+    juce::int64 getNextReadPosition() const override { return position; }
+    juce::int64 getTotalLength() const override { return store != nullptr ? store->getNumSamples() : 0; }
+
+    bool isLooping() const override { return false; }
+    void setLooping(bool) override {}
+
+private:
+    SampleStore::Ptr store;
+    juce::int64 position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleStoreSource)
+};
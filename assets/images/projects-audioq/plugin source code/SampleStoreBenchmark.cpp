@@ -0,0 +1,132 @@
+#include "SampleStore.h"
+
+/**
+ * SampleStoreBenchmark.cpp
+ *
+ * What the compact encodings cost to expand against what they save in memory
+ * traffic. Each store is read through read() in playback-sized blocks, once
+ * streaming through the whole store (bound by memory bandwidth) and once over
+ * a span small enough to stay in cache (the expansion alone), and compared with
+ * float32. Built with JUCE_UNIT_TESTS; run with
+ * juce::UnitTestRunner().runTestsInCategory("Benchmarks").
+ */
+
+#if JUCE_UNIT_TESTS
+
+class SampleStoreBenchmark : public juce::UnitTest
+{
+public:
+    SampleStoreBenchmark() : juce::UnitTest("SampleStore compact encodings", "Benchmarks") {}
+
+    void runTest() override
+    {
+        beginTest("Two minutes of stereo at 48 kHz");
+
+        // Far larger than any cache, so streaming reads come from memory
+        SampleStore::Ptr source = new SampleStore(2, 120 * 48000, 48000.0);
+        juce::Random random(1);
+
+        for (int ch = 0; ch < source->getNumChannels(); ++ch)
+        {
+            auto* data = source->getBuffer().getWritePointer(ch);
+            for (int i = 0; i < source->getNumSamples(); ++i)
+                data[i] = random.nextFloat() * 1.8f - 0.9f;
+        }
+
+        double floatStreaming = 0.0, floatCached = 0.0;
+
+        for (const auto encoding : { SampleStore::Encoding::float32, SampleStore::Encoding::int16,
+                                     SampleStore::Encoding::int24, SampleStore::Encoding::float16 })
+        {
+            auto store = SampleStore::createCompact(*source, encoding);
+
+            const double streaming = samplesPerSecond(*store, store->getNumSamples());
+            const double cached = samplesPerSecond(*store, cachedSpan);
+
+            if (encoding == SampleStore::Encoding::float32)
+            {
+                floatStreaming = streaming;
+                floatCached = cached;
+            }
+
+            expect(streaming > 0.0 && cached > 0.0);
+
+            logMessage("  " + getName(encoding) + ": " + juce::String(store->getSizeInBytes() / (1024.0 * 1024.0), 1) + " MB, "
+                + "streaming " + juce::String(streaming / 1.0e6, 0) + " M samples/s ("
+                + juce::String(streaming / floatStreaming, 2) + "x float), in cache "
+                + juce::String(cached / 1.0e6, 0) + " M samples/s (" + juce::String(cached / floatCached, 2)
+                + "x float), largest error " + juce::String(juce::Decibels::gainToDecibels(largestError(*source, *store), -200.0f), 1) + " dB");
+        }
+    }
+
+private:
+    static constexpr int blockSize = 512;
+    static constexpr int cachedSpan = 16 * blockSize;           ///< 64 KB as float stereo
+    static constexpr long long samplesMeasured = 200'000'000;
+
+    static juce::String getName(SampleStore::Encoding encoding)
+    {
+        switch (encoding)
+        {
+            case SampleStore::Encoding::int16:   return "int16";
+            case SampleStore::Encoding::int24:   return "int24";
+            case SampleStore::Encoding::float16: return "float16";
+            case SampleStore::Encoding::float32:
+            default:                             return "float32";
+        }
+    }
+
+    /** Samples per second (all channels) read() delivers cycling over the first `span` samples. */
+    double samplesPerSecond(const SampleStore& store, int span)
+    {
+        juce::AudioBuffer<float> dest(store.getNumChannels(), blockSize);
+        const int numBlocks = span / blockSize;
+        long long delivered = 0;
+        float sink = 0.0f;
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        while (delivered < samplesMeasured)
+        {
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                for (int ch = 0; ch < store.getNumChannels(); ++ch)
+                {
+                    store.read(ch, (long long)b * blockSize, blockSize, dest.getWritePointer(ch));
+                    sink += dest.getSample(ch, b % blockSize);
+                }
+
+                delivered += (long long)blockSize * store.getNumChannels();
+            }
+        }
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+        // Keeps the reads from being optimised away
+        if (sink == 12345.0f)
+            logMessage("");
+
+        return seconds > 0.0 ? (double)delivered / seconds : 0.0;
+    }
+
+    static float largestError(const SampleStore& reference, const SampleStore& store)
+    {
+        std::vector<float> expanded((size_t)reference.getNumSamples());
+        float largest = 0.0f;
+
+        for (int ch = 0; ch < reference.getNumChannels(); ++ch)
+        {
+            store.read(ch, 0, reference.getNumSamples(), expanded.data());
+            const auto* original = reference.getFloatData(ch);
+
+            for (int i = 0; i < reference.getNumSamples(); ++i)
+                largest = juce::jmax(largest, std::abs(expanded[(size_t)i] - original[i]));
+        }
+
+        return largest;
+    }
+};
+
+static SampleStoreBenchmark sampleStoreBenchmark;
+
+#endif
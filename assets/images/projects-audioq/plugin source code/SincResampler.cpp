@@ -0,0 +1,212 @@
+#include "SincResampler.h"
+
+/**
+ * SincResampler.cpp
+ *
+ * Kaiser-windowed sinc table construction and the streaming resampler's
+ * input history.
+ */
+
+namespace
+{
+    struct TierSpec
+    {
+        int    zeroCrossings;  ///< Per side, at full bandwidth
+        double beta;           ///< Kaiser window shape: higher = more stopband rejection
+        double rolloff;        ///< Cutoff as a fraction of Nyquist, leaving room for the transition band
+    };
+
+    // draft, normal, mastering
+    const TierSpec tierSpecs[SincKernelBank::numQualities] = {
+        { 4,  6.0,  0.85 },
+        { 16, 8.5,  0.92 },
+        { 32, 12.0, 0.96 }
+    };
+
+    /** Zeroth-order modified Bessel function of the first kind, by its power series. */
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 50; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+
+            if (term < sum * 1.0e-12)
+                break;
+        }
+
+        return sum;
+    }
+}
+
+//==============================================================================
+SincKernelBank::SincKernelBank()
+{
+    for (int q = 0; q < numQualities; ++q)
+    {
+        const auto& spec = tierSpecs[q];
+
+        // Lower cutoffs need proportionally longer kernels for the same transition width
+        std::array<int, numCutoffs> taps{};
+        size_t total = 0;
+
+        for (int c = 0; c < numCutoffs; ++c)
+        {
+            const double widen = std::pow(2.0, c / 4.0);
+            taps[(size_t)c] = ((2 * (int)std::ceil(spec.zeroCrossings * widen) + 3) / 4) * 4;
+            total += (size_t)(numPhases + 1) * (size_t)taps[(size_t)c];
+            maxTaps = juce::jmax(maxTaps, taps[(size_t)c]);
+        }
+
+        auto& table = storage[(size_t)q];
+        table.resize(total);
+
+        const double i0Beta = besselI0(spec.beta);
+        size_t offset = 0;
+
+        for (int c = 0; c < numCutoffs; ++c)
+        {
+            const int n = taps[(size_t)c];
+            const int half = n / 2;
+            const double cutoff = spec.rolloff * std::pow(2.0, -c / 4.0);
+
+            for (int p = 0; p <= numPhases; ++p)
+            {
+                float* row = table.data() + offset + (size_t)p * (size_t)n;
+                const double fraction = (double)p / numPhases;
+                double sum = 0.0;
+
+                for (int t = 0; t < n; ++t)
+                {
+                    // Distance from the read position to this tap, in source samples
+                    const double x = (double)(t - (half - 1)) - fraction;
+                    const double u = x / half;
+
+                    const double px = juce::MathConstants<double>::pi * cutoff * x;
+                    const double sinc = std::abs(px) < 1.0e-9 ? 1.0 : std::sin(px) / px;
+                    const double window = std::abs(u) < 1.0 ? besselI0(spec.beta * std::sqrt(1.0 - u * u)) / i0Beta : 0.0;
+
+                    row[t] = (float)(cutoff * sinc * window);
+                    sum += row[t];
+                }
+
+                // Exact unity gain at DC for every phase
+                for (int t = 0; t < n; ++t)
+                    row[t] = (float)(row[t] / sum);
+            }
+
+            kernels[(size_t)q][(size_t)c] = { n, table.data() + offset };
+            offset += (size_t)(numPhases + 1) * (size_t)n;
+        }
+    }
+}
+
+int SincKernelBank::getCutoffIndex(double step)
+{
+    if (step <= 1.0)
+        return 0;
+
+    return juce::jlimit(0, numCutoffs - 1, (int)std::ceil(4.0 * std::log2(step) - 1.0e-6));
+}
+
+//==============================================================================
+SincResamplingSource::SincResamplingSource(juce::AudioSource* inputSource, int channels)
+    : input(inputSource), numChannels(juce::jmax(1, channels))
+{
+    jassert(input != nullptr);
+}
+
+void SincResamplingSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    blockSize = juce::jmax(1, samplesPerBlockExpected);
+
+    input->prepareToPlay(juce::roundToInt(blockSize * ratio.load()), sampleRate);
+
+    // Room for one block read at the highest ratio, plus a kernel either side
+    const int maxTaps = kernels->getMaxTaps();
+    history.setSize(numChannels, 2 * maxTaps + (int)std::ceil(maxRatio * blockSize) + 8);
+    tapScratch.assign((size_t)maxTaps, 0.0f);
+
+    flushBuffers();
+}
+
+void SincResamplingSource::releaseResources()
+{
+    input->releaseResources();
+    flushBuffers();
+}
+
+void SincResamplingSource::flushBuffers()
+{
+    // Half a kernel of silence behind the first sample, so every read has history
+    const int halfMax = kernels->getMaxTaps() / 2;
+
+    history.clear();
+    historyFill = juce::jmin(halfMax, history.getNumSamples());
+    position = (double)historyFill;
+}
+
+void SincResamplingSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
+{
+    if (history.getNumSamples() == 0)
+    {
+        info.clearActiveBufferRegion();
+        return;
+    }
+
+    const double step = ratio.load();
+    const auto& kernel = kernels->getKernel((SincKernelBank::Quality)quality.load(), SincKernelBank::getCutoffIndex(step));
+    const int firstTap = kernel.getFirstTapOffset();
+    const int halfMax = kernels->getMaxTaps() / 2;
+    const int outChannels = juce::jmin(info.buffer->getNumChannels(), numChannels, maxChannels);
+    std::array<float*, maxChannels> outs{};
+
+    for (int done = 0; done < info.numSamples; )
+    {
+        const int num = juce::jmin(info.numSamples - done, blockSize);
+
+        // Pull enough input for the last tap of the last sample of this chunk
+        const int needed = (int)(position + step * (num - 1)) + kernel.numTaps / 2 + 1;
+        if (needed > historyFill)
+        {
+            const int toRead = juce::jmin(needed, history.getNumSamples()) - historyFill;
+            input->getNextAudioBlock(juce::AudioSourceChannelInfo(&history, historyFill, toRead));
+            historyFill += toRead;
+        }
+
+        for (int ch = 0; ch < outChannels; ++ch)
+            outs[(size_t)ch] = info.buffer->getWritePointer(ch, info.startSample + done);
+
+        for (int i = 0; i < num; ++i)
+        {
+            const auto index = (int)position;
+            const float* taps = kernel.getTaps((float)(position - index), tapScratch.data());
+
+            for (int ch = 0; ch < outChannels; ++ch)
+                outs[(size_t)ch][i] = SincKernelBank::dot(taps, history.getReadPointer(ch, index + firstTap), kernel.numTaps);
+
+            position += step;
+        }
+
+        for (int ch = outChannels; ch < info.buffer->getNumChannels(); ++ch)
+            info.buffer->clear(ch, info.startSample + done, num);
+
+        // Keep half the longest kernel behind the read position, drop the rest
+        const int drop = juce::jlimit(0, historyFill, (int)position - halfMax);
+        if (drop > 0)
+        {
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                float* data = history.getWritePointer(ch);
+                std::memmove(data, data + drop, sizeof(float) * (size_t)(historyFill - drop));
+            }
+
+            historyFill -= drop;
+            position -= drop;
+        }
+
+        done += num;
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+/**
+ * SincKernelBank
+ *
+ * Polyphase windowed-sinc (Kaiser) interpolation kernels, shared by every
+ * resampling reader in the plugin: the loop engine, the grain engine and the
+ * streaming SincResamplingSource.
+ *
+ * Each kernel is a table of numPhases + 1 rows of taps (one row per fractional
+ * position); a read interpolates between the two nearest rows once and reuses
+ * the taps for every channel. When reading faster than the source rate, the
+ * kernel with the next lower cutoff is used (cutoffs step down by a quarter
+ * octave), so high TEMPO values are band-limited instead of aliasing.
+ *
+ * The tables only depend on the quality tier, so one bank is built per process
+ * and shared through juce::SharedResourcePointer.
+ */
+class SincKernelBank
+{
+public:
+    enum class Quality { draft = 0, normal, mastering };
+
+    static constexpr int numQualities = 3;
+    static constexpr int numPhases = 256;
+
+    /** Cutoffs 2^(-i/4), i.e. band-limited reading up to ~6.7x the source rate. */
+    static constexpr int numCutoffs = 12;
+
+    struct Kernel
+    {
+        int          numTaps = 0;      ///< Multiple of 4
+        const float* rows = nullptr;   ///< (numPhases + 1) rows of numTaps
+
+        /** Offset of the first tap from the integer read position. */
+        int getFirstTapOffset() const { return 1 - numTaps / 2; }
+
+        /** Taps for a fractional position in [0, 1): a table row, or two interpolated into scratch. */
+        const float* getTaps(float fraction, float* scratch) const
+        {
+            const float phase = fraction * (float)numPhases;
+            const int row = juce::jlimit(0, numPhases - 1, (int)phase);
+            const float t = phase - (float)row;
+            const float* a = rows + (size_t)row * (size_t)numTaps;
+
+            if (t <= 0.0f)
+                return a;
+
+            juce::FloatVectorOperations::multiply(scratch, a, 1.0f - t, numTaps);
+            juce::FloatVectorOperations::addWithMultiply(scratch, a + numTaps, t, numTaps);
+            return scratch;
+        }
+    };
+
+    SincKernelBank();
+
+    const Kernel& getKernel(Quality quality, int cutoffIndex) const
+    {
+        return kernels[(size_t)quality][(size_t)juce::jlimit(0, numCutoffs - 1, cutoffIndex)];
+    }
+
+    /** The kernel for reading `step` source samples per output sample. */
+    static int getCutoffIndex(double step);
+
+    /** Longest kernel of any quality and cutoff. */
+    int getMaxTaps() const { return maxTaps; }
+
+    /** Sum of taps[i] * data[i], unrolled so the compiler vectorises it (n is a multiple of 4). */
+    static float dot(const float* taps, const float* data, int n)
+    {
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+        for (int i = 0; i < n; i += 4)
+        {
+            s0 += taps[i] * data[i];
+            s1 += taps[i + 1] * data[i + 1];
+            s2 += taps[i + 2] * data[i + 2];
+            s3 += taps[i + 3] * data[i + 3];
+        }
+
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    /**
+     * Reads data (numSamples long) at index + the fraction the taps were made for.
+     * Taps outside the data repeat its first or last sample.
+     */
+    static float read(const Kernel& kernel, const float* taps, const float* data, long long numSamples, long long index)
+    {
+        const long long first = index + kernel.getFirstTapOffset();
+
+        if (first >= 0 && first + kernel.numTaps <= numSamples)
+            return dot(taps, data + first, kernel.numTaps);
+
+        float sum = 0.0f;
+        for (int i = 0; i < kernel.numTaps; ++i)
+            sum += taps[i] * data[juce::jlimit(0LL, numSamples - 1, first + i)];
+
+        return sum;
+    }
+
+private:
+    std::array<std::vector<float>, numQualities> storage;
+    std::array<std::array<Kernel, numCutoffs>, numQualities> kernels;
+    int maxTaps = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SincKernelBank)
+};
+
+//==============================================================================
+/**
+ * SincResamplingSource
+ *
+ * Drop-in replacement for juce::ResamplingAudioSource built on SincKernelBank:
+ * pulls its input source at ratio input samples per output sample. The kernel
+ * taps are computed once per output sample and shared by all channels.
+ */
+class SincResamplingSource : public juce::AudioSource
+{
+public:
+    SincResamplingSource(juce::AudioSource* inputSource, int numChannels);
+
+    /** Input samples per output sample (2.0 = twice as fast). Any thread. */
+    void setResamplingRatio(double samplesInPerOutputSample) { ratio = juce::jlimit(0.01, maxRatio, samplesInPerOutputSample); }
+    double getResamplingRatio() const { return ratio.load(); }
+
+    void setQuality(SincKernelBank::Quality newQuality) { quality = (int)newQuality; }
+
+    /** Forgets the buffered input. */
+    void flushBuffers();
+
+    /**
+     * Reads from `newInput` from the next block on. The caller makes sure no
+     * block is being rendered meanwhile, and prepares the new input itself.
+     */
+    void setInput(juce::AudioSource* newInput) { jassert(newInput != nullptr); input = newInput; }
+
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override;
+
+private:
+    static constexpr double maxRatio = 8.0;
+    static constexpr int    maxChannels = 8;
+
+    juce::AudioSource* input;
+    const int numChannels;
+
+    juce::SharedResourcePointer<SincKernelBank> kernels;
+
+    // Input history: read position `position` is an index into it
+    juce::AudioBuffer<float> history;
+    int    historyFill = 0;
+    double position = 0.0;
+    int    blockSize = 0;
+
+    std::vector<float> tapScratch;
+
+    std::atomic<double> ratio{ 1.0 };
+    std::atomic<int>    quality{ (int)SincKernelBank::Quality::normal };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SincResamplingSource)
+};
@@ -0,0 +1,149 @@
+#include "SincResampler.h"
+
+/**
+ * SincResamplerBenchmark.cpp
+ *
+ * CPU cost and alias/image suppression of SincResamplingSource at each quality
+ * against juce::ResamplingAudioSource, at the ratios the plugin meets most.
+ * A unit sine goes in; whatever comes out other than the expected tone (all of
+ * it, when the tone lies past the output Nyquist) is reported relative to the
+ * tone. Built with JUCE_UNIT_TESTS; run with
+ * juce::UnitTestRunner().runTestsInCategory("Benchmarks").
+ */
+
+#if JUCE_UNIT_TESTS
+
+class SincResamplerBenchmark : public juce::UnitTest
+{
+public:
+    SincResamplerBenchmark() : juce::UnitTest("SincResampler vs ResamplingAudioSource", "Benchmarks") {}
+
+    void runTest() override
+    {
+        for (const double ratio : { 0.5, 44100.0 / 48000.0, 48000.0 / 44100.0, 2.0, 4.0 })
+        {
+            beginTest("Ratio " + juce::String(ratio, 4));
+
+            // Upsampling: a tone high in the passband, so images show. Downsampling:
+            // a tone 20% past the output Nyquist, which should not come out at all
+            const double toneIn = ratio < 1.0 ? 0.4 : juce::jmin(0.49, 0.6 / ratio);
+
+            for (const auto quality : { SincKernelBank::Quality::draft, SincKernelBank::Quality::normal, SincKernelBank::Quality::mastering })
+            {
+                SineSource sine(toneIn);
+                SincResamplingSource resampler(&sine, 2);
+                resampler.setResamplingRatio(ratio);
+                resampler.setQuality(quality);
+
+                report("Sinc " + juce::String(quality == SincKernelBank::Quality::draft ? "draft"
+                    : quality == SincKernelBank::Quality::normal ? "normal" : "mastering"), resampler, toneIn * ratio);
+            }
+
+            SineSource sine(toneIn);
+            juce::ResamplingAudioSource resampler(&sine, false, 2);
+            resampler.setResamplingRatio(ratio);
+            report("juce::ResamplingAudioSource", resampler, toneIn * ratio);
+        }
+    }
+
+private:
+    static constexpr double outputRate = 48000.0;
+    static constexpr int    blockSize = 512;
+    static constexpr double secondsMeasured = 10.0;
+
+    /** A unit sine at a fixed frequency in cycles per input sample, on every channel. */
+    struct SineSource : public juce::AudioSource
+    {
+        explicit SineSource(double cyclesPerSample) : step(juce::MathConstants<double>::twoPi * cyclesPerSample) {}
+
+        void prepareToPlay(int, double) override {}
+        void releaseResources() override {}
+
+        void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+        {
+            for (int i = 0; i < info.numSamples; ++i)
+            {
+                const float value = (float)std::sin(phase);
+                phase = std::fmod(phase + step, juce::MathConstants<double>::twoPi);
+
+                for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+                    info.buffer->setSample(ch, info.startSample + i, value);
+            }
+        }
+
+        const double step;
+        double phase = 0.0;
+    };
+
+    void report(const juce::String& name, juce::AudioSource& resampler, double toneOut)
+    {
+        resampler.prepareToPlay(blockSize, outputRate);
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        const juce::AudioSourceChannelInfo info(&buffer, 0, blockSize);
+
+        // Let the filters settle before anything is measured
+        for (int i = 0; i < 16; ++i)
+            resampler.getNextAudioBlock(info);
+
+        const int numBlocks = (int)(secondsMeasured * outputRate / blockSize);
+        std::vector<float> output;
+        output.reserve((size_t)(numBlocks * blockSize));
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            resampler.getNextAudioBlock(info);
+            output.insert(output.end(), buffer.getReadPointer(0), buffer.getReadPointer(0) + blockSize);
+        }
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        resampler.releaseResources();
+
+        expect(seconds > 0.0);
+
+        logMessage("  " + name + ": " + juce::String(secondsMeasured / seconds, 1) + "x real time ("
+            + juce::String(seconds * 1.0e9 / (double)output.size(), 1) + " ns per stereo sample), unwanted output "
+            + juce::String(unwantedDb(output, toneOut), 1) + " dB");
+    }
+
+    /**
+     * Power of everything in x except a sine at cyclesPerSample (fitted by least
+     * squares, skipped past Nyquist), in dB relative to a unit sine.
+     */
+    static double unwantedDb(const std::vector<float>& x, double cyclesPerSample)
+    {
+        double total = 0.0;
+        for (const float v : x)
+            total += (double)v * v;
+
+        if (cyclesPerSample < 0.5)
+        {
+            const double w = juce::MathConstants<double>::twoPi * cyclesPerSample;
+            double cc = 0.0, ss = 0.0, cs = 0.0, xc = 0.0, xs = 0.0;
+
+            for (size_t n = 0; n < x.size(); ++n)
+            {
+                const double c = std::cos(w * (double)n);
+                const double s = std::sin(w * (double)n);
+                cc += c * c;
+                ss += s * s;
+                cs += c * s;
+                xc += x[n] * c;
+                xs += x[n] * s;
+            }
+
+            const double det = cc * ss - cs * cs;
+            const double a = (xc * ss - xs * cs) / det;
+            const double b = (xs * cc - xc * cs) / det;
+            total -= a * xc + b * xs;
+        }
+
+        return 10.0 * std::log10(juce::jmax(total / (double)x.size(), 1.0e-20) / 0.5);
+    }
+};
+
+static SincResamplerBenchmark sincResamplerBenchmark;
+
+#endif
@@ -0,0 +1,173 @@
+#include "StretchRenderCache.h"
+
+/**
+ * StretchRenderCache.cpp
+ *
+ * Settle detection, slice-by-slice offline rendering and the two-pointer
+ * handover between the worker and the audio thread.
+ */
+
+StretchRenderCache::StretchRenderCache()
+    : stretcher([this](juce::AudioBuffer<float>& dest, int destStart, int numSamples)
+        {
+            readJobInput(dest, destStart, numSamples);
+        })
+{
+}
+
+StretchRenderCache::~StretchRenderCache()
+{
+    // The owner has removed this client from its thread and stopped audio by now
+    delete ready.exchange(nullptr);
+    delete retired.exchange(nullptr);
+    delete active;
+}
+
+void StretchRenderCache::setSource(SampleStore::Ptr newSource)
+{
+    const juce::SpinLock::ScopedLockType sl(sourceLock);
+    pendingSource = std::move(newSource);
+}
+
+//==============================================================================
+const StretchRenderCache::Rendered* StretchRenderCache::getRendered(const SampleStore* source, double ratio, TimeStretcher::Mode mode)
+{
+    wantedRatio = ratio;
+    wantedMode = (int)mode;
+
+    // Only this thread fills `retired` and only the worker empties it, so an
+    // empty slot stays empty until we fill it
+    if (retired.load() == nullptr)
+    {
+        if (auto* fresh = ready.exchange(nullptr))
+        {
+            retired.store(active);
+            active = fresh;
+        }
+    }
+
+    if (active == nullptr)
+        return nullptr;
+
+    if (active->source.get() != source || active->ratio != ratio || active->mode != mode)
+    {
+        // Hand it back for freeing; if the slot is still busy, try again next block
+        if (retired.load() == nullptr)
+        {
+            retired.store(active);
+            active = nullptr;
+        }
+
+        return nullptr;
+    }
+
+    return active;
+}
+
+//==============================================================================
+int StretchRenderCache::useTimeSlice()
+{
+    delete retired.exchange(nullptr);
+
+    SampleStore::Ptr source;
+    {
+        const juce::SpinLock::ScopedLockType sl(sourceLock);
+        source = pendingSource;
+    }
+
+    const double ratio = wantedRatio.load();
+    const auto mode = (TimeStretcher::Mode)wantedMode.load();
+    const auto now = juce::Time::getMillisecondCounter();
+
+    // Anything changed: start waiting for it to settle again
+    if (source.get() != seenSource || ratio != seenRatio || mode != seenMode)
+    {
+        seenSource = source.get();
+        seenRatio = ratio;
+        seenMode = mode;
+        seenSince = now;
+        seenDone = false;
+        cancelJob();
+        return 20;
+    }
+
+    if (seenDone || source == nullptr || mode == TimeStretcher::Mode::off || ratio <= 0.0)
+        return 100;
+
+    if (now - seenSince < (juce::uint32)settleMs.load())
+        return 20;
+
+    if (jobOutput == nullptr && !startJob(source, ratio, mode))
+    {
+        seenDone = true;
+        return 100;
+    }
+
+    // One slice of output
+    const int total = jobOutput->getNumSamples();
+    const int num = juce::jmin(sliceSize, total - jobOutputPosition);
+
+    stretcher.process(jobOutput->getBuffer(), jobOutputPosition, num);
+    jobOutputPosition += num;
+    progress = (float)jobOutputPosition / (float)juce::jmax(1, total);
+
+    if (jobOutputPosition < total)
+        return 1;
+
+    // Done: kept in the source's encoding, and handed over (replacing a render
+    // the audio thread never picked up)
+    auto output = SampleStore::createCompact(*jobOutput, jobSource->getEncoding());
+    delete ready.exchange(new Rendered{ jobSource, output, jobRatio, jobMode });
+
+    cancelJob();
+    seenDone = true;
+    return 100;
+}
+
+bool StretchRenderCache::startJob(SampleStore::Ptr source, double ratio, TimeStretcher::Mode mode)
+{
+    const long long length = (long long)std::ceil((double)source->getNumSamples() / ratio);
+    const long long bytes = length * source->getNumChannels() * (long long)sizeof(float);
+
+    if (length <= 0 || length > std::numeric_limits<int>::max() || bytes > maxBytes.load())
+        return false;
+
+    jobSource = std::move(source);
+    jobOutput = new SampleStore(jobSource->getNumChannels(), (int)length, jobSource->getSampleRate());
+    jobRatio = ratio;
+    jobMode = mode;
+    jobInputPosition = 0;
+    jobOutputPosition = 0;
+
+    stretcher.setMode(mode);
+    stretcher.setRatio(ratio);
+    stretcher.prepare(jobSource->getSampleRate(), sliceSize, TimeStretcher::Quality::offline);
+    return true;
+}
+
+void StretchRenderCache::cancelJob()
+{
+    jobSource = nullptr;
+    jobOutput = nullptr;
+    progress = 0.0f;
+}
+
+void StretchRenderCache::readJobInput(juce::AudioBuffer<float>& dest, int destStart, int numSamples)
+{
+    const long long total = jobSource->getNumSamples();
+    const int numAvailable = (int)juce::jlimit(0LL, (long long)numSamples, total - jobInputPosition);
+    const int srcChannels = jobSource->getNumChannels();
+
+    for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+    {
+        // Mono files feed every channel
+        if (numAvailable > 0)
+            jobSource->read(juce::jmin(ch, srcChannels - 1), jobInputPosition, numAvailable,
+                dest.getWritePointer(ch, destStart));
+
+        if (numAvailable < numSamples)
+            dest.clear(ch, destStart + numAvailable, numSamples - numAvailable);
+    }
+
+    jobInputPosition += numSamples;
+}
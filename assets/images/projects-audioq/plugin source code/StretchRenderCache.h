@@ -0,0 +1,108 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "SampleStore.h"
+#include "TimeStretcher.h"
+
+/**
+ * StretchRenderCache
+ *
+ * Renders the loaded file ahead of time at the current tempo with the slow,
+ * high-quality TimeStretcher settings, so steady-tempo playback is plain RAM
+ * playback instead of real-time stretching.
+ *
+ * The audio thread reports the ratio and mode it is playing each block. Once
+ * they have stayed the same for the settle time, a TimeSliceThread renders the
+ * whole file in slices (other clients of the thread keep running). The finished
+ * render is handed over through an atomic pointer; the audio thread returns the
+ * one it stops using through another, and the worker frees it. The audio thread
+ * never allocates, frees or locks.
+ */
+class StretchRenderCache : public juce::TimeSliceClient
+{
+public:
+    /** Audio rendered for one file, ratio and mode. */
+    struct Rendered
+    {
+        SampleStore::Ptr    source;  ///< The file it was rendered from
+        SampleStore::Ptr    store;   ///< The stretched audio, at the file's sample rate
+        double              ratio = 1.0;
+        TimeStretcher::Mode mode = TimeStretcher::Mode::off;
+    };
+
+    StretchRenderCache();
+    ~StretchRenderCache() override;
+
+    /**
+     * Message thread: the file to render from (nullptr for streamed files).
+     * A render in progress for another file is abandoned.
+     */
+    void setSource(SampleStore::Ptr newSource);
+
+    /** How long the tempo must stay unchanged before rendering starts. */
+    void setSettleTimeMs(int ms) { settleMs = juce::jmax(0, ms); }
+
+    /** Renders larger than this are skipped, leaving real-time stretching on. */
+    void setMaxBytes(long long numBytes) { maxBytes = numBytes; }
+
+    /**
+     * Audio thread: records what is being played and returns the render that
+     * matches it exactly, or nullptr if there is none yet. Wait-free. The result
+     * stays valid until the next call.
+     */
+    const Rendered* getRendered(const SampleStore* source, double ratio, TimeStretcher::Mode mode);
+
+    /** Progress of the render in progress, 0..1 (0 when idle). */
+    float getProgress() const { return progress.load(); }
+
+    /** Renders a slice at a time on the TimeSliceThread. */
+    int useTimeSlice() override;
+
+private:
+    /** Allocates the output and prepares the stretcher; false if the render is too big. */
+    bool startJob(SampleStore::Ptr source, double ratio, TimeStretcher::Mode mode);
+
+    /** The stretcher's input: the job's source from jobInputPosition on, silent past its end. */
+    void readJobInput(juce::AudioBuffer<float>& dest, int destStart, int numSamples);
+
+    void cancelJob();
+
+    static constexpr int sliceSize = 16384;
+
+    // Handover: ready is written by the worker, retired by the audio thread
+    std::atomic<Rendered*> ready{ nullptr };
+    std::atomic<Rendered*> retired{ nullptr };
+
+    // Audio thread only
+    Rendered* active = nullptr;
+
+    // Written by the audio thread every block
+    std::atomic<double> wantedRatio{ 0.0 };
+    std::atomic<int>    wantedMode{ (int)TimeStretcher::Mode::off };
+
+    std::atomic<int>       settleMs{ 300 };
+    std::atomic<long long> maxBytes{ 512LL * 1024 * 1024 };
+    std::atomic<float>     progress{ 0.0f };
+
+    // Shared by setSource() and the worker only
+    juce::SpinLock   sourceLock;
+    SampleStore::Ptr pendingSource;
+
+    // Worker state: what was last asked for and since when, and what is already rendered
+    const SampleStore*  seenSource = nullptr;
+    double              seenRatio = 0.0;
+    TimeStretcher::Mode seenMode = TimeStretcher::Mode::off;
+    juce::uint32        seenSince = 0;
+    bool                seenDone = false;
+
+    // The render in progress
+    TimeStretcher       stretcher;
+    SampleStore::Ptr    jobSource, jobOutput;
+    double              jobRatio = 1.0;
+    TimeStretcher::Mode jobMode = TimeStretcher::Mode::off;
+    long long           jobInputPosition = 0;
+    int                 jobOutputPosition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StretchRenderCache)
+};
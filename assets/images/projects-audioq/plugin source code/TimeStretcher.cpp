@@ -0,0 +1,415 @@
+#include "TimeStretcher.h"
+
+/**
+ * TimeStretcher.cpp
+ *
+ * WSOLA and phase-vocoder frame synthesis, the input history the frames are
+ * read from and the overlap-add output.
+ */
+
+namespace
+{
+    /** Wraps a phase to [-pi, pi]. */
+    inline float principalArgument(float phase)
+    {
+        return phase - juce::MathConstants<float>::twoPi
+            * std::round(phase / juce::MathConstants<float>::twoPi);
+    }
+
+    /** Periodic Hann: overlapping copies at a hop of size / 2 sum to exactly 1. */
+    void fillHann(std::vector<float>& window, int size)
+    {
+        window.resize((size_t)size);
+
+        for (int i = 0; i < size; ++i)
+            window[(size_t)i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float)i / (float)size);
+    }
+}
+
+//==============================================================================
+TimeStretcher::TimeStretcher(InputProvider provider)
+    : input(std::move(provider))
+{
+}
+
+void TimeStretcher::prepare(double sampleRate, int maxBlockSize, Quality quality)
+{
+    const bool offline = (quality == Quality::offline);
+
+    // ~46 ms vocoder frames and ~23 ms WSOLA frames in real time; offline doubles both, and the overlap
+    const int base = (sampleRate > 50000.0 ? 4096 : 2048) * (offline ? 2 : 1);
+    const int overlap = offline ? 2 : 1;
+
+    vocoderGeometry = { base, base / (4 * overlap), 0 };
+    wsolaGeometry = { base / 2, base / (4 * overlap), base / 8 };
+
+    // Periodic Hann copies sum to frameSize / (2 hop); squared ones to 3 frameSize / (8 hop)
+    wsolaGeometry.outputGain = 2.0f * (float)wsolaGeometry.synthesisHop / (float)wsolaGeometry.frameSize;
+    vocoderGeometry.outputGain = 8.0f * (float)vocoderGeometry.synthesisHop / (3.0f * (float)vocoderGeometry.frameSize);
+
+    phaseLocking = offline;
+    maxBlock = juce::jmax(1, maxBlockSize);
+
+    fft = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2((double)base)));
+
+    fillHann(wsolaWindow, wsolaGeometry.frameSize);
+    fillHann(vocoderWindow, vocoderGeometry.frameSize);
+
+    // WSOLA only uses its window for synthesis, so the window carries the overlap gain
+    juce::FloatVectorOperations::multiply(wsolaWindow.data(), wsolaGeometry.outputGain, wsolaGeometry.frameSize);
+
+    // Enough history for a frame, its search range and a hop at the highest ratio
+    inputBuffer.setSize(numChannels, 4 * base);
+    olaBuffer.setSize(numChannels, base);
+
+    fftA.assign((size_t)(2 * base), 0.0f);
+    fftB.assign((size_t)(2 * base), 0.0f);
+    monoRegion.assign((size_t)base, 0.0f);
+
+    magnitudes.assign((size_t)(base / 2 + 1), 0.0f);
+    phases.assign((size_t)(base / 2 + 1), 0.0f);
+    peaks.assign((size_t)(base / 2 + 1), 0);
+    peakOfBin.assign((size_t)(base / 2 + 1), 0);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        lastPhase[(size_t)ch].assign((size_t)(base / 2 + 1), 0.0f);
+        sumPhase[(size_t)ch].assign((size_t)(base / 2 + 1), 0.0f);
+    }
+
+    mode = getMode();
+    reset();
+}
+
+void TimeStretcher::reset()
+{
+    const auto& g = geometryFor(mode);
+
+    // The first WSOLA frame may search searchRange samples back, into silence
+    inputBuffer.clear();
+    inputStart = 0;
+    inputEnd = g.searchRange;
+    analysisPosition = (double)g.searchRange;
+    previousFrameStart = -1;
+
+    olaBuffer.clear();
+    olaRead = g.synthesisHop;
+}
+
+//==============================================================================
+void TimeStretcher::process(juce::AudioBuffer<float>& out, int startSample, int numSamples)
+{
+    const auto wanted = getMode();
+    if (wanted != mode)
+    {
+        mode = wanted;
+        reset();
+    }
+
+    if (mode == Mode::off || fft == nullptr)
+    {
+        out.clear(startSample, numSamples);
+        return;
+    }
+
+    const int hop = geometryFor(mode).synthesisHop;
+    const int channels = juce::jmin(out.getNumChannels(), numChannels);
+
+    for (int done = 0; done < numSamples; )
+    {
+        if (olaRead >= hop)
+            produceFrame();
+
+        const int num = juce::jmin(numSamples - done, hop - olaRead);
+
+        for (int ch = 0; ch < channels; ++ch)
+            out.copyFrom(ch, startSample + done, olaBuffer, ch, olaRead, num);
+
+        olaRead += num;
+        done += num;
+    }
+}
+
+void TimeStretcher::produceFrame()
+{
+    const auto& g = geometryFor(mode);
+
+    // Drop the hop that was just played
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        float* ola = olaBuffer.getWritePointer(ch);
+        std::memmove(ola, ola + g.synthesisHop, sizeof(float) * (size_t)(g.frameSize - g.synthesisHop));
+        juce::FloatVectorOperations::clear(ola + g.frameSize - g.synthesisHop, g.synthesisHop);
+    }
+
+    const auto nominal = (long long)analysisPosition;
+    long long frameStart = nominal;
+
+    if (mode == Mode::wsola)
+    {
+        ensureInput(nominal + g.frameSize + g.searchRange);
+
+        if (previousFrameStart >= 0)
+            frameStart = findBestWsolaOffset(nominal);
+
+        synthesiseWsolaFrame(frameStart);
+    }
+    else
+    {
+        ensureInput(nominal + g.frameSize);
+
+        const int analysisHop = previousFrameStart >= 0
+            ? (int)(frameStart - previousFrameStart)
+            : juce::roundToInt(g.synthesisHop * ratio);
+
+        synthesiseVocoderFrame(frameStart, juce::jmax(1, analysisHop));
+    }
+
+    previousFrameStart = frameStart;
+    analysisPosition += g.synthesisHop * ratio;
+    olaRead = 0;
+}
+
+void TimeStretcher::ensureInput(long long absoluteEnd)
+{
+    if (absoluteEnd <= inputEnd)
+        return;
+
+    const int capacity = inputBuffer.getNumSamples();
+
+    if (absoluteEnd - inputStart > capacity)
+    {
+        // Keep what the next frame can still read: its search range and the
+        // natural continuation of the previous frame
+        const auto& g = geometryFor(mode);
+        long long keepFrom = (long long)analysisPosition - g.searchRange;
+
+        if (previousFrameStart >= 0)
+            keepFrom = juce::jmin(keepFrom, previousFrameStart + g.synthesisHop);
+
+        keepFrom = juce::jlimit(inputStart, inputEnd, keepFrom);
+
+        const int drop = (int)(keepFrom - inputStart);
+        const int keep = (int)(inputEnd - keepFrom);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            float* data = inputBuffer.getWritePointer(ch);
+            std::memmove(data, data + drop, sizeof(float) * (size_t)keep);
+        }
+
+        inputStart = keepFrom;
+    }
+
+    jassert(absoluteEnd - inputStart <= capacity);
+    absoluteEnd = juce::jmin(absoluteEnd, inputStart + capacity);
+
+    // Pull in chunks no bigger than the blocks the provider was prepared for
+    while (inputEnd < absoluteEnd)
+    {
+        const int num = (int)juce::jmin((long long)maxBlock, absoluteEnd - inputEnd);
+        input(inputBuffer, (int)(inputEnd - inputStart), num);
+        inputEnd += num;
+    }
+}
+
+const float* TimeStretcher::inputAt(int channel, long long absolutePosition) const
+{
+    jassert(absolutePosition >= inputStart && absolutePosition < inputEnd);
+    return inputBuffer.getReadPointer(channel, (int)(absolutePosition - inputStart));
+}
+
+//==============================================================================
+long long TimeStretcher::findBestWsolaOffset(long long nominal)
+{
+    const auto& g = geometryFor(mode);
+    const int templateLength = g.frameSize / 2;
+    const int range = g.searchRange;
+    const int regionLength = templateLength + 2 * range;
+    const int fftSize = fft->getSize();
+
+    juce::FloatVectorOperations::clear(fftA.data(), 2 * fftSize);
+    juce::FloatVectorOperations::clear(fftB.data(), 2 * fftSize);
+    juce::FloatVectorOperations::clear(monoRegion.data(), regionLength);
+
+    // Mono mixes: where the previous frame would naturally continue, and the search region
+    const long long templateStart = previousFrameStart + g.synthesisHop;
+    const long long regionStart = nominal - range;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        juce::FloatVectorOperations::add(fftA.data(), inputAt(ch, templateStart), templateLength);
+        juce::FloatVectorOperations::add(monoRegion.data(), inputAt(ch, regionStart), regionLength);
+    }
+
+    juce::FloatVectorOperations::copy(fftB.data(), monoRegion.data(), regionLength);
+
+    // Cross-correlation for every lag at once: IFFT(FFT(region) * conj(FFT(template))).
+    // regionLength <= fftSize, so lags 0..2 * range never wrap around.
+    fft->performRealOnlyForwardTransform(fftA.data());
+    fft->performRealOnlyForwardTransform(fftB.data());
+
+    for (int k = 0; k < fftSize; ++k)
+    {
+        const float ar = fftA[(size_t)(2 * k)], ai = fftA[(size_t)(2 * k + 1)];
+        const float br = fftB[(size_t)(2 * k)], bi = fftB[(size_t)(2 * k + 1)];
+
+        fftB[(size_t)(2 * k)] = br * ar + bi * ai;
+        fftB[(size_t)(2 * k + 1)] = bi * ar - br * ai;
+    }
+
+    fft->performRealOnlyInverseTransform(fftB.data());
+
+    // Normalise by the energy under the template at each lag, so loud passages don't always win
+    float energy = 0.0f;
+    for (int i = 0; i < templateLength; ++i)
+        energy += monoRegion[(size_t)i] * monoRegion[(size_t)i];
+
+    int bestLag = range;
+    float bestScore = -std::numeric_limits<float>::max();
+
+    for (int lag = 0; lag <= 2 * range; ++lag)
+    {
+        const float score = fftB[(size_t)lag] / std::sqrt(juce::jmax(energy, 1.0e-9f));
+
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestLag = lag;
+        }
+
+        if (lag < 2 * range)
+        {
+            const float leaving = monoRegion[(size_t)lag];
+            const float entering = monoRegion[(size_t)(lag + templateLength)];
+            energy += entering * entering - leaving * leaving;
+        }
+    }
+
+    return regionStart + bestLag;
+}
+
+void TimeStretcher::synthesiseWsolaFrame(long long frameStart)
+{
+    const int size = wsolaGeometry.frameSize;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        juce::FloatVectorOperations::addWithMultiply(olaBuffer.getWritePointer(ch),
+            inputAt(ch, frameStart), wsolaWindow.data(), size);
+}
+
+void TimeStretcher::synthesiseVocoderFrame(long long frameStart, int analysisHop)
+{
+    const int size = vocoderGeometry.frameSize;
+    const int synthesisHop = vocoderGeometry.synthesisHop;
+    const int numBins = size / 2 + 1;
+    const float binFrequency = juce::MathConstants<float>::twoPi / (float)size;
+    const bool firstFrame = previousFrameStart < 0;
+    const bool locked = phaseLocking && !firstFrame;
+
+    float* data = fftA.data();
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto& last = lastPhase[(size_t)ch];
+        auto& sum = sumPhase[(size_t)ch];
+
+        juce::FloatVectorOperations::multiply(data, inputAt(ch, frameStart), vocoderWindow.data(), size);
+        juce::FloatVectorOperations::clear(data + size, size);
+
+        fft->performRealOnlyForwardTransform(data, true);
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            const float re = data[2 * k];
+            const float im = data[2 * k + 1];
+            magnitudes[(size_t)k] = std::sqrt(re * re + im * im);
+            phases[(size_t)k] = std::atan2(im, re);
+        }
+
+        if (locked)
+            findSpectralPeaks(numBins);
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            if (firstFrame)
+            {
+                sum[(size_t)k] = phases[(size_t)k];
+            }
+            else if (!locked || peakOfBin[(size_t)k] == k)
+            {
+                // The bin's true frequency from how far its phase moved over the analysis hop
+                const float expected = binFrequency * (float)k * (float)analysisHop;
+                const float deviation = principalArgument(phases[(size_t)k] - last[(size_t)k] - expected);
+                const float frequency = binFrequency * (float)k + deviation / (float)analysisHop;
+
+                sum[(size_t)k] = principalArgument(sum[(size_t)k] + frequency * (float)synthesisHop);
+            }
+        }
+
+        // Bins around a peak keep their phase relation to it, which avoids the vocoder's "phasiness"
+        if (locked)
+        {
+            for (int k = 0; k < numBins; ++k)
+            {
+                const int peak = peakOfBin[(size_t)k];
+
+                if (peak != k)
+                    sum[(size_t)k] = principalArgument(sum[(size_t)peak] + phases[(size_t)k] - phases[(size_t)peak]);
+            }
+        }
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            last[(size_t)k] = phases[(size_t)k];
+
+            data[2 * k] = magnitudes[(size_t)k] * std::cos(sum[(size_t)k]);
+            data[2 * k + 1] = magnitudes[(size_t)k] * std::sin(sum[(size_t)k]);
+        }
+
+        // Mirror the negative frequencies so the inverse sees a complete real spectrum
+        for (int k = 1; k < size / 2; ++k)
+        {
+            data[2 * (size - k)] = data[2 * k];
+            data[2 * (size - k) + 1] = -data[2 * k + 1];
+        }
+
+        fft->performRealOnlyInverseTransform(data);
+
+        juce::FloatVectorOperations::multiply(data, vocoderWindow.data(), size);
+        juce::FloatVectorOperations::addWithMultiply(olaBuffer.getWritePointer(ch), data, vocoderGeometry.outputGain, size);
+    }
+}
+
+void TimeStretcher::findSpectralPeaks(int numBins)
+{
+    int numPeaks = 0;
+
+    for (int k = 0; k < numBins; ++k)
+    {
+        const float m = magnitudes[(size_t)k];
+        bool isPeak = m > 0.0f;
+
+        for (int d = -2; d <= 2 && isPeak; ++d)
+            if (d != 0 && k + d >= 0 && k + d < numBins && magnitudes[(size_t)(k + d)] > m)
+                isPeak = false;
+
+        if (isPeak)
+            peaks[(size_t)numPeaks++] = k;
+    }
+
+    // Each bin follows the nearest peak; with no peaks at all every bin is its own
+    for (int k = 0, p = 0; k < numBins; ++k)
+    {
+        if (numPeaks == 0)
+        {
+            peakOfBin[(size_t)k] = k;
+            continue;
+        }
+
+        while (p + 1 < numPeaks && std::abs(peaks[(size_t)(p + 1)] - k) <= std::abs(peaks[(size_t)p] - k))
+            ++p;
+
+        peakOfBin[(size_t)k] = peaks[(size_t)p];
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * TimeStretcher
+ *
+ * Changes playback speed without changing pitch. Output is produced frame by
+ * frame by overlap-adding windowed frames; input is pulled on demand from an
+ * InputProvider at `ratio` input samples per output sample.
+ *
+ * Two algorithms:
+ *  - WSOLA: each frame is taken from the input position (within a small search
+ *    range) that best continues the previous one, found by FFT cross-correlation.
+ *    Cheap and keeps transients sharp; best for drums and speech.
+ *  - Phase vocoder: frames are re-synthesised in the frequency domain with each
+ *    bin's phase advanced at its measured frequency. Smooth on tonal material.
+ *
+ * Output sample 0 lines up with input sample 0, so neither adds latency; after
+ * reset() the first frame (~23 ms for WSOLA, ~46 ms for the vocoder at 44.1 kHz)
+ * fades in while the overlap-add fills up.
+ *
+ * Both use juce::dsp::FFT (which uses the platform's vectorised FFT where
+ * available). All buffers and FFT plans are allocated in prepare(), so
+ * process() never allocates.
+ *
+ * Quality::offline is for rendering ahead of time (StretchRenderCache): twice
+ * the frame size, twice the overlap and, in the vocoder, phase locking around
+ * spectral peaks. It costs several times the CPU of Quality::realtime.
+ */
+class TimeStretcher
+{
+public:
+    enum class Mode { off = 0, wsola, phaseVocoder };
+    enum class Quality { realtime = 0, offline };
+
+    /** Writes the next numSamples input samples into dest (2 channels) from destStart. */
+    using InputProvider = std::function<void(juce::AudioBuffer<float>& dest, int destStart, int numSamples)>;
+
+    static constexpr int numChannels = 2;
+
+    explicit TimeStretcher(InputProvider provider);
+
+    void prepare(double sampleRate, int maxBlockSize, Quality quality = Quality::realtime);
+
+    /** Forgets all buffered input and output (e.g. after a jump or a new file). */
+    void reset();
+
+    /** Switching algorithm resets the stretcher at its next process() call. */
+    void setMode(Mode newMode) { requestedMode = (int)newMode; }
+    Mode getMode() const { return (Mode)requestedMode.load(); }
+
+    /** Input samples consumed per output sample (2.0 = twice as fast). */
+    void setRatio(double newRatio) { ratio = juce::jlimit(0.1, 8.0, newRatio); }
+
+    /** Fills numSamples of out (up to 2 channels) with stretched audio. */
+    void process(juce::AudioBuffer<float>& out, int startSample, int numSamples);
+
+private:
+    /** Frame size, hop and (WSOLA) search range of one algorithm at the current rate. */
+    struct Geometry
+    {
+        int frameSize = 0;
+        int synthesisHop = 0;
+        int searchRange = 0;
+        float outputGain = 1.0f;  ///< Undoes the window overlap
+    };
+
+    const Geometry& geometryFor(Mode m) const { return m == Mode::wsola ? wsolaGeometry : vocoderGeometry; }
+
+    /**
+     * Drops the synthesisHop samples already played from the overlap-add buffer
+     * and adds the next frame, finishing the next synthesisHop samples.
+     */
+    void produceFrame();
+
+    /** Makes sure input samples up to (not including) absoluteEnd are buffered. */
+    void ensureInput(long long absoluteEnd);
+
+    /** WSOLA: the frame start within +-searchRange of nominal that best continues the previous frame. */
+    long long findBestWsolaOffset(long long nominal);
+
+    void synthesiseWsolaFrame(long long frameStart);
+    void synthesiseVocoderFrame(long long frameStart, int analysisHop);
+
+    /** Phase locking: assigns every bin to its nearest spectral peak (a local maximum over +-2 bins). */
+    void findSpectralPeaks(int numBins);
+
+    const float* inputAt(int channel, long long absolutePosition) const;
+
+    //==============================================================================
+    InputProvider input;
+
+    std::atomic<int> requestedMode{ (int)Mode::off };
+    Mode   mode = Mode::off;
+    double ratio = 1.0;
+
+    Geometry wsolaGeometry, vocoderGeometry;
+    int maxBlock = 0;
+    bool phaseLocking = false;
+
+    // WSOLA correlates over twice its frame, which is the vocoder's frame size, so one plan serves both
+    std::unique_ptr<juce::dsp::FFT> fft;
+
+    // Periodic Hann windows for each frame size
+    std::vector<float> wsolaWindow, vocoderWindow;
+
+    // Input history: absolute stream positions [inputStart, inputEnd)
+    juce::AudioBuffer<float> inputBuffer;
+    long long inputStart = 0;
+    long long inputEnd = 0;
+
+    double    analysisPosition = 0.0;  ///< Absolute input position of the next frame
+    long long previousFrameStart = -1;
+
+    // Overlap-add accumulator, one frame long; its first synthesisHop samples are finished
+    juce::AudioBuffer<float> olaBuffer;
+    int olaRead = 0;
+
+    // Scratch
+    std::vector<float> fftA, fftB, monoRegion;
+    std::array<std::vector<float>, numChannels> lastPhase, sumPhase;
+    std::vector<float> magnitudes, phases;
+    std::vector<int>   peaks, peakOfBin;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TimeStretcher)
+};
@@ -0,0 +1,184 @@
+#include "WaveformOverview.h"
+
+/**
+ * WaveformOverview.cpp
+ *
+ * Reduces streamed chunks of audio to a base level of min/max/RMS peaks and
+ * decimates it by two per level to build the rest of the pyramid.
+ */
+
+namespace
+{
+    juce::int16 toPeakValue(float v)
+    {
+        return (juce::int16)juce::roundToInt(juce::jlimit(-1.0f, 1.0f, v) * 32767.0f);
+    }
+
+    float fromPeakValue(juce::int16 v)
+    {
+        return (float)v / 32767.0f;
+    }
+}
+
+//==============================================================================
+WaveformOverview::WaveformOverview(long long total, std::vector<Level> lvls, std::vector<Peak> data)
+    : totalSamples(total), levels(std::move(lvls)), peakData(std::move(data))
+{
+    peaks = peakData.data();
+}
+
+WaveformOverview::WaveformOverview(long long total, std::vector<Level> lvls,
+    std::unique_ptr<juce::MemoryMappedFile> mapped, const Peak* mappedPeaks)
+    : totalSamples(total), levels(std::move(lvls)), mappedFile(std::move(mapped)), peaks(mappedPeaks)
+{
+}
+
+size_t WaveformOverview::getTotalNumPeaks() const
+{
+    return levels.empty() ? 0 : levels.back().firstPeak + levels.back().numPeaks;
+}
+
+int WaveformOverview::findLevelFor(double samplesPerPixel) const
+{
+    int best = 0;
+
+    for (int i = 1; i < getNumLevels(); ++i)
+        if ((double)levels[(size_t)i].samplesPerPeak <= samplesPerPixel)
+            best = i;
+
+    return best;
+}
+
+WaveformOverview::PeakValues WaveformOverview::getPeak(int levelIndex, long long startSample, long long endSample) const
+{
+    PeakValues result;
+    if (isEmpty())
+        return result;
+
+    const auto& level = getLevel(juce::jlimit(0, getNumLevels() - 1, levelIndex));
+    const Peak* levelPeaks = peaks + level.firstPeak;
+
+    const long long first = juce::jlimit(0LL, (long long)level.numPeaks - 1, startSample / level.samplesPerPeak);
+    const long long last = juce::jlimit(first, (long long)level.numPeaks - 1, (endSample - 1) / level.samplesPerPeak);
+
+    juce::int16 mn = levelPeaks[first].minValue;
+    juce::int16 mx = levelPeaks[first].maxValue;
+    double sumOfSquares = 0.0;
+
+    for (long long i = first; i <= last; ++i)
+    {
+        mn = juce::jmin(mn, levelPeaks[i].minValue);
+        mx = juce::jmax(mx, levelPeaks[i].maxValue);
+
+        const double r = fromPeakValue(levelPeaks[i].rms);
+        sumOfSquares += r * r;
+    }
+
+    result.minValue = fromPeakValue(mn);
+    result.maxValue = fromPeakValue(mx);
+    result.rms = (float)std::sqrt(sumOfSquares / (double)(last - first + 1));
+    return result;
+}
+
+//==============================================================================
+WaveformOverviewBuilder::WaveformOverviewBuilder(long long total)
+    : totalSamples(juce::jmax(0LL, total))
+{
+    // Coarsen the base level for very long files so the pyramid stays bounded
+    while (totalSamples / samplesPerPeak > maxBasePeaks)
+        samplesPerPeak *= 2;
+
+    basePeaks.reserve((size_t)((totalSamples + samplesPerPeak - 1) / samplesPerPeak));
+}
+
+void WaveformOverviewBuilder::addSamples(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    const int numChannels = buffer.getNumChannels();
+    int done = 0;
+
+    while (done < numSamples && samplesProcessed < totalSamples)
+    {
+        // Process the part of the chunk that falls into the current peak
+        const long long peakEnd = (samplesProcessed / samplesPerPeak + 1) * samplesPerPeak;
+        const int num = (int)juce::jmin((long long)(numSamples - done), peakEnd - samplesProcessed);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const float* data = buffer.getReadPointer(ch, startSample + done);
+
+            auto range = juce::FloatVectorOperations::findMinAndMax(data, num);
+            currentMin = juce::jmin(currentMin, range.getStart());
+            currentMax = juce::jmax(currentMax, range.getEnd());
+
+            double sum = 0.0;
+            for (int i = 0; i < num; ++i)
+                sum += (double)data[i] * (double)data[i];
+
+            currentSumOfSquares += sum;
+        }
+
+        currentCount += (long long)num * numChannels;
+        samplesProcessed += num;
+        done += num;
+
+        if (samplesProcessed == peakEnd || samplesProcessed == totalSamples)
+            finishCurrentPeak();
+    }
+}
+
+void WaveformOverviewBuilder::finishCurrentPeak()
+{
+    WaveformOverview::Peak p;
+    p.minValue = toPeakValue(currentMin);
+    p.maxValue = toPeakValue(currentMax);
+    p.rms = toPeakValue(currentCount > 0 ? (float)std::sqrt(currentSumOfSquares / (double)currentCount) : 0.0f);
+    basePeaks.push_back(p);
+
+    currentMin = 0.0f;
+    currentMax = 0.0f;
+    currentSumOfSquares = 0.0;
+    currentCount = 0;
+}
+
+WaveformOverview::Ptr WaveformOverviewBuilder::getResult()
+{
+    if (currentCount > 0)
+        finishCurrentPeak();
+
+    if (basePeaks.empty())
+        return new WaveformOverview(totalSamples, {}, {});
+
+    std::vector<WaveformOverview::Level> levels;
+    std::vector<WaveformOverview::Peak> data(basePeaks.begin(), basePeaks.end());
+
+    levels.push_back({ samplesPerPeak, 0, basePeaks.size() });
+
+    // Each level merges pairs of peaks from the one below
+    while (levels.back().numPeaks > minTopLevelPeaks)
+    {
+        const auto below = levels.back();
+        const size_t numPeaks = (below.numPeaks + 1) / 2;
+        const size_t first = data.size();
+
+        data.resize(first + numPeaks);
+
+        for (size_t i = 0; i < numPeaks; ++i)
+        {
+            const auto& a = data[below.firstPeak + i * 2];
+            const auto& b = (i * 2 + 1 < below.numPeaks) ? data[below.firstPeak + i * 2 + 1] : a;
+
+            const double ra = fromPeakValue(a.rms);
+            const double rb = fromPeakValue(b.rms);
+
+            auto& p = data[first + i];
+            p.minValue = juce::jmin(a.minValue, b.minValue);
+            p.maxValue = juce::jmax(a.maxValue, b.maxValue);
+            p.rms = toPeakValue((float)std::sqrt((ra * ra + rb * rb) * 0.5));
+        }
+
+        levels.push_back({ below.samplesPerPeak * 2, first, numPeaks });
+    }
+
+    basePeaks.clear();
+    return new WaveformOverview(totalSamples, std::move(levels), std::move(data));
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+/**
+ * WaveformOverview
+ *
+ * A mipmapped peak pyramid summarising a whole file for display. Level 0 holds
+ * one min/max/RMS peak per samplesPerPeak samples (a power of two); every level
+ * above halves the resolution of the one below. A view of any zoom then renders
+ * in O(width) by picking the level that matches its samples-per-pixel.
+ *
+ * Peaks are stored as 16-bit values. The base resolution is chosen so that the
+ * whole pyramid stays under a fixed size whatever the file length. The peak data
+ * either lives on the heap or directly in a memory-mapped peak cache file.
+ */
+class WaveformOverview : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<WaveformOverview>;
+
+    /** One stored peak: min, max and RMS of its samples, scaled to +-32767. */
+    struct Peak
+    {
+        juce::int16 minValue = 0;
+        juce::int16 maxValue = 0;
+        juce::int16 rms = 0;
+    };
+
+    /** A peak expanded back to floats in [-1..1]. */
+    struct PeakValues
+    {
+        float minValue = 0.0f;
+        float maxValue = 0.0f;
+        float rms = 0.0f;
+    };
+
+    struct Level
+    {
+        long long samplesPerPeak = 0;
+        size_t    firstPeak = 0;    ///< Offset of this level's peaks in the peak data
+        size_t    numPeaks = 0;
+    };
+
+    WaveformOverview(long long totalSamples, std::vector<Level> levels, std::vector<Peak> peakData);
+
+    /** Wraps peak data that lives inside a memory-mapped peak cache file. */
+    WaveformOverview(long long totalSamples, std::vector<Level> levels,
+        std::unique_ptr<juce::MemoryMappedFile> mappedFile, const Peak* mappedPeaks);
+
+    long long getTotalSamples() const { return totalSamples; }
+    int       getNumLevels()    const { return (int)levels.size(); }
+    bool      isEmpty()         const { return levels.empty(); }
+
+    const Level& getLevel(int index) const { return levels[(size_t)index]; }
+    const Peak*  getPeaks(int index) const { return peaks + levels[(size_t)index].firstPeak; }
+
+    /** All levels' peaks back to back, as written to the peak cache. */
+    const Peak* getPeakData() const { return peaks; }
+    size_t      getTotalNumPeaks() const;
+
+    /** The coarsest level with at least one peak per pixel at this zoom. */
+    int findLevelFor(double samplesPerPixel) const;
+
+    /** Combines the peaks of a level covering samples [startSample, endSample). */
+    PeakValues getPeak(int levelIndex, long long startSample, long long endSample) const;
+
+private:
+    long long          totalSamples = 0;
+    std::vector<Level> levels;
+    std::vector<Peak>  peakData;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    const Peak*        peaks = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformOverview)
+};
+
+/**
+ * WaveformOverviewBuilder
+ *
+ * Builds a WaveformOverview from audio fed in consecutive chunks, so a file of
+ * any length can be summarised while holding only one chunk of PCM at a time.
+ */
+class WaveformOverviewBuilder
+{
+public:
+    explicit WaveformOverviewBuilder(long long totalSamples);
+
+    /** Feeds the next numSamples samples of the file (all channels of buffer). */
+    void addSamples(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    /** Finishes the base level, builds the levels above it and returns the pyramid. */
+    WaveformOverview::Ptr getResult();
+
+    static constexpr long long minSamplesPerPeak = 64;
+    static constexpr long long maxBasePeaks = 1 << 21;
+    static constexpr size_t    minTopLevelPeaks = 256;
+
+private:
+    void finishCurrentPeak();
+
+    long long totalSamples = 0;
+    long long samplesPerPeak = minSamplesPerPeak;
+    long long samplesProcessed = 0;
+
+    std::vector<WaveformOverview::Peak> basePeaks;
+
+    // Running values for the base peak being filled
+    float     currentMin = 0.0f;
+    float     currentMax = 0.0f;
+    double    currentSumOfSquares = 0.0;
+    long long currentCount = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformOverviewBuilder)
+};